@@ -3,6 +3,8 @@
 #include <climits>    // Limits constants
 #include <fstream>    // File operations
 #include <sstream>    // String stream
+#include <unordered_map>  // ID indexes
+#include "entity_store.h"  // Growable entity storage
 
 using namespace std;
 
@@ -34,60 +36,57 @@ struct Dispatcher {
 
 class EmergencyManager {
 private:
-    Station stations[10];         // Stations array
-    Incident incidents[10];       // Incidents array
-    Dispatcher dispatchers[10];   // Dispatchers array
-    int numStations = 0;          // Station count
-    int numIncidents = 0;         // Incident count
-    int numDispatchers = 0;       // Dispatcher count
+    EntityBackend<Station> stations;         // Stations store
+    EntityBackend<Incident> incidents;       // Incidents store
+    EntityBackend<Dispatcher> dispatchers;   // Dispatchers store
+    unordered_map<int, EntityHandle> stationIndex;    // Station ID -> first station with it
+    unordered_map<int, EntityHandle> incidentIndex;   // Incident ID -> first incident with it
 
     int calculateShortestDistance(int x1, int y1, int x2, int y2) {  // Calculate distance
         return abs(x1 - x2) + abs(y1 - y2);
     }
 
+    Incident* findIncident(int incidentId) {  // Incident by ID
+        auto found = incidentIndex.find(incidentId);
+        return found != incidentIndex.end() ? incidents.get(found->second) : nullptr;
+    }
+
+    Station* findStation(int stationId) {  // Station by ID
+        auto found = stationIndex.find(stationId);
+        return found != stationIndex.end() ? stations.get(found->second) : nullptr;
+    }
+
+    void insertIncident(const Incident& incident) {  // Store and index
+        EntityHandle handle = incidents.insert(incident);
+        incidentIndex.emplace(incident.id, handle);
+    }
+
 public:
     void addStation(int id, int x, int y, const string& name) {  // Add station
-        if (numStations < 10) {
-            stations[numStations] = { id, x, y, name };
-            ++numStations;
-        }
-        else {
-            cout << "Max stations limit reached.\n";
-        }
+        EntityHandle handle = stations.insert({ id, x, y, name });
+        stationIndex.emplace(id, handle);
     }
 
     void addIncident(int id, int x, int y, int reportTime, int responseTime) {  // Add incident
-        if (numIncidents < 10) {
-            incidents[numIncidents] = { id, x, y, reportTime, responseTime, -1 };
-            ++numIncidents;
-        }
-        else {
-            cout << "Max incidents limit reached.\n";
-        }
+        insertIncident({ id, x, y, reportTime, responseTime, -1 });
     }
 
     void addDispatcher(int id, int x, int y) {  // Add dispatcher
-        if (numDispatchers < 10) {
-            dispatchers[numDispatchers] = { id, x, y };
-            ++numDispatchers;
-        }
-        else {
-            cout << "Max dispatchers limit reached.\n";
-        }
+        dispatchers.insert({ id, x, y });
     }
 
     void printLocations() {  // Print locations
         cout << "Stations:\n";
-        for (int i = 0; i < numStations; ++i) {
-            stations[i].printDetails();
+        for (Station& station : stations) {
+            station.printDetails();
         }
         cout << "Incidents:\n";
-        for (int i = 0; i < numIncidents; ++i) {
-            cout << "ID: " << incidents[i].id << ", Coordinates: (" << incidents[i].x << ", " << incidents[i].y << ")" << endl;
+        for (const Incident& incident : incidents) {
+            cout << "ID: " << incident.id << ", Coordinates: (" << incident.x << ", " << incident.y << ")" << endl;
         }
         cout << "Dispatchers:\n";
-        for (int i = 0; i < numDispatchers; ++i) {
-            cout << "ID: " << dispatchers[i].id << ", Coordinates: (" << dispatchers[i].x << ", " << dispatchers[i].y << ")" << endl;
+        for (const Dispatcher& dispatcher : dispatchers) {
+            cout << "ID: " << dispatcher.id << ", Coordinates: (" << dispatcher.x << ", " << dispatcher.y << ")" << endl;
         }
     }
 
@@ -96,16 +95,16 @@ public:
         for (int i = 0; i < 5; ++i) {
             for (int j = 0; j < 5; ++j) {
                 bool found = false;
-                for (int k = 0; k < numStations; ++k) {
-                    if (stations[k].x == i && stations[k].y == j) {
+                for (const Station& station : stations) {
+                    if (station.x == i && station.y == j) {
                         cout << "S ";
                         found = true;
                         break;
                     }
                 }
                 if (!found) {
-                    for (int k = 0; k < numIncidents; ++k) {
-                        if (incidents[k].x == i && incidents[k].y == j) {
+                    for (const Incident& incident : incidents) {
+                        if (incident.x == i && incident.y == j) {
                             cout << "I ";
                             found = true;
                             break;
@@ -121,96 +120,88 @@ public:
     }
 
     int calculateShortestDistanceToStation(int incidentId) {  // Distance to station
-        int incidentIndex = -1;
-        for (int i = 0; i < numIncidents; ++i) {
-            if (incidents[i].id == incidentId) {
-                incidentIndex = i;
-                break;
-            }
-        }
-
-        if (incidentIndex == -1) {
+        Incident* incident = findIncident(incidentId);
+        if (incident == nullptr) {
             cout << "Incident with ID " << incidentId << " not found.\n";
             return -1;
         }
 
-        int stationIndex = -1;
-        for (int i = 0; i < numStations; ++i) {
-            if (stations[i].id == incidents[incidentIndex].reportedFromStationId) {
-                stationIndex = i;
-                break;
-            }
-        }
-
-        if (stationIndex == -1) {
-            cout << "Station with ID " << incidents[incidentIndex].reportedFromStationId << " not found.\n";
+        Station* station = findStation(incident->reportedFromStationId);
+        if (station == nullptr) {
+            cout << "Station with ID " << incident->reportedFromStationId << " not found.\n";
             return -1;
         }
 
-        return calculateShortestDistance(incidents[incidentIndex].x, incidents[incidentIndex].y, stations[stationIndex].x, stations[stationIndex].y);
+        return calculateShortestDistance(incident->x, incident->y, station->x, station->y);
     }
 
     void assignDispatcher(int incidentId) {  // Assign dispatcher
-        int incidentIndex = -1;
-        for (int i = 0; i < numIncidents; ++i) {
-            if (incidents[i].id == incidentId) {
-                incidentIndex = i;
-                break;
-            }
+        Incident* incident = findIncident(incidentId);
+        if (incident == nullptr) {
+            cout << "Incident with ID " << incidentId << " not found.\n";
+            return;
         }
 
-        if (incidentIndex == -1) {
-            cout << "Incident with ID " << incidentId << " not found.\n";
+        int distance;
+        int closestId = nearestDispatcher(incident->x, incident->y, &distance);
+        if (closestId == -1) {
+            cout << "No available dispatchers.\n";
             return;
         }
 
+        cout << "Incident assigned to dispatcher ID " << closestId << ".\n";
+    }
+
+    // Closest dispatcher to a point by Manhattan distance, ties to the one
+    // added first; returns its ID, or -1 if there are none. Prints nothing.
+    int nearestDispatcher(int x, int y, int* distanceOut) {
         int minDistance = INT_MAX;
-        int closestDispatcherIndex = -1;
-        for (int i = 0; i < numDispatchers; ++i) {
-            int distance = calculateShortestDistance(incidents[incidentIndex].x, incidents[incidentIndex].y, dispatchers[i].x, dispatchers[i].y);
+        const Dispatcher* closestDispatcher = nullptr;
+        for (const Dispatcher& dispatcher : dispatchers) {
+            int distance = calculateShortestDistance(x, y, dispatcher.x, dispatcher.y);
             if (distance < minDistance) {
                 minDistance = distance;
-                closestDispatcherIndex = i;
+                closestDispatcher = &dispatcher;
             }
         }
-
-        if (closestDispatcherIndex == -1) {
-            cout << "No available dispatchers.\n";
-            return;
+        if (closestDispatcher == nullptr) {
+            return -1;
         }
-
-        cout << "Incident assigned to dispatcher ID " << dispatchers[closestDispatcherIndex].id << ".\n";
+        *distanceOut = minDistance;
+        return closestDispatcher->id;
     }
 
     void reportIncident(int incidentId) {  // Report incident
-        int incidentIndex = -1;
-        for (int i = 0; i < numIncidents; ++i) {
-            if (incidents[i].id == incidentId) {
-                incidentIndex = i;
-                break;
-            }
-        }
-
-        if (incidentIndex == -1) {
+        Incident* incident = findIncident(incidentId);
+        if (incident == nullptr) {
             cout << "Incident with ID " << incidentId << " not found.\n";
             return;
         }
 
         cout << "Select a station:\n";
-        for (int i = 0; i < numStations; ++i) {
-            cout << i + 1 << ". " << stations[i].name << endl;
+        int number = 0;
+        for (const Station& station : stations) {
+            cout << ++number << ". " << station.name << endl;
         }
         int stationIndex;
         cout << "Enter station index: ";
         cin >> stationIndex;
 
-        if (stationIndex < 1 || stationIndex > numStations) {
+        if (stationIndex < 1 || stationIndex > (int)stations.size()) {
             cout << "Invalid station index.\n";
             return;
         }
 
-        incidents[incidentIndex].reportedFromStationId = stations[stationIndex - 1].id;
-        cout << "Incident reported from station ID " << stations[stationIndex - 1].id << ".\n";
+        const Station* chosen = nullptr;
+        number = 0;
+        for (const Station& station : stations) {
+            if (++number == stationIndex) {
+                chosen = &station;
+                break;
+            }
+        }
+        incident->reportedFromStationId = chosen->id;
+        cout << "Incident reported from station ID " << chosen->id << ".\n";
     }
 
     void autoAddCustomerAssignIncident() {  // Auto add and assign
@@ -244,18 +235,18 @@ public:
         }
 
         outFile << "Stations:\n";
-        for (int i = 0; i < numStations; ++i) {
-            outFile << stations[i].id << " " << stations[i].x << " " << stations[i].y << " " << stations[i].name << "\n";
+        for (const Station& station : stations) {
+            outFile << station.id << " " << station.x << " " << station.y << " " << station.name << "\n";
         }
 
         outFile << "Incidents:\n";
-        for (int i = 0; i < numIncidents; ++i) {
-            outFile << incidents[i].id << " " << incidents[i].x << " " << incidents[i].y << " " << incidents[i].reportTime << " " << incidents[i].responseTime << " " << incidents[i].reportedFromStationId << "\n";
+        for (const Incident& incident : incidents) {
+            outFile << incident.id << " " << incident.x << " " << incident.y << " " << incident.reportTime << " " << incident.responseTime << " " << incident.reportedFromStationId << "\n";
         }
 
         outFile << "Dispatchers:\n";
-        for (int i = 0; i < numDispatchers; ++i) {
-            outFile << dispatchers[i].id << " " << dispatchers[i].x << " " << dispatchers[i].y << "\n";
+        for (const Dispatcher& dispatcher : dispatchers) {
+            outFile << dispatcher.id << " " << dispatcher.x << " " << dispatcher.y << "\n";
         }
 
         outFile.close();
@@ -269,35 +260,44 @@ public:
             return;
         }
 
+        // Sections follow each other without blank lines, so switch on the headers
         string line;
-        getline(inFile, line);  // Skip "Stations:"
-        numStations = 0;
-        while (getline(inFile, line) && !line.empty()) {
-            int id, x, y;
-            string name;
-            istringstream iss(line);
-            iss >> id >> x >> y;
-            getline(iss, name);
-            addStation(id, x, y, name.substr(1));  // Skip leading space
-        }
-
-        getline(inFile, line);  // Skip "Incidents:"
-        numIncidents = 0;
-        while (getline(inFile, line) && !line.empty()) {
-            int id, x, y, reportTime, responseTime, reportedFromStationId;
-            istringstream iss(line);
-            iss >> id >> x >> y >> reportTime >> responseTime >> reportedFromStationId;
-            addIncident(id, x, y, reportTime, responseTime);
-            incidents[numIncidents - 1].reportedFromStationId = reportedFromStationId;
-        }
+        string section;
+        stations.clear();
+        incidents.clear();
+        dispatchers.clear();
+        stationIndex.clear();
+        incidentIndex.clear();
+        while (getline(inFile, line)) {
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            if (line.empty()) {
+                continue;
+            }
+            if (line == "Stations:" || line == "Incidents:" || line == "Dispatchers:") {
+                section = line;
+                continue;
+            }
 
-        getline(inFile, line);  // Skip "Dispatchers:"
-        numDispatchers = 0;
-        while (getline(inFile, line) && !line.empty()) {
-            int id, x, y;
             istringstream iss(line);
-            iss >> id >> x >> y;
-            addDispatcher(id, x, y);
+            if (section == "Stations:") {
+                int id, x, y;
+                string name;
+                iss >> id >> x >> y;
+                getline(iss, name);
+                addStation(id, x, y, name.empty() ? name : name.substr(1));  // Skip leading space
+            }
+            else if (section == "Incidents:") {
+                int id, x, y, reportTime, responseTime, reportedFromStationId = -1;
+                iss >> id >> x >> y >> reportTime >> responseTime >> reportedFromStationId;
+                insertIncident({ id, x, y, reportTime, responseTime, reportedFromStationId });
+            }
+            else if (section == "Dispatchers:") {
+                int id, x, y;
+                iss >> id >> x >> y;
+                addDispatcher(id, x, y);
+            }
         }
 
         inFile.close();
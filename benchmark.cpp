@@ -0,0 +1,506 @@
+// Benchmark suite for EmergencyManager.
+//
+// Builds both programs into one binary, each inside its own namespace, and
+// times the same scenarios against each:
+//   list  - dsProject_22i0503_21i0281_verfinal.cpp (linked lists + indexes)
+//   array - 21i0281_22i0503_ds_project.cpp (entity stores, linear scans)
+//
+// Build:  g++ -std=c++17 -O2 -pthread -o benchmark benchmark.cpp
+// Usage:  benchmark [--sizes 10,1000,100000] [--dist uniform,clustered]
+//                   [--scenarios insert,lookup,nearest,saveload,map,sharded,staging]
+//                   [--builds list,array] [--queries N] [--seed S] [--tmp DIR]
+//                   [--shards 1,2,4]
+//
+// Every result is one JSON object per line on stdout with latency
+// percentiles in nanoseconds, so runs can be diffed or loaded into a sheet.
+
+// Standard, system and shared headers used by the two programs. They are
+// included here first so their include guards keep them out of the
+// namespaces below.
+#include <iostream>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <cmath>
+#include <climits>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <queue>
+#include <utility>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <chrono>
+#include <charconv>
+#include <new>
+#include <type_traits>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <random>
+#include <unordered_map>
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#endif
+#include "entity_store.h"
+
+namespace listbuild {
+#define main rescuenet_list_main
+#include "dsProject_22i0503_21i0281_verfinal.cpp"
+#undef main
+}
+
+namespace arraybuild {
+#define main rescuenet_array_main
+#include "21i0281_22i0503_ds_project.cpp"
+#undef main
+}
+
+using namespace std;
+
+const size_t ARRAY_BUILD_SCAN_LIMIT = 10000;   // Past this the array build's linear lookups take minutes
+
+struct Point {
+    int x, y;
+};
+
+// Seeded synthetic city: uniform over a square, or clustered around a few
+// hotspots with normally distributed spread
+class WorkloadGenerator {
+private:
+    mt19937_64 rng;
+    int extent;                 // Coordinates fall in [0, extent)
+    bool clustered;
+    vector<Point> centres;
+
+public:
+    WorkloadGenerator(uint64_t seed, size_t n, bool clustered) : rng(seed), clustered(clustered) {
+        extent = max(10, (int)(sqrt((double)n) * 10));
+        size_t hotspots = max((size_t)1, (size_t)sqrt((double)n) / 10);
+        uniform_int_distribution<int> coordinate(0, extent - 1);
+        for (size_t i = 0; i < hotspots; ++i) {
+            centres.push_back(Point{ coordinate(rng), coordinate(rng) });
+        }
+    }
+
+    Point next() {
+        if (!clustered) {
+            uniform_int_distribution<int> coordinate(0, extent - 1);
+            return Point{ coordinate(rng), coordinate(rng) };
+        }
+        const Point& centre = centres[uniform_int_distribution<size_t>(0, centres.size() - 1)(rng)];
+        normal_distribution<double> spread(0.0, extent / 50.0 + 1.0);
+        int x = (int)lround(centre.x + spread(rng));
+        int y = (int)lround(centre.y + spread(rng));
+        return Point{ min(max(x, 0), extent - 1), min(max(y, 0), extent - 1) };
+    }
+
+    int nextId(int count) {
+        return uniform_int_distribution<int>(0, count - 1)(rng);
+    }
+};
+
+// Latency samples of one scenario
+class LatencyRecorder {
+private:
+    vector<uint64_t> samples;
+    chrono::steady_clock::time_point started;
+    double totalSeconds;
+    size_t operations;
+
+public:
+    LatencyRecorder() : totalSeconds(0), operations(0) {}
+
+    void begin() {
+        started = chrono::steady_clock::now();
+    }
+
+    void end(size_t ops = 1) {
+        uint64_t ns = (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - started).count();
+        samples.push_back(ns / ops);
+        totalSeconds += ns / 1e9;
+        operations += ops;
+    }
+
+    uint64_t percentile(double p) {
+        if (samples.empty()) {
+            return 0;
+        }
+        size_t rank = min(samples.size() - 1, (size_t)(p * (samples.size() - 1) + 0.5));
+        nth_element(samples.begin(), samples.begin() + rank, samples.end());
+        return samples[rank];
+    }
+
+    void report(const string& build, const string& scenario, const string& dist, size_t n) {
+        cout << "{\"build\":\"" << build << "\",\"scenario\":\"" << scenario << "\",\"dist\":\"" << dist
+            << "\",\"n\":" << n << ",\"ops\":" << operations << ",\"total_ms\":" << totalSeconds * 1000
+            << ",\"ops_per_s\":" << (totalSeconds > 0 ? operations / totalSeconds : 0)
+            << ",\"p50_ns\":" << percentile(0.50) << ",\"p90_ns\":" << percentile(0.90)
+            << ",\"p99_ns\":" << percentile(0.99) << ",\"max_ns\":" << percentile(1.0) << "}\n";
+    }
+};
+
+// Discards everything the managers print while they are being timed
+class NullBuffer : public streambuf {
+protected:
+    int overflow(int ch) override {
+        return ch;
+    }
+
+    streamsize xsputn(const char*, streamsize count) override {
+        return count;
+    }
+};
+
+struct Options {
+    vector<size_t> sizes;
+    vector<string> distributions;
+    vector<string> scenarios;
+    vector<string> builds;
+    vector<size_t> shardCounts;
+    size_t queries;
+    uint64_t seed;
+    string tmpDir;
+};
+
+bool wants(const vector<string>& list, const string& name) {
+    return find(list.begin(), list.end(), name) != list.end();
+}
+
+vector<string> splitList(const string& text) {
+    vector<string> parts;
+    stringstream ss(text);
+    string part;
+    while (getline(ss, part, ',')) {
+        if (!part.empty()) {
+            parts.push_back(part);
+        }
+    }
+    return parts;
+}
+
+// Closest-unit query for the nearest scenario: both builds run a print-free
+// Manhattan search from the incident's location and send nothing out, so
+// the fleet stays the same size across queries
+int nearestQuery(listbuild::EmergencyManager* manager, Point at) {
+    int distance;
+    return manager->nearestAvailable(at.x, at.y, &distance);
+}
+
+int nearestQuery(arraybuild::EmergencyManager* manager, Point at) {
+    int distance;
+    return manager->nearestDispatcher(at.x, at.y, &distance);
+}
+
+// What the insert phase placed, by ID
+struct Placement {
+    vector<Point> stations, incidents, dispatchers;
+};
+
+// Station incident i is reported from before the lookup scenario
+int reportingStation(size_t i, size_t n) {
+    return (int)((i * 7919) % n);
+}
+
+// Links every incident to a station so lookups resolve both IDs
+void reportIncidents(listbuild::EmergencyManager* manager, const Placement& placed, const Options&) {
+    size_t n = placed.incidents.size();
+    for (size_t i = 0; i < n; ++i) {
+        manager->reportIncident((int)i, reportingStation(i, n));
+    }
+}
+
+// The array build only reports interactively, so it gets the same links by
+// reloading the placed records from a state file that carries them
+void reportIncidents(arraybuild::EmergencyManager* manager, const Placement& placed, const Options& options) {
+    size_t n = placed.incidents.size();
+    string file = options.tmpDir + "/bench_reports_array.txt";
+    ofstream out(file);
+    out << "Stations:\n";
+    for (size_t i = 0; i < n; ++i) {
+        out << i << " " << placed.stations[i].x << " " << placed.stations[i].y << " Station " << i << "\n";
+    }
+    out << "Incidents:\n";
+    for (size_t i = 0; i < n; ++i) {
+        out << i << " " << placed.incidents[i].x << " " << placed.incidents[i].y << " " << i << " " << i + 10 << " " << reportingStation(i, n) << "\n";
+    }
+    out << "Dispatchers:\n";
+    for (size_t i = 0; i < n; ++i) {
+        out << i << " " << placed.dispatchers[i].x << " " << placed.dispatchers[i].y << "\n";
+    }
+    out.close();
+    manager->loadFromFile(file);
+    remove(file.c_str());
+}
+
+// Runs every selected scenario against one build. Manager is either
+// listbuild::EmergencyManager or arraybuild::EmergencyManager; both expose
+// the same operations.
+template <typename Manager>
+void runBuild(const string& build, const Options& options, size_t n, const string& dist) {
+    NullBuffer sink;
+    streambuf* console = cout.rdbuf();
+    bool clustered = dist == "clustered";
+    Manager* manager = new Manager();
+    WorkloadGenerator generator(options.seed, n, clustered);
+
+    // Insert: stations, incidents and dispatchers, n of each
+    LatencyRecorder insert;
+    Placement placed;
+    cout.rdbuf(&sink);
+    for (size_t i = 0; i < n; ++i) {
+        Point s = generator.next(), in = generator.next(), d = generator.next();
+        placed.stations.push_back(s);
+        placed.incidents.push_back(in);
+        placed.dispatchers.push_back(d);
+        insert.begin();
+        manager->addStation((int)i, s.x, s.y, "Station " + to_string(i));
+        insert.end();
+        insert.begin();
+        manager->addIncident((int)i, in.x, in.y, (int)i, (int)i + 10);
+        insert.end();
+        insert.begin();
+        manager->addDispatcher((int)i, d.x, d.y);
+        insert.end();
+    }
+    cout.rdbuf(console);
+    if (wants(options.scenarios, "insert")) {
+        insert.report(build, "insert", dist, n);
+    }
+
+    size_t queries = min(options.queries, max(n, (size_t)1));
+    if (wants(options.scenarios, "lookup")) {
+        // Incident and station resolution by ID
+        LatencyRecorder lookup;
+        cout.rdbuf(&sink);
+        if (n > 0) {
+            reportIncidents(manager, placed, options);
+        }
+        for (size_t q = 0; q < queries; ++q) {
+            int id = generator.nextId((int)n);
+            lookup.begin();
+            manager->calculateShortestDistanceToStation(id);
+            lookup.end();
+        }
+        cout.rdbuf(console);
+        lookup.report(build, "lookup", dist, n);
+    }
+
+    if (wants(options.scenarios, "nearest")) {
+        LatencyRecorder nearest;
+        volatile int found = 0;  // Keeps the print-free searches from being optimized out
+        cout.rdbuf(&sink);
+        for (size_t q = 0; q < queries; ++q) {
+            int id = generator.nextId((int)n);
+            nearest.begin();
+            found = nearestQuery(manager, placed.incidents[id]);
+            nearest.end();
+        }
+        (void)found;
+        cout.rdbuf(console);
+        nearest.report(build, "nearest", dist, n);
+    }
+
+    if (wants(options.scenarios, "saveload")) {
+        string file = options.tmpDir + "/bench_state_" + build + ".txt";
+        int repetitions = n <= 100000 ? 5 : 1;
+        LatencyRecorder save, load;
+        cout.rdbuf(&sink);
+        for (int r = 0; r < repetitions; ++r) {
+            save.begin();
+            manager->saveToFile(file);
+            save.end();
+            load.begin();
+            manager->loadFromFile(file);
+            load.end();
+        }
+        cout.rdbuf(console);
+        remove(file.c_str());
+        save.report(build, "save", dist, n);
+        load.report(build, "load", dist, n);
+    }
+
+    if (wants(options.scenarios, "map")) {
+        // Repeat for up to a second or 1000 frames
+        LatencyRecorder map;
+        cout.rdbuf(&sink);
+        chrono::steady_clock::time_point until = chrono::steady_clock::now() + chrono::seconds(1);
+        for (int frame = 0; frame < 1000 && chrono::steady_clock::now() < until; ++frame) {
+            map.begin();
+            manager->displayMap();
+            map.end();
+        }
+        cout.rdbuf(console);
+        map.report(build, "map", dist, n);
+    }
+
+    cout.rdbuf(&sink);
+    delete manager;
+    cout.rdbuf(console);
+    cout.flush();
+}
+
+// Sharded intake (list build only): n dispatchers split into strips, then
+// up to n / 2 incidents submitted and assigned by the shard workers. One
+// sample per run, so the ops_per_s column is the throughput to compare
+// across shard counts.
+void runSharded(const Options& options, size_t n, const string& dist) {
+    NullBuffer sink;
+    streambuf* console = cout.rdbuf();
+    bool clustered = dist == "clustered";
+    size_t incidents = min(options.queries, n / 2);
+    for (size_t s = 0; s < options.shardCounts.size(); ++s) {
+        size_t shardCount = options.shardCounts[s];
+        WorkloadGenerator generator(options.seed, n, clustered);
+        vector<Point> units(n);
+        vector<int> xs(n);
+        for (size_t i = 0; i < n; ++i) {
+            units[i] = generator.next();
+            xs[i] = units[i].x;
+        }
+
+        LatencyRecorder submit;
+        cout.rdbuf(&sink);
+        listbuild::ShardedManager* manager = new listbuild::ShardedManager(listbuild::ShardedManager::balancedSplits(xs, shardCount));
+        for (size_t i = 0; i < n; ++i) {
+            manager->addDispatcher((int)i, units[i].x, units[i].y);
+        }
+        vector<Point> calls(incidents);
+        for (size_t i = 0; i < incidents; ++i) {
+            calls[i] = generator.next();
+        }
+        submit.begin();
+        for (size_t i = 0; i < incidents; ++i) {
+            manager->submitIncident((int)i, calls[i].x, calls[i].y, (int)i, (int)i + 10);
+        }
+        manager->drain();
+        submit.end(max(incidents, (size_t)1));
+        delete manager;
+        cout.rdbuf(console);
+        submit.report("list", "sharded_" + to_string(shardCount), dist, n);
+    }
+}
+
+// Hotspot analytics (list build only): 10 * n incidents with one report a
+// time unit, binned for a daily window on every thread, then sqrt(n) / 10
+// staging positions planned from the grid. The hotspot_grid row counts
+// incidents as operations; the staging row is one plan.
+void runStaging(const Options& options, size_t n, const string& dist) {
+    size_t incidents = n * 10;
+    WorkloadGenerator generator(options.seed, n, dist == "clustered");
+    vector<int32_t> xs(incidents), ys(incidents), reports(incidents);
+    for (size_t i = 0; i < incidents; ++i) {
+        Point p = generator.next();
+        xs[i] = p.x;
+        ys[i] = p.y;
+        reports[i] = (int32_t)i;
+    }
+    listbuild::HotspotOptions window = { 480, 960, 1440, 0, 0 };
+    listbuild::HotspotGrid grid;
+    LatencyRecorder build;
+    build.begin();
+    grid.build(xs.data(), ys.data(), reports.data(), incidents, window);
+    build.end(incidents);
+    build.report("list", "hotspot_grid", dist, n);
+
+    LatencyRecorder plan;
+    plan.begin();
+    grid.recommend(max((size_t)1, (size_t)sqrt((double)n) / 10));
+    plan.end();
+    plan.report("list", "staging", dist, n);
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    options.sizes = { 10, 1000, 100000 };
+    options.distributions = { "uniform", "clustered" };
+    options.scenarios = { "insert", "lookup", "nearest", "saveload", "map", "sharded", "staging" };
+    options.builds = { "list", "array" };
+    options.shardCounts = { 1, 2, 4 };
+    options.queries = 100000;
+    options.seed = 42;
+    options.tmpDir = ".";
+
+    for (int i = 1; i < argc; i += 2) {
+        string flag = argv[i];
+        if (i + 1 == argc) {
+            cerr << "Option " << flag << " needs a value\n";
+            return 1;
+        }
+        string value = argv[i + 1];
+        if (flag == "--sizes") {
+            options.sizes.clear();
+            vector<string> parts = splitList(value);
+            for (size_t p = 0; p < parts.size(); ++p) {
+                options.sizes.push_back((size_t)stoull(parts[p]));
+            }
+        }
+        else if (flag == "--dist") {
+            options.distributions = splitList(value);
+        }
+        else if (flag == "--scenarios") {
+            options.scenarios = splitList(value);
+        }
+        else if (flag == "--builds") {
+            options.builds = splitList(value);
+        }
+        else if (flag == "--queries") {
+            options.queries = (size_t)stoull(value);
+        }
+        else if (flag == "--seed") {
+            options.seed = stoull(value);
+        }
+        else if (flag == "--tmp") {
+            options.tmpDir = value;
+        }
+        else if (flag == "--shards") {
+            options.shardCounts.clear();
+            vector<string> parts = splitList(value);
+            for (size_t p = 0; p < parts.size(); ++p) {
+                options.shardCounts.push_back(max((size_t)1, (size_t)stoull(parts[p])));
+            }
+        }
+        else {
+            cerr << "Unknown option " << flag << "\n";
+            return 1;
+        }
+    }
+
+    for (size_t s = 0; s < options.sizes.size(); ++s) {
+        size_t n = options.sizes[s];
+        for (size_t d = 0; d < options.distributions.size(); ++d) {
+            const string& dist = options.distributions[d];
+            if (wants(options.builds, "list")) {
+                runBuild<listbuild::EmergencyManager>("list", options, n, dist);
+                if (wants(options.scenarios, "sharded")) {
+                    runSharded(options, n, dist);
+                }
+                if (wants(options.scenarios, "staging")) {
+                    runStaging(options, n, dist);
+                }
+            }
+            if (wants(options.builds, "array")) {
+                if (n > ARRAY_BUILD_SCAN_LIMIT) {
+                    cout << "{\"build\":\"array\",\"dist\":\"" << dist << "\",\"n\":" << n
+                        << ",\"skipped\":\"linear scans past " << ARRAY_BUILD_SCAN_LIMIT << "\"}\n";
+                }
+                else {
+                    runBuild<arraybuild::EmergencyManager>("array", options, n, dist);
+                }
+            }
+        }
+    }
+    return 0;
+}
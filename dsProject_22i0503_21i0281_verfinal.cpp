@@ -3,6 +3,37 @@
 #include <fstream>
 #include <sstream>
 #include <cmath>
+#include <climits>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <queue>
+#include <utility>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <chrono>
+#include <charconv>
+#include <new>
+#include <type_traits>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define RESCUENET_X86_SIMD 1
+#include <immintrin.h>
+#endif
 
 using namespace std;
 
@@ -12,7 +43,7 @@ struct Station {
     string name;
 
     void printDetails() {
-        cout << "ID: " << id << ", Name: " << name << ", Coordinates: (" << x << ", " << y << ")" << endl;
+        cout << "ID: " << id << ", Name: " << name << ", Coordinates: (" << x << ", " << y << ")" << "\n";
     }
 };
 
@@ -22,11 +53,594 @@ struct Incident {
     int reportTime;
     int responseTime;
     int reportedFromStationId;
+    int assignedDispatcherId;   // -1 while the incident awaits dispatch
+    int severity;               // SEVERITY_MINOR to SEVERITY_CRITICAL
 };
 
+// Higher is more urgent. Records saved before severities existed load as
+// SEVERITY_DEFAULT.
+const int SEVERITY_MINOR = 1;
+const int SEVERITY_CRITICAL = 5;
+const int SEVERITY_DEFAULT = 3;
+
+// Dispatcher life cycle: available -> en-route -> on-scene -> returning ->
+// available. Only available units are offered to dispatch searches.
+enum DispatcherState { DISPATCHER_AVAILABLE, DISPATCHER_EN_ROUTE, DISPATCHER_ON_SCENE, DISPATCHER_RETURNING };
+
+const char* const DISPATCHER_STATE_NAMES[] = { "available", "en-route", "on-scene", "returning" };
+
+// Unit timing until setUnitTiming changes it, and for saved states that predate it
+const int DEFAULT_UNIT_SPEED = 1;
+const int DEFAULT_ON_SCENE_TIME = 10;
+
+// Fields after x, y only matter while the unit is busy. A unit linked as
+// available takes its position as its base.
 struct Dispatcher {
     int id;
-    int x, y;
+    int x, y;                   // Current position
+    DispatcherState state;
+    int incidentId;             // Incident being handled
+    int baseX, baseY;           // Where the unit returns to and waits
+    int targetX, targetY;       // Where an en-route or returning unit is heading
+    int remaining;              // Time left on scene
+};
+
+// Open-addressing hash map keyed by a 64-bit integer (linear probing,
+// backward-shift deletion). Used to index records by ID in O(1).
+template <typename V>
+class OpenHashMap {
+private:
+    struct Slot {
+        long long key;
+        V value;
+        bool used;
+    };
+
+    vector<Slot> slots;   // Power-of-two sized slot table
+    size_t count;         // Number of used slots
+
+    static size_t hashKey(long long key) {
+        uint64_t h = (uint64_t)key;
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return (size_t)h;
+    }
+
+    void grow() {
+        rehash(slots.empty() ? 16 : slots.size() * 2);
+    }
+
+    void rehash(size_t capacity) {
+        vector<Slot> old;
+        old.swap(slots);
+        slots.assign(capacity, Slot{ 0, V(), false });
+        count = 0;
+        for (size_t i = 0; i < old.size(); ++i) {
+            if (old[i].used) {
+                insert(old[i].key, old[i].value);
+            }
+        }
+    }
+
+public:
+    OpenHashMap() : count(0) {}
+
+    // Returns false (and leaves the map unchanged) if the key is already present
+    bool insert(long long key, const V& value) {
+        if ((count + 1) * 4 > slots.size() * 3) {
+            grow();
+        }
+        size_t mask = slots.size() - 1;
+        size_t i = hashKey(key) & mask;
+        while (slots[i].used) {
+            if (slots[i].key == key) {
+                return false;
+            }
+            i = (i + 1) & mask;
+        }
+        slots[i] = Slot{ key, value, true };
+        ++count;
+        return true;
+    }
+
+    V* find(long long key) {
+        if (count == 0) {
+            return nullptr;
+        }
+        size_t mask = slots.size() - 1;
+        size_t i = hashKey(key) & mask;
+        while (slots[i].used) {
+            if (slots[i].key == key) {
+                return &slots[i].value;
+            }
+            i = (i + 1) & mask;
+        }
+        return nullptr;
+    }
+
+    bool erase(long long key) {
+        if (count == 0) {
+            return false;
+        }
+        size_t mask = slots.size() - 1;
+        size_t i = hashKey(key) & mask;
+        while (slots[i].used && slots[i].key != key) {
+            i = (i + 1) & mask;
+        }
+        if (!slots[i].used) {
+            return false;
+        }
+        // Shift later entries of the probe chain back into the hole
+        size_t hole = i;
+        size_t j = i;
+        while (true) {
+            j = (j + 1) & mask;
+            if (!slots[j].used) {
+                break;
+            }
+            size_t home = hashKey(slots[j].key) & mask;
+            if (((j - home) & mask) >= ((j - hole) & mask)) {
+                slots[hole] = slots[j];
+                hole = j;
+            }
+        }
+        slots[hole].used = false;
+        slots[hole].value = V();
+        --count;
+        return true;
+    }
+
+    void clear() {
+        slots.clear();
+        count = 0;
+    }
+
+    // Sizes the table for n keys so that inserting them never rehashes
+    void reserve(size_t n) {
+        size_t capacity = 16;
+        while (capacity * 3 < n * 4 + 4) {
+            capacity *= 2;
+        }
+        if (capacity > slots.size()) {
+            rehash(capacity);
+        }
+    }
+
+    size_t size() const {
+        return count;
+    }
+};
+
+// Read-only view of a whole file: memory-mapped where the platform allows,
+// read into a buffer otherwise
+class MappedFile {
+private:
+    const char* bytes;
+    size_t length;
+#ifdef _WIN32
+    vector<char> buffer;
+#endif
+
+public:
+    MappedFile() : bytes(nullptr), length(0) {}
+
+    ~MappedFile() {
+        close();
+    }
+
+    bool open(const string& filename) {
+        close();
+#ifdef _WIN32
+        ifstream inFile(filename, ios::binary | ios::ate);
+        if (!inFile) {
+            return false;
+        }
+        buffer.resize((size_t)inFile.tellg());
+        inFile.seekg(0);
+        inFile.read(buffer.data(), buffer.size());
+        bytes = buffer.data();
+        length = buffer.size();
+        return (bool)inFile;
+#else
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            ::close(fd);
+            return false;
+        }
+        length = (size_t)info.st_size;
+        if (length > 0) {
+            void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped == MAP_FAILED) {
+                ::close(fd);
+                length = 0;
+                return false;
+            }
+            madvise(mapped, length, MADV_SEQUENTIAL);
+            bytes = (const char*)mapped;
+        }
+        ::close(fd);
+        return true;
+#endif
+    }
+
+    void close() {
+#ifdef _WIN32
+        buffer.clear();
+#else
+        if (bytes != nullptr) {
+            munmap((void*)bytes, length);
+        }
+#endif
+        bytes = nullptr;
+        length = 0;
+    }
+
+    const char* data() const {
+        return bytes;
+    }
+
+    size_t size() const {
+        return length;
+    }
+};
+
+// Buffered writer for bulk text output. Records are formatted straight
+// into one large reusable buffer (numbers with to_chars), which goes out in
+// a single write whenever it fills; a field too long to fit is written
+// together with the buffer by one writev instead of being copied. The
+// target is a file or pipe opened by name, or an existing stream buffer
+// such as cout's, so output that is already redirected stays redirected.
+class RecordWriter {
+private:
+    vector<char> buffer;
+    size_t used;
+    streambuf* stream;      // Target when writing through a stream buffer
+#ifdef _WIN32
+    FILE* file;
+#else
+    int fd;                 // Target when writing to a file or pipe, -1 otherwise
+#endif
+    bool failed;
+
+    // Sends the buffer followed by extra bytes, and empties the buffer
+    void drain(const char* extra = nullptr, size_t extraLength = 0) {
+        if (stream != nullptr) {
+            failed |= stream->sputn(buffer.data(), used) != (streamsize)used;
+            if (extraLength > 0) {
+                failed |= stream->sputn(extra, extraLength) != (streamsize)extraLength;
+            }
+        }
+#ifdef _WIN32
+        else if (file != nullptr) {
+            failed |= fwrite(buffer.data(), 1, used, file) != used;
+            if (extraLength > 0) {
+                failed |= fwrite(extra, 1, extraLength, file) != extraLength;
+            }
+        }
+#else
+        else if (fd >= 0) {
+            struct iovec parts[2] = { { buffer.data(), used }, { (void*)extra, extraLength } };
+            int count = extraLength > 0 ? 2 : 1;
+            struct iovec* part = parts;
+            while (count > 0 && !failed) {
+                ssize_t written = writev(fd, part, count);
+                if (written < 0) {
+                    failed = errno != EINTR;
+                    continue;
+                }
+                // Skip what went out; pipes may take less than asked
+                while (count > 0 && (size_t)written >= part->iov_len) {
+                    written -= part->iov_len;
+                    ++part;
+                    --count;
+                }
+                if (count > 0) {
+                    part->iov_base = (char*)part->iov_base + written;
+                    part->iov_len -= written;
+                }
+            }
+        }
+#endif
+        used = 0;
+    }
+
+    void reserveRoom(size_t n) {
+        if (buffer.size() - used < n) {
+            drain();
+        }
+    }
+
+public:
+    explicit RecordWriter(size_t capacity = 1 << 20) : buffer(max(capacity, (size_t)64)), used(0), stream(nullptr),
+#ifdef _WIN32
+        file(nullptr),
+#else
+        fd(-1),
+#endif
+        failed(false) {}
+
+    ~RecordWriter() {
+        close();
+    }
+
+    RecordWriter(const RecordWriter&) = delete;
+    RecordWriter& operator=(const RecordWriter&) = delete;
+
+    // Creates or truncates a file; a named pipe works too
+    bool open(const string& filename) {
+        close();
+        failed = false;
+#ifdef _WIN32
+        file = fopen(filename.c_str(), "wb");
+        return file != nullptr;
+#else
+        fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        return fd >= 0;
+#endif
+    }
+
+    void attach(streambuf* target) {
+        close();
+        failed = false;
+        stream = target;
+    }
+
+    RecordWriter& put(char c) {
+        reserveRoom(1);
+        buffer[used++] = c;
+        return *this;
+    }
+
+    RecordWriter& text(const char* p, size_t n) {
+        if (n > buffer.size() - used) {
+            if (n >= buffer.size() / 2) {
+                drain(p, n);
+                return *this;
+            }
+            drain();
+        }
+        memcpy(buffer.data() + used, p, n);
+        used += n;
+        return *this;
+    }
+
+    RecordWriter& text(const char* p) {
+        return text(p, strlen(p));
+    }
+
+    RecordWriter& text(const string& s) {
+        return text(s.data(), s.size());
+    }
+
+    RecordWriter& number(long long v) {
+        reserveRoom(24);
+        char* at = buffer.data() + used;
+        used = to_chars(at, buffer.data() + buffer.size(), v).ptr - buffer.data();
+        return *this;
+    }
+
+    // Space-separated numbers, each preceded by a space
+    RecordWriter& fields(const int* values, size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            put(' ');
+            number(values[i]);
+        }
+        return *this;
+    }
+
+    // Sends everything buffered; false if any write so far failed. A
+    // stream buffer target is left to flush on its own schedule.
+    bool flush() {
+        drain();
+        return !failed;
+    }
+
+    bool close() {
+        bool ok = flush();
+#ifdef _WIN32
+        if (file != nullptr) {
+            ok = fclose(file) == 0 && ok;
+            file = nullptr;
+        }
+#else
+        if (fd >= 0) {
+            ok = ::close(fd) == 0 && ok;
+            fd = -1;
+        }
+#endif
+        stream = nullptr;
+        return ok;
+    }
+};
+
+const size_t LISTING_BUFFER_SIZE = 64 << 10;   // printLocations' writer, kept per manager
+
+// What a bulk dump includes: a mask of record kinds and an inclusive box
+// that each record's position must fall in
+const int OUTPUT_STATIONS = 1;
+const int OUTPUT_INCIDENTS = 2;
+const int OUTPUT_DISPATCHERS = 4;
+const int OUTPUT_ARCHIVED = 8;
+const int OUTPUT_ALL = OUTPUT_STATIONS | OUTPUT_INCIDENTS | OUTPUT_DISPATCHERS | OUTPUT_ARCHIVED;
+
+struct OutputFilter {
+    int kinds;
+    int minX, minY, maxX, maxY;
+
+    bool wants(int kind, int x, int y) const {
+        return (kinds & kind) != 0 && x >= minX && x <= maxX && y >= minY && y <= maxY;
+    }
+};
+
+const OutputFilter OUTPUT_EVERYTHING = { OUTPUT_ALL, INT_MIN, INT_MIN, INT_MAX, INT_MAX };
+
+// Binary snapshot layout (host byte order, little-endian in practice):
+// header, then the station, incident and dispatcher record arrays, a
+// string table holding station names and the archive blocks, each section
+// 8-byte aligned.
+const char SNAPSHOT_MAGIC[8] = { 'R', 'N', 'S', 'N', 'A', 'P', '\0', '\0' };
+const uint32_t SNAPSHOT_VERSION = 5;
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t stationCount, incidentCount, dispatcherCount;
+    uint64_t stationOffset, incidentOffset, dispatcherOffset;
+    uint64_t stringsOffset, stringsSize;
+    uint64_t archiveOffset, archiveSize;   // Since version 4
+    int32_t unitSpeed, onSceneTime;        // Since version 5
+};
+
+// Header sizes of versions 1 to 3, which end before the archive fields, and
+// of version 4, which ends before the unit timing
+const uint32_t SNAPSHOT_HEADER_V3_SIZE = offsetof(SnapshotHeader, archiveOffset);
+const uint32_t SNAPSHOT_HEADER_V4_SIZE = offsetof(SnapshotHeader, unitSpeed);
+
+struct StationRecord {
+    int32_t id, x, y;
+    uint32_t nameOffset;   // Into the string table
+    uint32_t nameLength;
+};
+
+struct IncidentRecord {
+    int32_t id, x, y;
+    int32_t reportTime, responseTime;
+    int32_t reportedFromStationId;
+    int32_t assignedDispatcherId;
+    int32_t severity;
+};
+
+// Versions 1 and 2 had no severity; those incidents load as SEVERITY_DEFAULT
+struct IncidentRecordV2 {
+    int32_t id, x, y;
+    int32_t reportTime, responseTime;
+    int32_t reportedFromStationId;
+    int32_t assignedDispatcherId;
+};
+
+struct DispatcherRecord {
+    int32_t id, x, y;
+    int32_t state, incidentId;
+    int32_t baseX, baseY, targetX, targetY;
+    int32_t remaining;
+};
+
+// Version 1 stored position only; those units load as available
+struct DispatcherRecordV1 {
+    int32_t id, x, y;
+};
+
+// Append-only operation log with group commit: records collect in memory
+// and are written and fsync'ed together once enough of them are pending or
+// the oldest has waited long enough. A crash loses at most the last
+// uncommitted group; a torn final line is ignored on replay.
+class Journal {
+private:
+    FILE* file;
+    string pending;                  // Records not yet written
+    size_t pendingRecords;
+    size_t recordsSinceCompaction;
+    size_t groupRecords;             // Commit once this many records are pending
+    chrono::milliseconds groupDelay; // ... or once the oldest has waited this long
+    chrono::steady_clock::time_point oldestPending;
+
+    static void syncToDisk(FILE* f) {
+#ifdef _WIN32
+        _commit(_fileno(f));
+#else
+        fsync(fileno(f));
+#endif
+    }
+
+public:
+    Journal() : file(nullptr), pendingRecords(0), recordsSinceCompaction(0), groupRecords(64), groupDelay(10) {}
+
+    ~Journal() {
+        close();
+    }
+
+    bool open(const string& filename) {
+        close();
+        file = fopen(filename.c_str(), "ab");
+        return file != nullptr;
+    }
+
+    void close() {
+        if (file != nullptr) {
+            commit();
+            fclose(file);
+            file = nullptr;
+        }
+    }
+
+    bool isOpen() const {
+        return file != nullptr;
+    }
+
+    void setGroupCommit(size_t records, int delayMillis) {
+        groupRecords = max(records, (size_t)1);
+        groupDelay = chrono::milliseconds(delayMillis);
+    }
+
+    size_t sinceCompaction() const {
+        return recordsSinceCompaction;
+    }
+
+    // Queues one record (a line without its newline) and commits the group if due
+    void append(const string& record) {
+        if (file == nullptr) {
+            return;
+        }
+        if (pendingRecords == 0) {
+            oldestPending = chrono::steady_clock::now();
+        }
+        pending += record;
+        pending += '\n';
+        ++pendingRecords;
+        ++recordsSinceCompaction;
+        if (pendingRecords >= groupRecords || chrono::steady_clock::now() - oldestPending >= groupDelay) {
+            commit();
+        }
+    }
+
+    // Writes and fsyncs every pending record
+    bool commit() {
+        if (file == nullptr || pendingRecords == 0) {
+            return true;
+        }
+        bool ok = fwrite(pending.data(), 1, pending.size(), file) == pending.size() && fflush(file) == 0;
+        syncToDisk(file);
+        pending.clear();
+        pendingRecords = 0;
+        if (!ok) {
+            cerr << "Error writing journal.\n";
+        }
+        return ok;
+    }
+
+    // Drops every record; the caller has just captured them in a snapshot
+    bool truncate(const string& filename) {
+        pending.clear();
+        pendingRecords = 0;
+        recordsSinceCompaction = 0;
+        if (file != nullptr) {
+            fclose(file);
+        }
+        file = fopen(filename.c_str(), "wb");
+        if (file == nullptr) {
+            return false;
+        }
+        syncToDisk(file);
+        return true;
+    }
 };
 
 struct StationNode {
@@ -37,317 +651,6436 @@ struct StationNode {
 struct IncidentNode {
     Incident incident;
     IncidentNode* next;
+    size_t heapSlot;   // Position in the triage queue, TRIAGE_NOT_QUEUED when not waiting
 };
 
+const size_t TRIAGE_NOT_QUEUED = SIZE_MAX;
+
 struct DispatcherNode {
     Dispatcher dispatcher;
     DispatcherNode* next;
+    size_t slot;   // Index in the coordinate columns while available, in the busy list otherwise
 };
 
-class EmergencyManager {
+// Slab allocator for list nodes. Nodes are carved out of slabs that double
+// in size, so nodes added one after another sit next to each other in
+// memory. clear() drops them all at once, keeping the largest slab for
+// reuse when the state is reloaded. Trivially destructible nodes may also
+// be released one by one; create() hands those slots out again first.
+template <typename T>
+class NodePool {
 private:
-    StationNode* stations;         // Head of stations linked list
-    IncidentNode* incidents;       // Head of incidents linked list
-    DispatcherNode* dispatchers;   // Head of dispatchers linked list
+    struct Slab {
+        T* nodes;
+        size_t capacity;
+        size_t used;
+    };
 
-    int calculateShortestDistance(int x1, int y1, int x2, int y2) {
-        return abs(x1 - x2) + abs(y1 - y2);
+    vector<Slab> slabs;   // The last slab is the one being filled
+    vector<T*> released;  // Slots given back by release()
+
+    void addSlab(size_t capacity) {
+        slabs.push_back(Slab{ static_cast<T*>(::operator new(capacity * sizeof(T))), capacity, 0 });
+    }
+
+    void destroyNodes(Slab& slab) {
+        if (!is_trivially_destructible<T>::value) {
+            for (size_t i = 0; i < slab.used; ++i) {
+                slab.nodes[i].~T();
+            }
+        }
+        slab.used = 0;
+    }
+
+public:
+    NodePool() {}
+
+    ~NodePool() {
+        for (size_t i = 0; i < slabs.size(); ++i) {
+            destroyNodes(slabs[i]);
+            ::operator delete(slabs[i].nodes);
+        }
+    }
+
+    NodePool(const NodePool&) = delete;
+    NodePool& operator=(const NodePool&) = delete;
+
+    T* create(const T& value) {
+        if (!released.empty()) {
+            T* slot = released.back();
+            released.pop_back();
+            return new (slot) T(value);
+        }
+        if (slabs.empty() || slabs.back().used == slabs.back().capacity) {
+            size_t capacity = slabs.empty() ? 64 : min(slabs.back().capacity * 2, (size_t)1 << 20);
+            addSlab(capacity);
+        }
+        Slab& slab = slabs.back();
+        return new (slab.nodes + slab.used++) T(value);
+    }
+
+    // Slabs destroy every slot they handed out, so only nodes without a
+    // destructor can be given back early
+    void release(T* node) {
+        static_assert(is_trivially_destructible<T>::value, "released nodes are destroyed again by clear()");
+        released.push_back(node);
+    }
+
+    // Makes room for n more nodes in a single slab
+    void reserve(size_t n) {
+        if (slabs.empty() || slabs.back().capacity - slabs.back().used < n) {
+            addSlab(max(n, (size_t)64));
+        }
+    }
+
+    void clear() {
+        released.clear();
+        size_t largest = 0;
+        for (size_t i = 0; i < slabs.size(); ++i) {
+            destroyNodes(slabs[i]);
+            if (slabs[i].capacity > slabs[largest].capacity) {
+                largest = i;
+            }
+        }
+        for (size_t i = 0; i < slabs.size(); ++i) {
+            if (i != largest) {
+                ::operator delete(slabs[i].nodes);
+            }
+        }
+        if (!slabs.empty()) {
+            Slab keep = slabs[largest];
+            slabs.assign(1, keep);
+        }
+    }
+};
+
+// Coordinate and ID accessors used by PointGrid
+inline int pointX(const DispatcherNode* node) { return node->dispatcher.x; }
+inline int pointY(const DispatcherNode* node) { return node->dispatcher.y; }
+inline int pointId(const DispatcherNode* node) { return node->dispatcher.id; }
+
+// A grid entry together with its distance from a query point
+template <typename T>
+struct GridCandidate {
+    int distance;
+    T* node;
+
+    // Ranks by distance, then by lower ID
+    bool operator<(const GridCandidate& other) const {
+        if (distance != other.distance) {
+            return distance < other.distance;
+        }
+        return pointId(node) < pointId(other.node);
+    }
+};
+
+// Uniform grid of buckets over point coordinates. Nearest-neighbour
+// queries visit square rings of cells around the query point and stop once
+// no unvisited cell can hold a closer point under the Manhattan metric. The
+// cell size follows the points: inserts that leave the occupied area far
+// larger than the point count, or the cells far fuller than planned,
+// regrid everything.
+template <typename T>
+class PointGrid {
+private:
+    int cellSize;                   // Side length of a cell
+    OpenHashMap<int> cellIndex;     // Packed cell key -> bucket number
+    vector<vector<T*>> buckets;     // Points per occupied cell
+    int minCellX, maxCellX, minCellY, maxCellY;
+    size_t count;
+    size_t regridCount;             // Points when the cell size was last chosen
+
+    // Cells in the box spanned by the occupied ones
+    double boxCells() const {
+        return ((double)maxCellX - minCellX + 1) * ((double)maxCellY - minCellY + 1);
+    }
+
+    int cellOf(int v) const {
+        // Floor division so negative coordinates land in the right cell
+        return v >= 0 ? v / cellSize : -((-(long long)v + cellSize - 1) / cellSize);
+    }
+
+    static long long cellKey(int cx, int cy) {
+        return ((long long)cx << 32) ^ (long long)(uint32_t)cy;
+    }
+
+    // Offer every point in a bucket to a bounded max-heap of the k best
+    static void scanBucket(const vector<T*>& nodes, int x, int y, size_t k, priority_queue<GridCandidate<T>>& best) {
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            GridCandidate<T> candidate{ abs(x - pointX(nodes[i])) + abs(y - pointY(nodes[i])), nodes[i] };
+            if (best.size() < k) {
+                best.push(candidate);
+            }
+            else if (candidate < best.top()) {
+                best.pop();
+                best.push(candidate);
+            }
+        }
+    }
+
+    void scanCell(int cx, int cy, int x, int y, size_t k, priority_queue<GridCandidate<T>>& best) {
+        int* bucket = cellIndex.find(cellKey(cx, cy));
+        if (bucket != nullptr) {
+            scanBucket(buckets[*bucket], x, y, k, best);
+        }
+    }
+
+    // True once the points have outgrown the cell size: the occupied box
+    // holds many more cells than points, or the points have doubled since
+    // the size was chosen and crowd many to a cell
+    bool needsRegrid() const {
+        return boxCells() > 8.0 * count + 64 || (count >= 2 * regridCount + 64 && count > 16 * buckets.size());
+    }
+
+    void regrid() {
+        vector<T*> nodes;
+        nodes.reserve(count);
+        for (size_t i = 0; i < buckets.size(); ++i) {
+            nodes.insert(nodes.end(), buckets[i].begin(), buckets[i].end());
+        }
+        rebuild(nodes);
+    }
+
+public:
+    explicit PointGrid(int cellSize = 16) : cellSize(cellSize), minCellX(0), maxCellX(0), minCellY(0), maxCellY(0), count(0), regridCount(0) {}
+
+    void insert(T* node) {
+        int cx = cellOf(pointX(node));
+        int cy = cellOf(pointY(node));
+        long long key = cellKey(cx, cy);
+        int* bucket = cellIndex.find(key);
+        if (bucket == nullptr) {
+            cellIndex.insert(key, (int)buckets.size());
+            buckets.push_back(vector<T*>());
+            bucket = cellIndex.find(key);
+        }
+        buckets[*bucket].push_back(node);
+
+        if (count == 0) {
+            minCellX = maxCellX = cx;
+            minCellY = maxCellY = cy;
+        }
+        else {
+            minCellX = min(minCellX, cx);
+            maxCellX = max(maxCellX, cx);
+            minCellY = min(minCellY, cy);
+            maxCellY = max(maxCellY, cy);
+        }
+        ++count;
+        if (needsRegrid()) {
+            regrid();
+        }
+    }
+
+    // Removes a point that is still at the coordinates it was inserted with
+    bool remove(T* node) {
+        int* bucket = cellIndex.find(cellKey(cellOf(pointX(node)), cellOf(pointY(node))));
+        if (bucket == nullptr) {
+            return false;
+        }
+        vector<T*>& nodes = buckets[*bucket];
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            if (nodes[i] == node) {
+                nodes[i] = nodes.back();
+                nodes.pop_back();
+                --count;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    void clear() {
+        cellIndex.clear();
+        buckets.clear();
+        count = 0;
+        regridCount = 0;
+    }
+
+    // Cell side giving about two points per cell for n points spread over a box
+    static int cellSizeFor(long long minX, long long maxX, long long minY, long long maxY, size_t n) {
+        double area = (double)(maxX - minX + 1) * (double)(maxY - minY + 1);
+        return (int)max(1.0, min(sqrt(2.0 * area / max(n, (size_t)1)), (double)INT_MAX / 4));
+    }
+
+    // Replaces the contents with nodes, choosing the cell size from their
+    // density first. Bulk loads use this; inserting a large sparse set one by
+    // one at the default size creates a bucket for nearly every point.
+    void rebuild(const vector<T*>& nodes) {
+        clear();
+        if (!nodes.empty()) {
+            long long minX = pointX(nodes[0]), maxX = minX, minY = pointY(nodes[0]), maxY = minY;
+            for (size_t i = 1; i < nodes.size(); ++i) {
+                minX = min(minX, (long long)pointX(nodes[i]));
+                maxX = max(maxX, (long long)pointX(nodes[i]));
+                minY = min(minY, (long long)pointY(nodes[i]));
+                maxY = max(maxY, (long long)pointY(nodes[i]));
+            }
+            cellSize = cellSizeFor(minX, maxX, minY, maxY, nodes.size());
+        }
+
+        // Group the points by cell so every bucket is allocated once at its
+        // final size and the table is filled in one sweep
+        vector<pair<long long, T*>> keyed(nodes.size());
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            keyed[i] = make_pair(cellKey(cellOf(pointX(nodes[i])), cellOf(pointY(nodes[i]))), nodes[i]);
+        }
+        sort(keyed.begin(), keyed.end(), [](const pair<long long, T*>& a, const pair<long long, T*>& b) { return a.first < b.first; });
+        size_t cells = 0;
+        for (size_t i = 0; i < keyed.size(); ++i) {
+            if (i == 0 || keyed[i].first != keyed[i - 1].first) {
+                ++cells;
+            }
+        }
+        cellIndex.reserve(cells);
+        buckets.reserve(cells);
+        for (size_t i = 0; i < keyed.size();) {
+            size_t j = i;
+            while (j < keyed.size() && keyed[j].first == keyed[i].first) {
+                ++j;
+            }
+            cellIndex.insert(keyed[i].first, (int)buckets.size());
+            buckets.push_back(vector<T*>());
+            buckets.back().reserve(j - i);
+            for (size_t k = i; k < j; ++k) {
+                buckets.back().push_back(keyed[k].second);
+            }
+            i = j;
+        }
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            int cx = cellOf(pointX(nodes[i]));
+            int cy = cellOf(pointY(nodes[i]));
+            if (i == 0) {
+                minCellX = maxCellX = cx;
+                minCellY = maxCellY = cy;
+            }
+            else {
+                minCellX = min(minCellX, cx);
+                maxCellX = max(maxCellX, cx);
+                minCellY = min(minCellY, cy);
+                maxCellY = max(maxCellY, cy);
+            }
+        }
+        count = nodes.size();
+        regridCount = count;
+    }
+
+    // Up to k points closest to (x, y), nearest first, ties broken by lower
+    // ID. Only points closer than limit are returned.
+    vector<GridCandidate<T>> kNearest(int x, int y, size_t k, long long limit = LLONG_MAX) {
+        priority_queue<GridCandidate<T>> best;
+        if (count == 0 || k == 0) {
+            return vector<GridCandidate<T>>();
+        }
+
+        int cx = cellOf(x);
+        int cy = cellOf(y);
+        int maxRing = max(max(cx - minCellX, maxCellX - cx), max(cy - minCellY, maxCellY - cy));
+        // A query outside the occupied cells starts at the first ring that
+        // reaches them, and every point is at least the smaller of its
+        // distances to them along x and along y farther than the ring bound
+        int firstRing = max(max(minCellX - cx, cx - maxCellX), max(max(minCellY - cy, cy - maxCellY), 0));
+        long long gapX = max(max((long long)minCellX * cellSize - x, (long long)x - ((long long)maxCellX + 1) * cellSize + 1), 0LL);
+        long long gapY = max(max((long long)minCellY * cellSize - y, (long long)y - ((long long)maxCellY + 1) * cellSize + 1), 0LL);
+        long long gap = min(gapX, gapY);
+        // Once the walk has passed more cells than there are points, the
+        // rest of it would cost more than checking every point directly
+        double visited = 0;
+        for (int r = firstRing; r <= maxRing; ++r) {
+            if (visited > (double)count) {
+                best = priority_queue<GridCandidate<T>>();
+                for (size_t i = 0; i < buckets.size(); ++i) {
+                    scanBucket(buckets[i], x, y, k, best);
+                }
+                break;
+            }
+            int lowX = max(cx - r, minCellX), highX = min(cx + r, maxCellX);
+            int lowY = max(cy - r, minCellY), highY = min(cy + r, maxCellY);
+            visited += 2.0 * (highX - lowX + 1) + 2.0 * (highY - lowY + 1);
+            // Top and bottom rows of the ring
+            for (int ix = lowX; ix <= highX; ++ix) {
+                if (cy - r >= minCellY) scanCell(ix, cy - r, x, y, k, best);
+                if (r > 0 && cy + r <= maxCellY) scanCell(ix, cy + r, x, y, k, best);
+            }
+            // Left and right columns, excluding the corners already visited
+            for (int iy = max(cy - r + 1, lowY); iy <= min(cy + r - 1, highY); ++iy) {
+                if (r > 0 && cx - r >= minCellX) scanCell(cx - r, iy, x, y, k, best);
+                if (r > 0 && cx + r <= maxCellX) scanCell(cx + r, iy, x, y, k, best);
+            }
+            // Every cell in ring r + 1 is at least r * cellSize + gap + 1 away
+            long long bound = (long long)r * cellSize + gap;
+            if ((best.size() == k && (long long)best.top().distance <= bound) || bound >= limit) {
+                break;
+            }
+        }
+        while (!best.empty() && best.top().distance >= limit) {
+            best.pop();
+        }
+
+        vector<GridCandidate<T>> ranked(best.size());
+        for (size_t i = ranked.size(); i > 0; --i) {
+            ranked[i - 1] = best.top();
+            best.pop();
+        }
+        return ranked;
+    }
+
+    // Closest point to (x, y), ties broken by lower ID; nullptr if empty
+    T* nearest(int x, int y, int* distanceOut = nullptr, long long limit = LLONG_MAX) {
+        vector<GridCandidate<T>> ranked = kNearest(x, y, 1, limit);
+        if (ranked.empty()) {
+            return nullptr;
+        }
+        if (distanceOut != nullptr) {
+            *distanceOut = ranked[0].distance;
+        }
+        return ranked[0].node;
+    }
+};
+
+typedef GridCandidate<DispatcherNode> DispatcherCandidate;
+typedef PointGrid<DispatcherNode> DispatcherGrid;
+
+// Manhattan distance kernels over coordinates stored column-wise. min returns
+// the smallest distance from (x, y) to any of the n points; find returns the
+// first index at or after start whose distance equals target, or n.
+inline int minManhattanScalar(const int32_t* xs, const int32_t* ys, size_t n, int x, int y) {
+    int best = INT_MAX;
+    for (size_t i = 0; i < n; ++i) {
+        best = min(best, abs(xs[i] - x) + abs(ys[i] - y));
+    }
+    return best;
+}
+
+inline size_t findManhattanScalar(const int32_t* xs, const int32_t* ys, size_t n, int x, int y, int target, size_t start) {
+    for (size_t i = start; i < n; ++i) {
+        if (abs(xs[i] - x) + abs(ys[i] - y) == target) {
+            return i;
+        }
+    }
+    return n;
+}
+
+#ifdef RESCUENET_X86_SIMD
+__attribute__((target("sse4.1")))
+inline int minManhattanSse41(const int32_t* xs, const int32_t* ys, size_t n, int x, int y) {
+    __m128i qx = _mm_set1_epi32(x);
+    __m128i qy = _mm_set1_epi32(y);
+    __m128i best = _mm_set1_epi32(INT_MAX);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i dx = _mm_abs_epi32(_mm_sub_epi32(_mm_loadu_si128((const __m128i*)(xs + i)), qx));
+        __m128i dy = _mm_abs_epi32(_mm_sub_epi32(_mm_loadu_si128((const __m128i*)(ys + i)), qy));
+        best = _mm_min_epi32(best, _mm_add_epi32(dx, dy));
+    }
+    best = _mm_min_epi32(best, _mm_shuffle_epi32(best, _MM_SHUFFLE(1, 0, 3, 2)));
+    best = _mm_min_epi32(best, _mm_shuffle_epi32(best, _MM_SHUFFLE(2, 3, 0, 1)));
+    return min(_mm_cvtsi128_si32(best), minManhattanScalar(xs + i, ys + i, n - i, x, y));
+}
+
+__attribute__((target("sse4.1")))
+inline size_t findManhattanSse41(const int32_t* xs, const int32_t* ys, size_t n, int x, int y, int target, size_t start) {
+    __m128i qx = _mm_set1_epi32(x);
+    __m128i qy = _mm_set1_epi32(y);
+    __m128i wanted = _mm_set1_epi32(target);
+    size_t i = start;
+    for (; i + 4 <= n; i += 4) {
+        __m128i dx = _mm_abs_epi32(_mm_sub_epi32(_mm_loadu_si128((const __m128i*)(xs + i)), qx));
+        __m128i dy = _mm_abs_epi32(_mm_sub_epi32(_mm_loadu_si128((const __m128i*)(ys + i)), qy));
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_add_epi32(dx, dy), wanted)));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return findManhattanScalar(xs, ys, n, x, y, target, i);
+}
+
+__attribute__((target("avx2")))
+inline int minManhattanAvx2(const int32_t* xs, const int32_t* ys, size_t n, int x, int y) {
+    __m256i qx = _mm256_set1_epi32(x);
+    __m256i qy = _mm256_set1_epi32(y);
+    __m256i best = _mm256_set1_epi32(INT_MAX);
+    __m256i best2 = best;
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i dx = _mm256_abs_epi32(_mm256_sub_epi32(_mm256_loadu_si256((const __m256i*)(xs + i)), qx));
+        __m256i dy = _mm256_abs_epi32(_mm256_sub_epi32(_mm256_loadu_si256((const __m256i*)(ys + i)), qy));
+        __m256i dx2 = _mm256_abs_epi32(_mm256_sub_epi32(_mm256_loadu_si256((const __m256i*)(xs + i + 8)), qx));
+        __m256i dy2 = _mm256_abs_epi32(_mm256_sub_epi32(_mm256_loadu_si256((const __m256i*)(ys + i + 8)), qy));
+        best = _mm256_min_epi32(best, _mm256_add_epi32(dx, dy));
+        best2 = _mm256_min_epi32(best2, _mm256_add_epi32(dx2, dy2));
+    }
+    best = _mm256_min_epi32(best, best2);
+    __m128i half = _mm_min_epi32(_mm256_castsi256_si128(best), _mm256_extracti128_si256(best, 1));
+    half = _mm_min_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(1, 0, 3, 2)));
+    half = _mm_min_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(2, 3, 0, 1)));
+    return min(_mm_cvtsi128_si32(half), minManhattanScalar(xs + i, ys + i, n - i, x, y));
+}
+
+__attribute__((target("avx2")))
+inline size_t findManhattanAvx2(const int32_t* xs, const int32_t* ys, size_t n, int x, int y, int target, size_t start) {
+    __m256i qx = _mm256_set1_epi32(x);
+    __m256i qy = _mm256_set1_epi32(y);
+    __m256i wanted = _mm256_set1_epi32(target);
+    size_t i = start;
+    for (; i + 8 <= n; i += 8) {
+        __m256i dx = _mm256_abs_epi32(_mm256_sub_epi32(_mm256_loadu_si256((const __m256i*)(xs + i)), qx));
+        __m256i dy = _mm256_abs_epi32(_mm256_sub_epi32(_mm256_loadu_si256((const __m256i*)(ys + i)), qy));
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_add_epi32(dx, dy), wanted)));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return findManhattanScalar(xs, ys, n, x, y, target, i);
+}
+#endif
+
+// Below this many dispatchers a vectorized scan beats the grid search
+const size_t DISPATCHER_SCAN_LIMIT = 512;
+
+// The widest kernel pair the CPU supports, picked once at first use
+struct ManhattanKernel {
+    int (*minDistance)(const int32_t*, const int32_t*, size_t, int, int);
+    size_t (*find)(const int32_t*, const int32_t*, size_t, int, int, int, size_t);
+};
+
+inline ManhattanKernel selectManhattanKernel() {
+#ifdef RESCUENET_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return ManhattanKernel{ minManhattanAvx2, findManhattanAvx2 };
+    }
+    if (__builtin_cpu_supports("sse4.1")) {
+        return ManhattanKernel{ minManhattanSse41, findManhattanSse41 };
+    }
+#endif
+    return ManhattanKernel{ minManhattanScalar, findManhattanScalar };
+}
+
+inline const ManhattanKernel& manhattanKernel() {
+    static const ManhattanKernel kernel = selectManhattanKernel();
+    return kernel;
+}
+
+// Point coordinates kept as separate x[] and y[] arrays for brute-force
+// scans. Entry i of every column describes the same point.
+class CoordinateStore {
+private:
+    vector<int32_t> xs;
+    vector<int32_t> ys;
+    vector<int32_t> ids;
+
+public:
+    void add(int id, int x, int y) {
+        xs.push_back(x);
+        ys.push_back(y);
+        ids.push_back(id);
+    }
+
+    void reserve(size_t n) {
+        xs.reserve(n);
+        ys.reserve(n);
+        ids.reserve(n);
+    }
+
+    void clear() {
+        xs.clear();
+        ys.clear();
+        ids.clear();
+    }
+
+    size_t size() const {
+        return ids.size();
+    }
+
+    int idAt(size_t index) const {
+        return ids[index];
+    }
+
+    int xAt(size_t index) const {
+        return xs[index];
+    }
+
+    int yAt(size_t index) const {
+        return ys[index];
+    }
+
+    // Moves the last point into index; returns the ID now at index, or -1
+    // if the removed point was the last one
+    int removeAt(size_t index) {
+        size_t last = ids.size() - 1;
+        xs[index] = xs[last];
+        ys[index] = ys[last];
+        ids[index] = ids[last];
+        xs.pop_back();
+        ys.pop_back();
+        ids.pop_back();
+        return index < last ? ids[index] : -1;
+    }
+
+    // Index of the point closest to (x, y), lowest ID among equally close
+    // points, or -1 if the store is empty. The distance goes to distOut.
+    int nearest(int x, int y, int* distOut) const {
+        if (ids.empty()) {
+            return -1;
+        }
+        const ManhattanKernel& kernel = manhattanKernel();
+        size_t n = ids.size();
+        int best = kernel.minDistance(xs.data(), ys.data(), n, x, y);
+        int bestIndex = -1;
+        for (size_t i = kernel.find(xs.data(), ys.data(), n, x, y, best, 0); i < n; i = kernel.find(xs.data(), ys.data(), n, x, y, best, i + 1)) {
+            if (bestIndex == -1 || ids[i] < ids[bestIndex]) {
+                bestIndex = (int)i;
+            }
+        }
+        if (distOut != nullptr) {
+            *distOut = best;
+        }
+        return bestIndex;
+    }
+};
+
+const size_t COVERAGE_MAX_CELLS = (size_t)1 << 22;   // Largest raster, 16 MB of owners
+
+// Nearest-station raster under the Manhattan metric. Every cell of a box
+// around the stations records its closest station (lowest ID on ties), so a
+// lookup is one read. A point outside the box uses the box cell nearest to
+// it: stepping towards the box along an axis steps towards every station at
+// once, so that cell's station is the point's station too.
+// A new station repaints only the cells it wins, spreading out from its own
+// cell. A station outside the box first grows the box with some slack,
+// filling the new cells from the old border by the same argument. When even
+// the stations' bounding box would pass COVERAGE_MAX_CELLS the raster is
+// dropped and lookups scan the station coordinates instead.
+class StationCoverage {
+private:
+    CoordinateStore stations;   // Station slot -> coordinates and ID
+    vector<int32_t> owner;      // Cell -> station slot, -1 if not reached yet
+    vector<int32_t> frontier;   // Cells whose owner changed and must spread
+    int minX, minY;             // Lower corner of the box
+    int width, height;          // Box size in cells, 0 when there is no raster
+    bool scanOnly;              // Box too large, always scan
+
+    int distanceTo(int slot, int x, int y) const {
+        return abs(stations.xAt((size_t)slot) - x) + abs(stations.yAt((size_t)slot) - y);
+    }
+
+    // Whether station slot should own (x, y) instead of station current
+    bool beats(int slot, int current, int x, int y) const {
+        if (current < 0) {
+            return true;
+        }
+        int distance = distanceTo(slot, x, y);
+        int currentDistance = distanceTo(current, x, y);
+        return distance < currentDistance || (distance == currentDistance && stations.idAt((size_t)slot) < stations.idAt((size_t)current));
+    }
+
+    size_t cellOf(int x, int y) const {
+        return (size_t)(y - minY) * (size_t)width + (size_t)(x - minX);
+    }
+
+    // Pads [lo, hi] by half its length, at least 8, on the sides listed
+    static void pad(long long& lo, long long& hi, bool low, bool high) {
+        long long slack = max(8LL, (hi - lo + 1) / 2);
+        if (low) {
+            lo -= slack;
+        }
+        if (high) {
+            hi += slack;
+        }
+    }
+
+    static bool fits(long long x0, long long y0, long long x1, long long y1) {
+        return x0 >= INT_MIN && y0 >= INT_MIN && x1 <= INT_MAX && y1 <= INT_MAX
+            && (double)(x1 - x0 + 1) * (double)(y1 - y0 + 1) <= (double)COVERAGE_MAX_CELLS;
+    }
+
+    void dropRaster() {
+        owner.clear();
+        owner.shrink_to_fit();
+        width = 0;
+        height = 0;
+    }
+
+    // Spreads the owners of the queued cells: a neighbour changes hands
+    // whenever the expanding cell's station beats its current one. A cell's
+    // best station is also best for its neighbour one step closer to that
+    // station, so every cell that should change is reached.
+    void spread() {
+        for (size_t head = 0; head < frontier.size(); ++head) {
+            int32_t cell = frontier[head];
+            int slot = owner[cell];
+            int x = minX + cell % width;
+            int y = minY + cell / width;
+            const int dx[4] = { -1, 1, 0, 0 };
+            const int dy[4] = { 0, 0, -1, 1 };
+            for (int d = 0; d < 4; ++d) {
+                int nx = x + dx[d];
+                int ny = y + dy[d];
+                if (nx < minX || nx >= minX + width || ny < minY || ny >= minY + height) {
+                    continue;
+                }
+                size_t next = cellOf(nx, ny);
+                if (owner[next] != slot && beats(slot, owner[next], nx, ny)) {
+                    owner[next] = slot;
+                    frontier.push_back((int32_t)next);
+                }
+            }
+        }
+        frontier.clear();
+    }
+
+    // Seeds a station's own cell and spreads it
+    void paint(int slot) {
+        int x = stations.xAt((size_t)slot);
+        int y = stations.yAt((size_t)slot);
+        size_t cell = cellOf(x, y);
+        if (beats(slot, owner[cell], x, y)) {
+            owner[cell] = slot;
+            frontier.push_back((int32_t)cell);
+            spread();
+        }
+    }
+
+    // Grows the box to take in (x, y); the new cells inherit the owner of
+    // the nearest old cell. Returns false if the grown box would be too large.
+    bool grow(int x, int y) {
+        long long x0 = minX, y0 = minY, x1 = (long long)minX + width - 1, y1 = (long long)minY + height - 1;
+        long long nx0 = min(x0, (long long)x), ny0 = min(y0, (long long)y);
+        long long nx1 = max(x1, (long long)x), ny1 = max(y1, (long long)y);
+        long long px0 = nx0, py0 = ny0, px1 = nx1, py1 = ny1;
+        pad(px0, px1, x < x0, x > x1);
+        pad(py0, py1, y < y0, y > y1);
+        if (fits(px0, py0, px1, py1)) {
+            nx0 = px0;
+            ny0 = py0;
+            nx1 = px1;
+            ny1 = py1;
+        }
+        else if (!fits(nx0, ny0, nx1, ny1)) {
+            return false;
+        }
+
+        int newWidth = (int)(nx1 - nx0 + 1), newHeight = (int)(ny1 - ny0 + 1);
+        vector<int32_t> grown((size_t)newWidth * (size_t)newHeight);
+        for (int row = 0; row < newHeight; ++row) {
+            long long oldRow = min(max(ny0 + row, y0), y1) - y0;
+            for (int col = 0; col < newWidth; ++col) {
+                long long oldCol = min(max(nx0 + col, x0), x1) - x0;
+                grown[(size_t)row * newWidth + col] = owner[(size_t)oldRow * width + (size_t)oldCol];
+            }
+        }
+        owner.swap(grown);
+        minX = (int)nx0;
+        minY = (int)ny0;
+        width = newWidth;
+        height = newHeight;
+        return true;
+    }
+
+public:
+    StationCoverage() : minX(0), minY(0), width(0), height(0), scanOnly(false) {}
+
+    // Adds a station and repaints the cells it wins. Bulk loads pass
+    // repaint = false and call rebuild() once at the end; lookups scan until then.
+    void add(int id, int x, int y, bool repaint = true) {
+        stations.add(id, x, y);
+        if (scanOnly) {
+            return;
+        }
+        if (!repaint) {
+            dropRaster();
+            return;
+        }
+        if (width == 0) {
+            rebuild();
+            return;
+        }
+        if ((x < minX || x >= minX + width || y < minY || y >= minY + height) && !grow(x, y)) {
+            // Earlier slack may be what overflows; retry on the exact bounds
+            rebuild();
+            return;
+        }
+        paint((int)stations.size() - 1);
+    }
+
+    // Paints the whole raster from scratch with a multi-source BFS
+    void rebuild() {
+        dropRaster();
+        scanOnly = false;
+        if (stations.size() == 0) {
+            return;
+        }
+        long long x0 = INT_MAX, y0 = INT_MAX, x1 = INT_MIN, y1 = INT_MIN;
+        for (size_t i = 0; i < stations.size(); ++i) {
+            x0 = min(x0, (long long)stations.xAt(i));
+            y0 = min(y0, (long long)stations.yAt(i));
+            x1 = max(x1, (long long)stations.xAt(i));
+            y1 = max(y1, (long long)stations.yAt(i));
+        }
+        long long px0 = x0, py0 = y0, px1 = x1, py1 = y1;
+        pad(px0, px1, true, true);
+        pad(py0, py1, true, true);
+        if (fits(px0, py0, px1, py1)) {
+            x0 = px0;
+            y0 = py0;
+            x1 = px1;
+            y1 = py1;
+        }
+        else if (!fits(x0, y0, x1, y1)) {
+            scanOnly = true;
+            return;
+        }
+        minX = (int)x0;
+        minY = (int)y0;
+        width = (int)(x1 - x0 + 1);
+        height = (int)(y1 - y0 + 1);
+        owner.assign((size_t)width * (size_t)height, -1);
+        for (size_t i = 0; i < stations.size(); ++i) {
+            size_t cell = cellOf(stations.xAt(i), stations.yAt(i));
+            if (beats((int)i, owner[cell], stations.xAt(i), stations.yAt(i))) {
+                owner[cell] = (int32_t)i;
+                frontier.push_back((int32_t)cell);
+            }
+        }
+        spread();
+    }
+
+    void reserve(size_t n) {
+        stations.reserve(n);
+    }
+
+    void clear() {
+        stations.clear();
+        dropRaster();
+        scanOnly = false;
+    }
+
+    // ID of the station closest to (x, y), lowest ID among equally close
+    // ones, or -1 if there are no stations. The distance goes to distOut.
+    int nearest(int x, int y, int* distOut) const {
+        if (stations.size() == 0) {
+            return -1;
+        }
+        int slot;
+        if (width > 0) {
+            int cx = min(max(x, minX), minX + width - 1);
+            int cy = min(max(y, minY), minY + height - 1);
+            slot = owner[cellOf(cx, cy)];
+        }
+        else {
+            slot = stations.nearest(x, y, nullptr);
+        }
+        if (distOut != nullptr) {
+            *distOut = distanceTo(slot, x, y);
+        }
+        return stations.idAt((size_t)slot);
+    }
+};
+
+const int TIME_INDEX_FANOUT = 32;   // Entries or children per B+-tree node
+
+// An incident in the time index. It is open from its report to its
+// response, or only at the report time when the response is not later.
+struct TimeEntry {
+    int start;
+    int end;
+    int id;
+    IncidentNode* node;
+};
+
+// B+-tree over incidents ordered by (reportTime, ID). Leaves are chained in
+// key order, so a range scan is one descent plus a walk: O(log n + k).
+// Inner nodes also keep the latest end time under each child, which lets
+// overlap queries skip every subtree whose incidents all closed too early;
+// with bounded incident durations those stay close to O(log n + k) too.
+// Incidents are never removed one by one, so only insertion is supported.
+class TimeIndex {
+private:
+    struct Node {
+        bool leaf;
+        int count;
+        int maxEnd;   // Latest end time anywhere below
+    };
+
+    struct Leaf : Node {
+        TimeEntry entries[TIME_INDEX_FANOUT];
+        Leaf* next;
+    };
+
+    struct Inner : Node {
+        long long lowKeys[TIME_INDEX_FANOUT];   // Smallest key under each child
+        int maxEnds[TIME_INDEX_FANOUT];         // Latest end time under each child
+        Node* children[TIME_INDEX_FANOUT];
+    };
+
+    Node* root;
+    Leaf* first;    // Leftmost leaf
+    size_t count;
+
+    static long long keyOf(int start, int id) {
+        return (long long)start * 4294967296LL + (uint32_t)id;
+    }
+
+    static long long keyOf(const TimeEntry& entry) {
+        return keyOf(entry.start, entry.id);
+    }
+
+    static Leaf* newLeaf() {
+        Leaf* leaf = new Leaf;
+        leaf->leaf = true;
+        leaf->count = 0;
+        leaf->maxEnd = INT_MIN;
+        leaf->next = nullptr;
+        return leaf;
+    }
+
+    static Inner* newInner() {
+        Inner* inner = new Inner;
+        inner->leaf = false;
+        inner->count = 0;
+        inner->maxEnd = INT_MIN;
+        return inner;
+    }
+
+    static void refreshMaxEnd(Leaf* leaf) {
+        leaf->maxEnd = INT_MIN;
+        for (int i = 0; i < leaf->count; ++i) {
+            leaf->maxEnd = max(leaf->maxEnd, leaf->entries[i].end);
+        }
+    }
+
+    static void refreshMaxEnd(Inner* inner) {
+        inner->maxEnd = INT_MIN;
+        for (int i = 0; i < inner->count; ++i) {
+            inner->maxEnd = max(inner->maxEnd, inner->maxEnds[i]);
+        }
+    }
+
+    static long long firstKey(const Node* node) {
+        return node->leaf ? keyOf(static_cast<const Leaf*>(node)->entries[0]) : static_cast<const Inner*>(node)->lowKeys[0];
+    }
+
+    // Child of an inner node whose key range holds key
+    static int childFor(const Inner* inner, long long key) {
+        int i = (int)(upper_bound(inner->lowKeys, inner->lowKeys + inner->count, key) - inner->lowKeys) - 1;
+        return max(i, 0);
+    }
+
+    static void destroy(Node* node) {
+        if (!node->leaf) {
+            Inner* inner = static_cast<Inner*>(node);
+            for (int i = 0; i < inner->count; ++i) {
+                destroy(inner->children[i]);
+            }
+            delete inner;
+        }
+        else {
+            delete static_cast<Leaf*>(node);
+        }
+    }
+
+    // Inserts below node. Returns the new right sibling if node had to
+    // split, with its smallest key in splitKey.
+    Node* insertInto(Node* node, const TimeEntry& entry, long long key, long long& splitKey) {
+        const int half = TIME_INDEX_FANOUT / 2;
+        if (node->leaf) {
+            Leaf* leaf = static_cast<Leaf*>(node);
+            int pos = leaf->count;
+            while (pos > 0 && keyOf(leaf->entries[pos - 1]) > key) {
+                --pos;
+            }
+            Leaf* right = nullptr;
+            Leaf* target = leaf;
+            if (leaf->count == TIME_INDEX_FANOUT) {
+                right = newLeaf();
+                copy(leaf->entries + half, leaf->entries + TIME_INDEX_FANOUT, right->entries);
+                right->count = TIME_INDEX_FANOUT - half;
+                leaf->count = half;
+                right->next = leaf->next;
+                leaf->next = right;
+                if (pos > half) {
+                    target = right;
+                    pos -= half;
+                }
+            }
+            copy_backward(target->entries + pos, target->entries + target->count, target->entries + target->count + 1);
+            target->entries[pos] = entry;
+            ++target->count;
+            if (right == nullptr) {
+                leaf->maxEnd = max(leaf->maxEnd, entry.end);
+                return nullptr;
+            }
+            refreshMaxEnd(leaf);
+            refreshMaxEnd(right);
+            splitKey = keyOf(right->entries[0]);
+            return right;
+        }
+
+        Inner* inner = static_cast<Inner*>(node);
+        int i = childFor(inner, key);
+        if (key < inner->lowKeys[0]) {
+            inner->lowKeys[0] = key;
+        }
+        long long childSplitKey;
+        Node* sibling = insertInto(inner->children[i], entry, key, childSplitKey);
+        inner->maxEnds[i] = inner->children[i]->maxEnd;
+        if (sibling == nullptr) {
+            inner->maxEnd = max(inner->maxEnd, entry.end);
+            return nullptr;
+        }
+
+        Inner* right = nullptr;
+        Inner* target = inner;
+        int pos = i + 1;
+        if (inner->count == TIME_INDEX_FANOUT) {
+            right = newInner();
+            copy(inner->lowKeys + half, inner->lowKeys + TIME_INDEX_FANOUT, right->lowKeys);
+            copy(inner->maxEnds + half, inner->maxEnds + TIME_INDEX_FANOUT, right->maxEnds);
+            copy(inner->children + half, inner->children + TIME_INDEX_FANOUT, right->children);
+            right->count = TIME_INDEX_FANOUT - half;
+            inner->count = half;
+            if (pos > half) {
+                target = right;
+                pos -= half;
+            }
+        }
+        copy_backward(target->lowKeys + pos, target->lowKeys + target->count, target->lowKeys + target->count + 1);
+        copy_backward(target->maxEnds + pos, target->maxEnds + target->count, target->maxEnds + target->count + 1);
+        copy_backward(target->children + pos, target->children + target->count, target->children + target->count + 1);
+        target->lowKeys[pos] = childSplitKey;
+        target->maxEnds[pos] = sibling->maxEnd;
+        target->children[pos] = sibling;
+        ++target->count;
+        refreshMaxEnd(inner);
+        if (right == nullptr) {
+            return nullptr;
+        }
+        refreshMaxEnd(right);
+        splitKey = right->lowKeys[0];
+        return right;
+    }
+
+    static void collectOpen(const Node* node, int from, int to, vector<IncidentNode*>& out) {
+        if (node->leaf) {
+            const Leaf* leaf = static_cast<const Leaf*>(node);
+            for (int i = 0; i < leaf->count && leaf->entries[i].start <= to; ++i) {
+                if (leaf->entries[i].end >= from) {
+                    out.push_back(leaf->entries[i].node);
+                }
+            }
+            return;
+        }
+        const Inner* inner = static_cast<const Inner*>(node);
+        long long last = keyOf(to, -1);
+        for (int i = 0; i < inner->count && inner->lowKeys[i] <= last; ++i) {
+            if (inner->maxEnds[i] >= from) {
+                collectOpen(inner->children[i], from, to, out);
+            }
+        }
+    }
+
+public:
+    TimeIndex() : root(nullptr), first(nullptr), count(0) {}
+
+    ~TimeIndex() {
+        clear();
+    }
+
+    TimeIndex(const TimeIndex&) = delete;
+    TimeIndex& operator=(const TimeIndex&) = delete;
+
+    static TimeEntry entryFor(IncidentNode* node) {
+        const Incident& in = node->incident;
+        return TimeEntry{ in.reportTime, max(in.reportTime, in.responseTime), in.id, node };
+    }
+
+    void insert(IncidentNode* node) {
+        TimeEntry entry = entryFor(node);
+        if (root == nullptr) {
+            first = newLeaf();
+            root = first;
+        }
+        long long splitKey;
+        Node* sibling = insertInto(root, entry, keyOf(entry), splitKey);
+        if (sibling != nullptr) {
+            Inner* top = newInner();
+            top->lowKeys[0] = firstKey(root);
+            top->maxEnds[0] = root->maxEnd;
+            top->children[0] = root;
+            top->lowKeys[1] = splitKey;
+            top->maxEnds[1] = sibling->maxEnd;
+            top->children[1] = sibling;
+            top->count = 2;
+            refreshMaxEnd(top);
+            root = top;
+        }
+        ++count;
+    }
+
+    // Replaces the contents with the given entries in one bottom-up pass.
+    // Nodes are filled to 3/4 so later inserts do not split right away.
+    void build(vector<TimeEntry>& entries) {
+        clear();
+        if (entries.empty()) {
+            return;
+        }
+        sort(entries.begin(), entries.end(), [](const TimeEntry& a, const TimeEntry& b) { return keyOf(a) < keyOf(b); });
+        const int fill = TIME_INDEX_FANOUT * 3 / 4;
+        vector<Node*> level;
+        Leaf* previous = nullptr;
+        for (size_t i = 0; i < entries.size(); i += fill) {
+            Leaf* leaf = newLeaf();
+            leaf->count = (int)min((size_t)fill, entries.size() - i);
+            copy(entries.begin() + i, entries.begin() + i + leaf->count, leaf->entries);
+            refreshMaxEnd(leaf);
+            if (previous != nullptr) {
+                previous->next = leaf;
+            }
+            else {
+                first = leaf;
+            }
+            previous = leaf;
+            level.push_back(leaf);
+        }
+        while (level.size() > 1) {
+            vector<Node*> parents;
+            for (size_t i = 0; i < level.size(); i += fill) {
+                Inner* inner = newInner();
+                inner->count = (int)min((size_t)fill, level.size() - i);
+                for (int c = 0; c < inner->count; ++c) {
+                    inner->children[c] = level[i + c];
+                    inner->lowKeys[c] = firstKey(level[i + c]);
+                    inner->maxEnds[c] = level[i + c]->maxEnd;
+                }
+                refreshMaxEnd(inner);
+                parents.push_back(inner);
+            }
+            level.swap(parents);
+        }
+        root = level[0];
+        count = entries.size();
+    }
+
+    void clear() {
+        if (root != nullptr) {
+            destroy(root);
+        }
+        root = nullptr;
+        first = nullptr;
+        count = 0;
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    // Incidents reported in [from, to], in report order
+    void reportedBetween(int from, int to, vector<IncidentNode*>& out) const {
+        if (root == nullptr || from > to) {
+            return;
+        }
+        long long key = keyOf(from, 0);
+        const Node* node = root;
+        while (!node->leaf) {
+            const Inner* inner = static_cast<const Inner*>(node);
+            node = inner->children[childFor(inner, key)];
+        }
+        const Leaf* leaf = static_cast<const Leaf*>(node);
+        int pos = 0;
+        while (pos < leaf->count && keyOf(leaf->entries[pos]) < key) {
+            ++pos;
+        }
+        for (; leaf != nullptr; leaf = leaf->next, pos = 0) {
+            for (; pos < leaf->count; ++pos) {
+                if (leaf->entries[pos].start > to) {
+                    return;
+                }
+                out.push_back(leaf->entries[pos].node);
+            }
+        }
+    }
+
+    // Incidents open at some point in [from, to], in report order
+    void openDuring(int from, int to, vector<IncidentNode*>& out) const {
+        if (root != nullptr && from <= to) {
+            collectOpen(root, from, to, out);
+        }
+    }
+};
+
+const size_t TRIAGE_ARITY = 4;   // Children per triage heap node
+
+// Indexed d-ary heap over incidents awaiting dispatch: most severe first,
+// then the longest waiting (earliest report), then the lowest ID. Every
+// queued node knows its heap position, so an incident whose severity
+// changes, or that gets a unit some other way, is re-keyed or removed in
+// O(log n) without a search. A 4-ary heap is shallower than a binary one
+// and its children share a cache line.
+class TriageQueue {
+private:
+    vector<IncidentNode*> heap;
+
+    static bool before(const IncidentNode* a, const IncidentNode* b) {
+        return moreUrgent(a->incident, b->incident);
+    }
+
+    void place(size_t i, IncidentNode* node) {
+        heap[i] = node;
+        node->heapSlot = i;
+    }
+
+    void siftUp(size_t i) {
+        IncidentNode* node = heap[i];
+        while (i > 0) {
+            size_t parent = (i - 1) / TRIAGE_ARITY;
+            if (!before(node, heap[parent])) {
+                break;
+            }
+            place(i, heap[parent]);
+            i = parent;
+        }
+        place(i, node);
+    }
+
+    void siftDown(size_t i) {
+        IncidentNode* node = heap[i];
+        while (true) {
+            size_t first = i * TRIAGE_ARITY + 1;
+            if (first >= heap.size()) {
+                break;
+            }
+            size_t best = first;
+            size_t last = min(first + TRIAGE_ARITY, heap.size());
+            for (size_t c = first + 1; c < last; ++c) {
+                if (before(heap[c], heap[best])) {
+                    best = c;
+                }
+            }
+            if (!before(heap[best], node)) {
+                break;
+            }
+            place(i, heap[best]);
+            i = best;
+        }
+        place(i, node);
+    }
+
+public:
+    // The queue's order, for callers merging several queues
+    static bool moreUrgent(const Incident& x, const Incident& y) {
+        if (x.severity != y.severity) {
+            return x.severity > y.severity;
+        }
+        if (x.reportTime != y.reportTime) {
+            return x.reportTime < y.reportTime;
+        }
+        return x.id < y.id;
+    }
+
+    void push(IncidentNode* node) {
+        heap.push_back(node);
+        siftUp(heap.size() - 1);
+    }
+
+    // Most urgent waiting incident, or nullptr
+    IncidentNode* top() const {
+        return heap.empty() ? nullptr : heap[0];
+    }
+
+    bool contains(const IncidentNode* node) const {
+        return node->heapSlot != TRIAGE_NOT_QUEUED;
+    }
+
+    void remove(IncidentNode* node) {
+        if (!contains(node)) {
+            return;
+        }
+        size_t i = node->heapSlot;
+        node->heapSlot = TRIAGE_NOT_QUEUED;
+        IncidentNode* last = heap.back();
+        heap.pop_back();
+        if (last != node) {
+            place(i, last);
+            update(last);
+        }
+    }
+
+    // Restores the order after a queued node's severity changed either way
+    void update(IncidentNode* node) {
+        size_t i = node->heapSlot;
+        if (i > 0 && before(node, heap[(i - 1) / TRIAGE_ARITY])) {
+            siftUp(i);
+        }
+        else {
+            siftDown(i);
+        }
+    }
+
+    // Replaces the contents in O(n) by sifting down from the last parent
+    void build(const vector<IncidentNode*>& nodes) {
+        clear();
+        heap = nodes;
+        for (size_t i = 0; i < heap.size(); ++i) {
+            heap[i]->heapSlot = i;
+        }
+        if (heap.size() < 2) {
+            return;
+        }
+        for (size_t i = (heap.size() - 2) / TRIAGE_ARITY + 1; i-- > 0;) {
+            siftDown(i);
+        }
+    }
+
+    void clear() {
+        for (size_t i = 0; i < heap.size(); ++i) {
+            heap[i]->heapSlot = TRIAGE_NOT_QUEUED;
+        }
+        heap.clear();
+    }
+
+    size_t size() const {
+        return heap.size();
+    }
+};
+
+const uint32_t ARCHIVE_BLOCK_ROWS = 4096;   // Incidents per compressed block
+
+// Columns of an archive block. Rows are sorted by (report time, ID), so
+// report times are stored as plain varint deltas; IDs and coordinates as
+// zigzag varint deltas from the previous row, which stay short when nearby
+// rows are close in space; the response time as a zigzag varint offset
+// from the report time; the rest as zigzag varints.
+enum ArchiveColumn {
+    ARCHIVE_ID,
+    ARCHIVE_REPORT,
+    ARCHIVE_RESPONSE,
+    ARCHIVE_X,
+    ARCHIVE_Y,
+    ARCHIVE_STATION,
+    ARCHIVE_DISPATCHER,
+    ARCHIVE_SEVERITY,
+    ARCHIVE_COLUMNS
+};
+
+enum ArchiveEncoding { ENCODE_DELTA, ENCODE_ZIGZAG_DELTA, ENCODE_ZIGZAG };
+
+const ArchiveEncoding ARCHIVE_ENCODINGS[ARCHIVE_COLUMNS] = {
+    ENCODE_ZIGZAG_DELTA, ENCODE_DELTA, ENCODE_ZIGZAG, ENCODE_ZIGZAG_DELTA,
+    ENCODE_ZIGZAG_DELTA, ENCODE_ZIGZAG, ENCODE_ZIGZAG, ENCODE_ZIGZAG
+};
+
+// Block header and zone map; also the block's on-disk form in snapshots
+struct ArchiveBlockHeader {
+    uint32_t count;
+    int32_t minId, maxId;
+    int32_t minReport, maxReport;
+    int32_t minX, maxX, minY, maxY;
+    uint32_t columnStart[ARCHIVE_COLUMNS + 1];   // Byte offset of each column in the data; the last is the total
+};
+
+// Archived incidents matching a query: report time and position inside
+// inclusive bounds
+struct ArchiveQuery {
+    int fromTime, toTime;
+    int minX, minY, maxX, maxY;
+};
+
+struct ArchiveSummary {
+    uint64_t incidents;
+    uint64_t blocksScanned, blocksSkipped;
+    double meanResponse;        // Response time minus report time
+    long long maxResponse;
+    uint64_t bySeverity[SEVERITY_CRITICAL + 1];
+};
+
+inline uint32_t zigzag(uint32_t v) {
+    return (v << 1) ^ (uint32_t)((int32_t)v >> 31);
+}
+
+inline uint32_t unzigzag(uint32_t v) {
+    return (v >> 1) ^ (0u - (v & 1));
+}
+
+// Resolved incidents kept out of the live lists in compressed column
+// blocks of up to ARCHIVE_BLOCK_ROWS rows, about a fifth of their live
+// size. Each block has a min/max zone map on ID, report time and position,
+// so scans skip blocks that cannot match without decoding them. Matching
+// blocks are decoded a column at a time into flat arrays and filtered with
+// branch-free loops the compiler vectorizes; only the columns a query needs
+// are decoded. Blocks are appended and never change, except that a
+// partly filled last block is merged with the next batch.
+class IncidentArchive {
+private:
+    struct Block {
+        ArchiveBlockHeader header;
+        vector<uint8_t> data;
+    };
+
+    vector<Block> blocks;
+    size_t rows;
+    size_t bytes;
+
+    static void putVarint(vector<uint8_t>& out, uint32_t v) {
+        while (v >= 0x80) {
+            out.push_back((uint8_t)(v | 0x80));
+            v >>= 7;
+        }
+        out.push_back((uint8_t)v);
+    }
+
+    // Arithmetic is modulo 2^32 so any int column round-trips
+    static void encodeColumn(vector<uint8_t>& out, const int32_t* values, size_t n, ArchiveEncoding encoding, int32_t base) {
+        uint32_t previous = (uint32_t)base;
+        for (size_t i = 0; i < n; ++i) {
+            uint32_t v = (uint32_t)values[i];
+            if (encoding == ENCODE_DELTA) {
+                putVarint(out, v - previous);
+            }
+            else if (encoding == ENCODE_ZIGZAG_DELTA) {
+                putVarint(out, zigzag(v - previous));
+            }
+            else {
+                putVarint(out, zigzag(v));
+            }
+            previous = v;
+        }
+    }
+
+    // Varints are read in one pass, then undone in separate flat loops
+    static void decodeColumn(const Block& block, ArchiveColumn column, int32_t* out) {
+        const uint8_t* p = block.data.data() + block.header.columnStart[column];
+        uint32_t n = block.header.count;
+        uint32_t* raw = (uint32_t*)out;
+        for (uint32_t i = 0; i < n; ++i) {
+            uint32_t v = *p & 0x7F;
+            for (int shift = 7; *p++ & 0x80; shift += 7) {
+                v |= (uint32_t)(*p & 0x7F) << shift;
+            }
+            raw[i] = v;
+        }
+        ArchiveEncoding encoding = ARCHIVE_ENCODINGS[column];
+        if (encoding != ENCODE_DELTA) {
+            for (uint32_t i = 0; i < n; ++i) {
+                raw[i] = unzigzag(raw[i]);
+            }
+        }
+        if (encoding != ENCODE_ZIGZAG) {
+            uint32_t running = encoding == ENCODE_DELTA ? (uint32_t)block.header.minReport : 0;
+            for (uint32_t i = 0; i < n; ++i) {
+                running += raw[i];
+                raw[i] = running;
+            }
+        }
+    }
+
+    // Rows must be sorted by (report time, ID)
+    void appendBlock(const Incident* sorted, uint32_t n) {
+        Block block;
+        ArchiveBlockHeader& h = block.header;
+        memset(&h, 0, sizeof(h));
+        h.count = n;
+        h.minId = h.maxId = sorted[0].id;
+        h.minReport = sorted[0].reportTime;
+        h.maxReport = sorted[n - 1].reportTime;
+        h.minX = h.maxX = sorted[0].x;
+        h.minY = h.maxY = sorted[0].y;
+        vector<int32_t> columns[ARCHIVE_COLUMNS];
+        for (int c = 0; c < ARCHIVE_COLUMNS; ++c) {
+            columns[c].resize(n);
+        }
+        for (uint32_t i = 0; i < n; ++i) {
+            const Incident& in = sorted[i];
+            h.minId = min(h.minId, in.id);
+            h.maxId = max(h.maxId, in.id);
+            h.minX = min(h.minX, in.x);
+            h.maxX = max(h.maxX, in.x);
+            h.minY = min(h.minY, in.y);
+            h.maxY = max(h.maxY, in.y);
+            columns[ARCHIVE_ID][i] = in.id;
+            columns[ARCHIVE_REPORT][i] = in.reportTime;
+            columns[ARCHIVE_RESPONSE][i] = (int32_t)((uint32_t)in.responseTime - (uint32_t)in.reportTime);
+            columns[ARCHIVE_X][i] = in.x;
+            columns[ARCHIVE_Y][i] = in.y;
+            columns[ARCHIVE_STATION][i] = in.reportedFromStationId;
+            columns[ARCHIVE_DISPATCHER][i] = in.assignedDispatcherId;
+            columns[ARCHIVE_SEVERITY][i] = in.severity;
+        }
+        for (int c = 0; c < ARCHIVE_COLUMNS; ++c) {
+            h.columnStart[c] = (uint32_t)block.data.size();
+            encodeColumn(block.data, columns[c].data(), n, ARCHIVE_ENCODINGS[c], c == ARCHIVE_REPORT ? h.minReport : 0);
+        }
+        h.columnStart[ARCHIVE_COLUMNS] = (uint32_t)block.data.size();
+        block.data.shrink_to_fit();
+        rows += n;
+        bytes += sizeof(Block) + block.data.size();
+        blocks.push_back(std::move(block));
+    }
+
+    // True if a column holds exactly count varints of at most 5 bytes
+    static bool validColumn(const uint8_t* p, const uint8_t* end, uint32_t count) {
+        uint32_t values = 0;
+        int length = 0;
+        for (; p < end; ++p) {
+            if (++length > 5) {
+                return false;
+            }
+            if ((*p & 0x80) == 0) {
+                ++values;
+                length = 0;
+            }
+        }
+        return values == count && length == 0;
+    }
+
+    static void decodeRows(const Block& block, vector<Incident>& out) {
+        uint32_t n = block.header.count;
+        vector<int32_t> columns[ARCHIVE_COLUMNS];
+        for (int c = 0; c < ARCHIVE_COLUMNS; ++c) {
+            columns[c].resize(n);
+            decodeColumn(block, (ArchiveColumn)c, columns[c].data());
+        }
+        for (uint32_t i = 0; i < n; ++i) {
+            out.push_back(Incident{ columns[ARCHIVE_ID][i], columns[ARCHIVE_X][i], columns[ARCHIVE_Y][i], columns[ARCHIVE_REPORT][i],
+                (int32_t)((uint32_t)columns[ARCHIVE_REPORT][i] + (uint32_t)columns[ARCHIVE_RESPONSE][i]),
+                columns[ARCHIVE_STATION][i], columns[ARCHIVE_DISPATCHER][i], columns[ARCHIVE_SEVERITY][i] });
+        }
+    }
+
+public:
+    IncidentArchive() : rows(0), bytes(0) {}
+
+    // Compresses a batch of incidents into new blocks
+    void append(vector<Incident> incidents) {
+        if (!blocks.empty() && blocks.back().header.count < ARCHIVE_BLOCK_ROWS) {
+            decodeRows(blocks.back(), incidents);
+            rows -= blocks.back().header.count;
+            bytes -= sizeof(Block) + blocks.back().data.size();
+            blocks.pop_back();
+        }
+        sort(incidents.begin(), incidents.end(), [](const Incident& a, const Incident& b) {
+            return a.reportTime != b.reportTime ? a.reportTime < b.reportTime : a.id < b.id;
+        });
+        for (size_t i = 0; i < incidents.size(); i += ARCHIVE_BLOCK_ROWS) {
+            appendBlock(incidents.data() + i, (uint32_t)min((size_t)ARCHIVE_BLOCK_ROWS, incidents.size() - i));
+        }
+    }
+
+    ArchiveSummary summarize(const ArchiveQuery& q) const {
+        ArchiveSummary summary = ArchiveSummary();
+        vector<int32_t> report(ARCHIVE_BLOCK_ROWS), xs(ARCHIVE_BLOCK_ROWS), ys(ARCHIVE_BLOCK_ROWS);
+        vector<int32_t> response(ARCHIVE_BLOCK_ROWS), severity(ARCHIVE_BLOCK_ROWS);
+        vector<uint8_t> keep(ARCHIVE_BLOCK_ROWS);
+        long long totalResponse = 0;
+        long long maxResponse = LLONG_MIN;
+        for (size_t b = 0; b < blocks.size(); ++b) {
+            const Block& block = blocks[b];
+            const ArchiveBlockHeader& h = block.header;
+            if (h.maxReport < q.fromTime || h.minReport > q.toTime || h.maxX < q.minX || h.minX > q.maxX || h.maxY < q.minY || h.minY > q.maxY) {
+                ++summary.blocksSkipped;
+                continue;
+            }
+            ++summary.blocksScanned;
+            uint32_t n = h.count;
+            decodeColumn(block, ARCHIVE_REPORT, report.data());
+            decodeColumn(block, ARCHIVE_X, xs.data());
+            decodeColumn(block, ARCHIVE_Y, ys.data());
+            decodeColumn(block, ARCHIVE_RESPONSE, response.data());
+            decodeColumn(block, ARCHIVE_SEVERITY, severity.data());
+            const int32_t* r = report.data();
+            const int32_t* x = xs.data();
+            const int32_t* y = ys.data();
+            uint8_t* k = keep.data();
+            for (uint32_t i = 0; i < n; ++i) {
+                k[i] = (uint8_t)((r[i] >= q.fromTime) & (r[i] <= q.toTime) & (x[i] >= q.minX) & (x[i] <= q.maxX) & (y[i] >= q.minY) & (y[i] <= q.maxY));
+            }
+            const int32_t* delay = response.data();
+            uint64_t count = 0;
+            long long sum = 0;
+            long long longest = LLONG_MIN;
+            for (uint32_t i = 0; i < n; ++i) {
+                count += k[i];
+                sum += k[i] ? (long long)delay[i] : 0;
+                longest = max(longest, k[i] ? (long long)delay[i] : LLONG_MIN);
+            }
+            for (uint32_t i = 0; i < n; ++i) {
+                summary.bySeverity[min(max(severity[i], 0), SEVERITY_CRITICAL)] += k[i];
+            }
+            summary.incidents += count;
+            totalResponse += sum;
+            maxResponse = max(maxResponse, longest);
+        }
+        summary.meanResponse = summary.incidents > 0 ? (double)totalResponse / summary.incidents : 0;
+        summary.maxResponse = summary.incidents > 0 ? maxResponse : 0;
+        return summary;
+    }
+
+    // Every archived incident, block by block
+    void decodeAll(vector<Incident>& out) const {
+        out.reserve(out.size() + rows);
+        for (size_t b = 0; b < blocks.size(); ++b) {
+            decodeRows(blocks[b], out);
+        }
+    }
+
+    // Archived incidents inside a box, in archive order; blocks whose zone
+    // map misses the box are not decoded
+    void decodeInBox(int minX, int minY, int maxX, int maxY, vector<Incident>& out) const {
+        vector<Incident> rowsOfBlock;
+        for (size_t b = 0; b < blocks.size(); ++b) {
+            const ArchiveBlockHeader& h = blocks[b].header;
+            if (h.maxX < minX || h.minX > maxX || h.maxY < minY || h.minY > maxY) {
+                continue;
+            }
+            rowsOfBlock.clear();
+            decodeRows(blocks[b], rowsOfBlock);
+            for (size_t i = 0; i < rowsOfBlock.size(); ++i) {
+                const Incident& in = rowsOfBlock[i];
+                if (in.x >= minX && in.x <= maxX && in.y >= minY && in.y <= maxY) {
+                    out.push_back(in);
+                }
+            }
+        }
+    }
+
+    // Positions and report times of every archived incident, appended as
+    // flat columns without building rows
+    void decodePositions(vector<int32_t>& xs, vector<int32_t>& ys, vector<int32_t>& reports) const {
+        size_t at = xs.size();
+        xs.resize(at + rows);
+        ys.resize(at + rows);
+        reports.resize(at + rows);
+        for (size_t b = 0; b < blocks.size(); ++b) {
+            decodeColumn(blocks[b], ARCHIVE_X, xs.data() + at);
+            decodeColumn(blocks[b], ARCHIVE_Y, ys.data() + at);
+            decodeColumn(blocks[b], ARCHIVE_REPORT, reports.data() + at);
+            at += blocks[b].header.count;
+        }
+    }
+
+    // Blocks as stored in snapshots: each header followed by its data
+    void serialize(string& out) const {
+        for (size_t b = 0; b < blocks.size(); ++b) {
+            out.append((const char*)&blocks[b].header, sizeof(ArchiveBlockHeader));
+            out.append((const char*)blocks[b].data.data(), blocks[b].data.size());
+        }
+    }
+
+    // Reads blocks written by serialize; false if they do not fit the buffer
+    bool deserialize(const char* p, size_t size) {
+        clear();
+        const char* end = p + size;
+        while (p < end) {
+            Block block;
+            if ((size_t)(end - p) < sizeof(ArchiveBlockHeader)) {
+                return false;
+            }
+            memcpy(&block.header, p, sizeof(ArchiveBlockHeader));
+            p += sizeof(ArchiveBlockHeader);
+            const ArchiveBlockHeader& h = block.header;
+            uint32_t total = h.columnStart[ARCHIVE_COLUMNS];
+            if (h.count == 0 || h.count > ARCHIVE_BLOCK_ROWS || total > (size_t)(end - p) || h.columnStart[0] != 0) {
+                return false;
+            }
+            for (int c = 0; c < ARCHIVE_COLUMNS; ++c) {
+                if (h.columnStart[c + 1] < h.columnStart[c] || h.columnStart[c + 1] > total
+                    || !validColumn((const uint8_t*)p + h.columnStart[c], (const uint8_t*)p + h.columnStart[c + 1], h.count)) {
+                    return false;
+                }
+            }
+            block.data.assign((const uint8_t*)p, (const uint8_t*)p + total);
+            p += total;
+            rows += h.count;
+            bytes += sizeof(Block) + total;
+            blocks.push_back(std::move(block));
+        }
+        return true;
+    }
+
+    void clear() {
+        blocks.clear();
+        rows = 0;
+        bytes = 0;
+    }
+
+    size_t size() const {
+        return rows;
+    }
+
+    size_t blockCount() const {
+        return blocks.size();
+    }
+
+    size_t memoryBytes() const {
+        return bytes;
+    }
+};
+
+// Point identified by its position in a dense array, e.g. a road
+// intersection or one side of a batch assignment
+struct IndexedPoint {
+    int index;   // Dense position
+    int x, y;    // Coordinates
+};
+
+inline int pointX(const IndexedPoint* point) { return point->x; }
+inline int pointY(const IndexedPoint* point) { return point->y; }
+inline int pointId(const IndexedPoint* point) { return point->index; }
+
+// Which incidents a hotspot grid counts: those reported in [fromTime,
+// toTime]. With a period the report time is first taken modulo it, so
+// period 1440 with 480..960 means 08:00-16:00 on every day of minutes; a
+// window with fromTime > toTime then wraps past midnight.
+struct HotspotOptions {
+    int fromTime, toTime;
+    int period;             // 0 compares report times as they are
+    int cellSize;           // 0 picks one giving at most HOTSPOT_AUTO_CELLS cells a side
+    unsigned threads;       // 0 uses one per hardware thread
+};
+
+const int HOTSPOT_AUTO_CELLS = 256;
+const size_t HOTSPOT_MAX_CELLS = (size_t)1 << 22;
+
+struct HotspotCell {
+    int x, y;               // Cell centre
+    uint64_t incidents;
+};
+
+struct StagingPlan {
+    vector<HotspotCell> points;     // Staging positions and the incidents closest to each
+    uint64_t incidents;             // Incidents counted by the grid
+    size_t cells;                   // Occupied cells
+    int cellSize;
+    int iterations;
+    double expectedDistance;        // Mean Manhattan distance to the closest staging position
+    double currentDistance;         // Same for the current dispatcher homes; -1 without dispatchers
+    double seconds;
+};
+
+// Incident density over a uniform grid of cells, counted in parallel: each
+// thread bins a slice of the input into a private grid, and the grids are
+// then summed, again split across threads by cell range. Staging positions
+// come from weighted k-medians over the occupied cells. Under the Manhattan
+// metric the best position for a group of cells is the weighted median of
+// their x and of their y separately, so each Lloyd round is exact. Rounds
+// skip most distance scans with Hamerly's bounds: a cell whose distance to
+// its own centre is still below the smallest possible distance to any
+// other centre cannot change group. Distances are measured from cell
+// centres, so they are accurate to about half a cell per axis.
+class HotspotGrid {
+private:
+    int originX, originY;       // Lower corner of cell (0, 0)
+    int cellSize;
+    int cols, rows;
+    vector<uint32_t> counts;    // Incidents per cell, row-major
+    uint64_t total;
+    unsigned threads;
+
+    // Runs work(task) for tasks 0..count-1 on up to threads threads
+    template <typename Work>
+    static void parallelFor(size_t count, unsigned threads, Work work) {
+        atomic<size_t> nextTask(0);
+        auto run = [&]() {
+            for (size_t t = nextTask.fetch_add(1); t < count; t = nextTask.fetch_add(1)) {
+                work(t);
+            }
+        };
+        vector<thread> workers;
+        for (unsigned t = 1; t < min((size_t)threads, count); ++t) {
+            workers.push_back(thread(run));
+        }
+        run();
+        for (size_t t = 0; t < workers.size(); ++t) {
+            workers[t].join();
+        }
+    }
+
+    static long long foldTime(long long t, int period) {
+        return period > 0 ? ((t % period) + period) % period : t;
+    }
+
+    static bool inWindow(int t, const HotspotOptions& options) {
+        long long folded = foldTime(t, options.period);
+        if (options.fromTime <= options.toTime) {
+            return folded >= options.fromTime && folded <= options.toTime;
+        }
+        return folded >= options.fromTime || folded <= options.toTime;
+    }
+
+    int centreX(int col) const {
+        return (int)min((long long)originX + (long long)col * cellSize + cellSize / 2, (long long)INT_MAX);
+    }
+
+    int centreY(int row) const {
+        return (int)min((long long)originY + (long long)row * cellSize + cellSize / 2, (long long)INT_MAX);
+    }
+
+    static long long distance(long long x1, long long y1, long long x2, long long y2) {
+        return llabs(x1 - x2) + llabs(y1 - y2);
+    }
+
+public:
+    HotspotGrid() : originX(0), originY(0), cellSize(1), cols(0), rows(0), total(0), threads(1) {}
+
+    // Counts the incidents in the window; false if the grid would need
+    // more than HOTSPOT_MAX_CELLS cells
+    bool build(const int32_t* xs, const int32_t* ys, const int32_t* reports, size_t n, const HotspotOptions& options) {
+        threads = options.threads > 0 ? options.threads : max(1u, thread::hardware_concurrency());
+        const size_t MIN_SLICE = 1 << 16;
+        size_t slices = min((size_t)threads, n / MIN_SLICE + 1);
+        size_t sliceLength = n / slices + 1;
+
+        // Pass 1: bounds of the incidents in the window
+        struct Bounds {
+            int minX, minY, maxX, maxY;
+            size_t count;
+        };
+        vector<Bounds> bounds(slices, Bounds{ INT_MAX, INT_MAX, INT_MIN, INT_MIN, 0 });
+        parallelFor(slices, threads, [&](size_t s) {
+            Bounds b = bounds[s];
+            for (size_t i = s * sliceLength; i < min(n, (s + 1) * sliceLength); ++i) {
+                if (inWindow(reports[i], options)) {
+                    b.minX = min(b.minX, xs[i]);
+                    b.maxX = max(b.maxX, xs[i]);
+                    b.minY = min(b.minY, ys[i]);
+                    b.maxY = max(b.maxY, ys[i]);
+                    ++b.count;
+                }
+            }
+            bounds[s] = b;
+        });
+        Bounds all = Bounds{ INT_MAX, INT_MAX, INT_MIN, INT_MIN, 0 };
+        for (size_t s = 0; s < slices; ++s) {
+            all.minX = min(all.minX, bounds[s].minX);
+            all.maxX = max(all.maxX, bounds[s].maxX);
+            all.minY = min(all.minY, bounds[s].minY);
+            all.maxY = max(all.maxY, bounds[s].maxY);
+            all.count += bounds[s].count;
+        }
+        counts.clear();
+        total = 0;
+        cols = rows = 0;
+        if (all.count == 0) {
+            return true;
+        }
+
+        long long spanX = (long long)all.maxX - all.minX + 1, spanY = (long long)all.maxY - all.minY + 1;
+        long long side = options.cellSize > 0 ? options.cellSize : max(1LL, (max(spanX, spanY) + HOTSPOT_AUTO_CELLS - 1) / HOTSPOT_AUTO_CELLS);
+        long long colCount = (spanX + side - 1) / side, rowCount = (spanY + side - 1) / side;
+        if (colCount > (long long)HOTSPOT_MAX_CELLS || rowCount > (long long)HOTSPOT_MAX_CELLS / colCount) {
+            return false;
+        }
+        originX = all.minX;
+        originY = all.minY;
+        cellSize = (int)side;
+        cols = (int)colCount;
+        rows = (int)rowCount;
+        size_t cells = (size_t)cols * rows;
+
+        // Pass 2: every slice into its own grid, then the grids summed by cell range
+        vector<vector<uint32_t>> partial(slices);
+        parallelFor(slices, threads, [&](size_t s) {
+            vector<uint32_t>& grid = partial[s];
+            grid.assign(cells, 0);
+            for (size_t i = s * sliceLength; i < min(n, (s + 1) * sliceLength); ++i) {
+                if (inWindow(reports[i], options)) {
+                    size_t col = (size_t)(((long long)xs[i] - originX) / cellSize);
+                    size_t row = (size_t)(((long long)ys[i] - originY) / cellSize);
+                    ++grid[row * cols + col];
+                }
+            }
+        });
+        counts.swap(partial[0]);
+        const size_t RANGE = 1 << 16;
+        parallelFor((cells + RANGE - 1) / RANGE, threads, [&](size_t r) {
+            for (size_t s = 1; s < slices; ++s) {
+                const uint32_t* from = partial[s].data();
+                for (size_t c = r * RANGE; c < min(cells, (r + 1) * RANGE); ++c) {
+                    counts[c] += from[c];
+                }
+            }
+        });
+        total = all.count;
+        return true;
+    }
+
+    uint64_t incidents() const {
+        return total;
+    }
+
+    int side() const {
+        return cellSize;
+    }
+
+    // The count most crowded cells, most crowded first
+    vector<HotspotCell> hottest(size_t count) const {
+        vector<HotspotCell> cells;
+        for (int r = 0; r < rows; ++r) {
+            for (int c = 0; c < cols; ++c) {
+                uint32_t n = counts[(size_t)r * cols + c];
+                if (n > 0) {
+                    cells.push_back(HotspotCell{ centreX(c), centreY(r), n });
+                }
+            }
+        }
+        count = min(count, cells.size());
+        partial_sort(cells.begin(), cells.begin() + count, cells.end(), [](const HotspotCell& a, const HotspotCell& b) {
+            return a.incidents != b.incidents ? a.incidents > b.incidents : (a.x != b.x ? a.x < b.x : a.y < b.y);
+        });
+        cells.resize(count);
+        return cells;
+    }
+
+    // Weighted k-medians over the occupied cells. Seeding picks each next
+    // centre with probability proportional to weight times distance to the
+    // nearest centre so far, from a fixed seed, so plans are repeatable.
+    StagingPlan recommend(size_t k) const {
+        StagingPlan plan = StagingPlan();
+        plan.incidents = total;
+        plan.cellSize = cellSize;
+        plan.currentDistance = -1;
+        vector<int> px, py, pcol;
+        vector<uint64_t> weight;
+        for (int r = 0; r < rows; ++r) {
+            for (int c = 0; c < cols; ++c) {
+                uint32_t n = counts[(size_t)r * cols + c];
+                if (n > 0) {
+                    px.push_back(centreX(c));
+                    py.push_back(centreY(r));
+                    pcol.push_back(c);
+                    weight.push_back(n);
+                }
+            }
+        }
+        size_t points = px.size();
+        plan.cells = points;
+        k = min(k, points);
+        if (k == 0) {
+            return plan;
+        }
+
+        vector<int> cx, cy;
+        vector<long long> nearest(points, LLONG_MAX);
+        uint64_t state = 0x9E3779B97F4A7C15ULL;
+        auto random = [&state]() {
+            state ^= state >> 12;
+            state ^= state << 25;
+            state ^= state >> 27;
+            return state * 0x2545F4914F6CDD1DULL;
+        };
+        size_t pick = 0;
+        uint64_t heaviest = 0;
+        for (size_t i = 0; i < points; ++i) {
+            if (weight[i] > heaviest) {
+                heaviest = weight[i];
+                pick = i;
+            }
+        }
+        while (cx.size() < k) {
+            cx.push_back(px[pick]);
+            cy.push_back(py[pick]);
+            double mass = 0;
+            for (size_t i = 0; i < points; ++i) {
+                nearest[i] = min(nearest[i], distance(px[i], py[i], cx.back(), cy.back()));
+                mass += (double)weight[i] * nearest[i];
+            }
+            if (mass == 0) {
+                break;      // Every cell already holds a centre
+            }
+            double target = (random() >> 11) * (1.0 / 9007199254740992.0) * mass;
+            for (size_t i = 0; i < points; ++i) {
+                if (nearest[i] > 0) {
+                    pick = i;   // Rounding may leave target just above zero at the end
+                    target -= (double)weight[i] * nearest[i];
+                    if (target < 0) {
+                        break;
+                    }
+                }
+            }
+        }
+        k = cx.size();
+
+        // Cells in column order, for the weighted median of x; they are
+        // already in row order for y
+        vector<size_t> byCol(points);
+        {
+            vector<size_t> start(cols + 1, 0);
+            for (size_t i = 0; i < points; ++i) {
+                ++start[pcol[i] + 1];
+            }
+            for (int c = 0; c < cols; ++c) {
+                start[c + 1] += start[c];
+            }
+            for (size_t i = 0; i < points; ++i) {
+                byCol[start[pcol[i]]++] = i;
+            }
+        }
+
+        vector<int> label(points);
+        vector<long long> upper(points), lower(points);
+        auto scan = [&](size_t i) {
+            long long best = LLONG_MAX, second = LLONG_MAX;
+            int bestCentre = 0;
+            for (size_t c = 0; c < k; ++c) {
+                long long d = distance(px[i], py[i], cx[c], cy[c]);
+                if (d < best) {
+                    second = best;
+                    best = d;
+                    bestCentre = (int)c;
+                }
+                else if (d < second) {
+                    second = d;
+                }
+            }
+            label[i] = bestCentre;
+            upper[i] = best;
+            lower[i] = second;
+        };
+        const size_t RANGE = 4096;
+        size_t ranges = (points + RANGE - 1) / RANGE;
+        parallelFor(ranges, threads, [&](size_t r) {
+            for (size_t i = r * RANGE; i < min(points, (r + 1) * RANGE); ++i) {
+                scan(i);
+            }
+        });
+
+        const int MAX_ROUNDS = 100;
+        vector<uint64_t> groupWeight(k), seen(k);
+        vector<int> medianX(k), medianY(k);
+        vector<long long> moved(k);
+        for (plan.iterations = 1; plan.iterations <= MAX_ROUNDS; ++plan.iterations) {
+            fill(groupWeight.begin(), groupWeight.end(), 0);
+            for (size_t i = 0; i < points; ++i) {
+                groupWeight[label[i]] += weight[i];
+            }
+            fill(seen.begin(), seen.end(), 0);
+            for (size_t j = 0; j < points; ++j) {
+                size_t i = byCol[j];
+                int c = label[i];
+                if (seen[c] * 2 < groupWeight[c] && (seen[c] += weight[i]) * 2 >= groupWeight[c]) {
+                    medianX[c] = px[i];
+                }
+            }
+            fill(seen.begin(), seen.end(), 0);
+            for (size_t i = 0; i < points; ++i) {
+                int c = label[i];
+                if (seen[c] * 2 < groupWeight[c] && (seen[c] += weight[i]) * 2 >= groupWeight[c]) {
+                    medianY[c] = py[i];
+                }
+            }
+            long long largest = 0;
+            for (size_t c = 0; c < k; ++c) {
+                moved[c] = 0;
+                if (groupWeight[c] > 0) {
+                    moved[c] = distance(cx[c], cy[c], medianX[c], medianY[c]);
+                    cx[c] = medianX[c];
+                    cy[c] = medianY[c];
+                }
+                largest = max(largest, moved[c]);
+            }
+            if (largest == 0) {
+                break;
+            }
+            parallelFor(ranges, threads, [&](size_t r) {
+                for (size_t i = r * RANGE; i < min(points, (r + 1) * RANGE); ++i) {
+                    upper[i] += moved[label[i]];
+                    lower[i] = lower[i] == LLONG_MAX ? LLONG_MAX : lower[i] - largest;
+                    if (upper[i] <= lower[i]) {
+                        continue;
+                    }
+                    upper[i] = distance(px[i], py[i], cx[label[i]], cy[label[i]]);
+                    if (upper[i] > lower[i]) {
+                        scan(i);
+                    }
+                }
+            });
+        }
+        plan.iterations = min(plan.iterations, MAX_ROUNDS);
+
+        double sum = 0;
+        plan.points.resize(k);
+        for (size_t c = 0; c < k; ++c) {
+            plan.points[c] = HotspotCell{ cx[c], cy[c], 0 };
+        }
+        for (size_t i = 0; i < points; ++i) {
+            int c = label[i];
+            plan.points[c].incidents += weight[i];
+            sum += (double)weight[i] * distance(px[i], py[i], cx[c], cy[c]);
+        }
+        plan.expectedDistance = sum / total;
+        return plan;
+    }
+
+    // Mean distance from the counted incidents to the closest of sites
+    double meanDistance(const vector<IndexedPoint>& sites) const {
+        if (sites.empty() || total == 0) {
+            return -1;
+        }
+        vector<IndexedPoint> copies(sites);
+        PointGrid<IndexedPoint> grid;
+        vector<IndexedPoint*> nodes;
+        for (size_t i = 0; i < copies.size(); ++i) {
+            nodes.push_back(&copies[i]);
+        }
+        grid.rebuild(nodes);
+        double sum = 0;
+        for (int r = 0; r < rows; ++r) {
+            for (int c = 0; c < cols; ++c) {
+                uint32_t n = counts[(size_t)r * cols + c];
+                if (n > 0) {
+                    const IndexedPoint* site = grid.nearest(centreX(c), centreY(r));
+                    sum += (double)n * distance(site->x, site->y, centreX(c), centreY(r));
+                }
+            }
+        }
+        return sum / total;
+    }
+};
+
+const int ROAD_INF = INT_MAX;   // Unreachable marker for road distances
+
+// Weighted road graph with CSR adjacency and an A* engine. Queries use a
+// landmark (ALT) lower bound computed at load time, combined with the
+// Manhattan distance when every road is at least as long as the straight
+// grid distance between its ends. Points off the graph snap to the nearest
+// intersection and pay the Manhattan distance to it.
+class RoadNetwork {
+private:
+    static const int MAX_LANDMARKS = 16;
+
+    vector<IndexedPoint> nodes;         // Intersections by dense index
+    vector<int> edgeOffset;         // CSR row offsets, size nodes + 1
+    vector<int> edgeTarget;         // CSR column (head node) per edge
+    vector<int> edgeWeight;         // Road length per edge
+    vector<int> reverseOffset;      // CSR of the reversed graph
+    vector<int> reverseTarget;
+    vector<int> reverseWeight;
+    int scale;                      // See manhattanScale
+
+    int numLandmarks;
+    vector<int> landmarkFrom;       // [landmark * n + v] = d(landmark, v)
+    vector<int> landmarkTo;         // [landmark * n + v] = d(v, landmark)
+
+    PointGrid<IndexedPoint> snapGrid;   // Nearest intersection lookup
+
+    // Per-query scratch, reset lazily through a generation stamp
+    vector<int> dist;
+    vector<int> bound;              // Cached lower bound to the current target
+    vector<unsigned> stamp;
+    unsigned generation;
+
+    static void buildCsr(int n, const vector<int>& from, const vector<int>& to, const vector<int>& weight,
+        vector<int>& offset, vector<int>& target, vector<int>& weightOut) {
+        offset.assign(n + 1, 0);
+        for (size_t i = 0; i < from.size(); ++i) {
+            ++offset[from[i] + 1];
+        }
+        for (int v = 0; v < n; ++v) {
+            offset[v + 1] += offset[v];
+        }
+        target.resize(from.size());
+        weightOut.resize(from.size());
+        vector<int> fill(offset.begin(), offset.end() - 1);
+        for (size_t i = 0; i < from.size(); ++i) {
+            int slot = fill[from[i]]++;
+            target[slot] = to[i];
+            weightOut[slot] = weight[i];
+        }
+    }
+
+    // Full single-source Dijkstra over a CSR graph, used for landmark tables
+    static void dijkstra(int source, const vector<int>& offset, const vector<int>& target, const vector<int>& weight, int* out, int n) {
+        for (int v = 0; v < n; ++v) {
+            out[v] = ROAD_INF;
+        }
+        priority_queue<pair<long long, int>, vector<pair<long long, int>>, greater<pair<long long, int>>> heap;
+        out[source] = 0;
+        heap.push(make_pair(0LL, source));
+        while (!heap.empty()) {
+            pair<long long, int> top = heap.top();
+            heap.pop();
+            int v = top.second;
+            if (top.first != out[v]) {
+                continue;
+            }
+            for (int e = offset[v]; e < offset[v + 1]; ++e) {
+                long long candidate = top.first + weight[e];
+                int w = target[e];
+                if (candidate < out[w]) {
+                    out[w] = (int)min(candidate, (long long)ROAD_INF - 1);
+                    heap.push(make_pair((long long)out[w], w));
+                }
+            }
+        }
+    }
+
+    void buildLandmarks() {
+        int n = (int)nodes.size();
+        numLandmarks = min((int)MAX_LANDMARKS, n);
+        landmarkFrom.assign((size_t)numLandmarks * n, ROAD_INF);
+        landmarkTo.assign((size_t)numLandmarks * n, ROAD_INF);
+
+        // Farthest-point selection: each landmark maximises its distance to the ones before it
+        vector<long long> closest(n, LLONG_MAX);
+        int next = 0;
+        for (int l = 0; l < numLandmarks; ++l) {
+            int* from = &landmarkFrom[(size_t)l * n];
+            dijkstra(next, edgeOffset, edgeTarget, edgeWeight, from, n);
+            dijkstra(next, reverseOffset, reverseTarget, reverseWeight, &landmarkTo[(size_t)l * n], n);
+            long long farthest = -1;
+            for (int v = 0; v < n; ++v) {
+                long long d = from[v] == ROAD_INF ? LLONG_MAX / 2 : from[v];
+                closest[v] = min(closest[v], d);
+                if (closest[v] > farthest) {
+                    farthest = closest[v];
+                    next = v;
+                }
+            }
+        }
+    }
+
+    // Admissible lower bound on d(v, target)
+    int lowerBound(int v, int target) const {
+        int n = (int)nodes.size();
+        int bound = (int)((long long)(abs(nodes[v].x - nodes[target].x) + abs(nodes[v].y - nodes[target].y)) * scale / SCALE_ONE);
+        for (int l = 0; l < numLandmarks; ++l) {
+            size_t base = (size_t)l * n;
+            int fromV = landmarkFrom[base + v], fromT = landmarkFrom[base + target];
+            if (fromV != ROAD_INF && fromT != ROAD_INF) {
+                bound = max(bound, fromT - fromV);   // d(L,t) <= d(L,v) + d(v,t)
+            }
+            int toV = landmarkTo[base + v], toT = landmarkTo[base + target];
+            if (toV != ROAD_INF && toT != ROAD_INF) {
+                bound = max(bound, toV - toT);       // d(v,L) <= d(v,t) + d(t,L)
+            }
+        }
+        return bound;
+    }
+
+public:
+    static const int SCALE_ONE = 1024;
+
+    RoadNetwork() : scale(SCALE_ONE), numLandmarks(0), generation(0) {}
+
+    bool isLoaded() const {
+        return !nodes.empty();
+    }
+
+    // No route is shorter than the Manhattan distance times this over
+    // SCALE_ONE: the smallest ratio of a road's length to the straight-line
+    // length between its ends, rounded down and at most one
+    int manhattanScale() const {
+        return scale;
+    }
+
+    // Reads "Nodes:" lines of "id x y" and "Roads:" lines of "from to weight [oneway]".
+    // Roads are two-way unless the optional fourth field is 1.
+    bool loadFromFile(const string& filename) {
+        ifstream inFile(filename);
+        if (!inFile) {
+            cerr << "Error opening road network file.\n";
+            return false;
+        }
+
+        vector<IndexedPoint> newNodes;
+        OpenHashMap<int> idToIndex;
+        vector<int> from, to, weight;
+        int newScale = SCALE_ONE;
+        string line;
+        string section;
+        int lineNumber = 0;
+        while (getline(inFile, line)) {
+            ++lineNumber;
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            if (line.empty()) {
+                continue;
+            }
+            if (line == "Nodes:" || line == "Roads:") {
+                section = line;
+                continue;
+            }
+
+            istringstream iss(line);
+            if (section == "Nodes:") {
+                int id, x, y;
+                if (!(iss >> id >> x >> y) || !idToIndex.insert(id, (int)newNodes.size())) {
+                    cerr << "Invalid or duplicate road node on line " << lineNumber << ".\n";
+                    return false;
+                }
+                newNodes.push_back(IndexedPoint{ (int)newNodes.size(), x, y });
+            }
+            else if (section == "Roads:") {
+                int a, b, w, oneway = 0;
+                if (!(iss >> a >> b >> w) || w < 0) {
+                    cerr << "Invalid road on line " << lineNumber << ".\n";
+                    return false;
+                }
+                iss >> oneway;
+                int* ia = idToIndex.find(a);
+                int* ib = idToIndex.find(b);
+                if (ia == nullptr || ib == nullptr) {
+                    cerr << "Road on line " << lineNumber << " references an unknown node.\n";
+                    return false;
+                }
+                const IndexedPoint& na = newNodes[*ia];
+                const IndexedPoint& nb = newNodes[*ib];
+                int straight = abs(na.x - nb.x) + abs(na.y - nb.y);
+                if (w < straight) {
+                    newScale = min(newScale, (int)((long long)w * SCALE_ONE / straight));
+                }
+                from.push_back(*ia);
+                to.push_back(*ib);
+                weight.push_back(w);
+                if (oneway != 1) {
+                    from.push_back(*ib);
+                    to.push_back(*ia);
+                    weight.push_back(w);
+                }
+            }
+        }
+
+        nodes.swap(newNodes);
+        scale = newScale;
+        int n = (int)nodes.size();
+        buildCsr(n, from, to, weight, edgeOffset, edgeTarget, edgeWeight);
+        buildCsr(n, to, from, weight, reverseOffset, reverseTarget, reverseWeight);
+
+        snapGrid.clear();
+        for (int v = 0; v < n; ++v) {
+            snapGrid.insert(&nodes[v]);
+        }
+        buildLandmarks();
+
+        dist.assign(n, ROAD_INF);
+        bound.assign(n, 0);
+        stamp.assign(n, 0);
+        generation = 0;
+        cout << "Road network loaded: " << n << " intersections, " << edgeTarget.size() << " directed roads.\n";
+        return true;
+    }
+
+    // Index of the intersection closest to (x, y), -1 if the network is empty
+    int nearestNode(int x, int y) {
+        IndexedPoint* node = snapGrid.nearest(x, y);
+        return node != nullptr ? node->index : -1;
+    }
+
+    // A* shortest path length between two intersections, -1 if unreachable
+    int shortestPath(int source, int target) {
+        if (source == target) {
+            return 0;
+        }
+        if (++generation == 0) {
+            fill(stamp.begin(), stamp.end(), 0);
+            generation = 1;
+        }
+
+        // Heap entries are (distance + bound, node); bounds are computed once per touched node
+        priority_queue<pair<long long, int>, vector<pair<long long, int>>, greater<pair<long long, int>>> heap;
+        stamp[source] = generation;
+        dist[source] = 0;
+        bound[source] = lowerBound(source, target);
+        heap.push(make_pair((long long)bound[source], source));
+        while (!heap.empty()) {
+            pair<long long, int> top = heap.top();
+            heap.pop();
+            int v = top.second;
+            if (v == target) {
+                return dist[v];
+            }
+            if (top.first != (long long)dist[v] + bound[v]) {
+                continue;   // Stale entry
+            }
+            for (int e = edgeOffset[v]; e < edgeOffset[v + 1]; ++e) {
+                int w = edgeTarget[e];
+                long long candidate = (long long)dist[v] + edgeWeight[e];
+                if (candidate >= ROAD_INF) {
+                    continue;
+                }
+                if (stamp[w] != generation) {
+                    stamp[w] = generation;
+                    bound[w] = lowerBound(w, target);
+                }
+                else if (candidate >= dist[w]) {
+                    continue;
+                }
+                dist[w] = (int)candidate;
+                heap.push(make_pair(candidate + bound[w], w));
+            }
+        }
+        return -1;
+    }
+
+    // Landmark lower bound on distance(x1, y1, x2, y2), -1 if the network is empty
+    int lowerBoundDistance(int x1, int y1, int x2, int y2) {
+        int source = nearestNode(x1, y1);
+        int target = nearestNode(x2, y2);
+        if (source < 0 || target < 0) {
+            return -1;
+        }
+        long long total = (long long)lowerBound(source, target)
+            + abs(x1 - nodes[source].x) + abs(y1 - nodes[source].y)
+            + abs(x2 - nodes[target].x) + abs(y2 - nodes[target].y);
+        return (int)min(total, (long long)INT_MAX);
+    }
+
+    // Road distance between two points, including the legs to and from the
+    // nearest intersections; -1 if no route exists
+    int distance(int x1, int y1, int x2, int y2) {
+        int source = nearestNode(x1, y1);
+        int target = nearestNode(x2, y2);
+        if (source < 0 || target < 0) {
+            return -1;
+        }
+        int path = shortestPath(source, target);
+        if (path < 0) {
+            return -1;
+        }
+        long long total = (long long)path
+            + abs(x1 - nodes[source].x) + abs(y1 - nodes[source].y)
+            + abs(x2 - nodes[target].x) + abs(y2 - nodes[target].y);
+        return total >= ROAD_INF ? -1 : (int)total;
+    }
+};
+
+// Minimum-total-distance matching of "row" points to distinct "column" points
+// under the Manhattan metric (rows.size() <= cols.size()), by the shortest
+// augmenting path method of Jonker and Volgenant from a column-reduced dual.
+// Surplus columns are held by spare rows that share one potential and sit in
+// a grid. Rows still free after BATCH_SEARCH_SECONDS take their nearest
+// free column instead, and isExact() reports it.
+const double BATCH_SEARCH_SECONDS = 0.5;
+
+class BatchAssignment {
+private:
+    static const int SPARE = -2;       // rowOfCol of a column held by a spare row
+    static const size_t FLAT_START_STEPS = 8;   // Settled columns per row before the flat start gives up
+
+    vector<IndexedPoint> rows;
+    vector<IndexedPoint> cols;
+    PointGrid<IndexedPoint> spareGrid;  // Columns held by spare rows
+    long long spareLevel;               // Potential shared by every spare column
+    vector<int> active;                 // Columns not held by spares
+    vector<int> activeSlot;             // Position in active, per column
+
+    vector<long long> reduction;        // Each column's distance to its nearest row
+    vector<int> farthest;               // The m - n columns with the largest reductions
+
+    vector<long long> colPotential;     // Dual value per active column
+    vector<int> rowOfCol, colOfRow;     // Current matching, -1 when free
+    size_t steps;                       // Columns settled by augment since the start
+    bool exact;                         // False once the search ran out of time
+    chrono::steady_clock::time_point deadline;
+
+    // Dijkstra scratch
+    vector<long long> dist;             // Per column
+    vector<int> predCol;                // Column the path came through, -1 from the root
+    vector<int> open;                   // Active columns not settled
+    vector<int> settled;
+
+    long long cost(int r, int c) const {
+        return llabs((long long)rows[r].x - cols[c].x) + llabs((long long)rows[r].y - cols[c].y);
+    }
+
+    // A matched row's dual value; its matched arc is tight
+    long long rowPotential(int r) const {
+        int c = colOfRow[r];
+        return cost(r, c) - colPotential[c];
+    }
+
+    // Orders candidates by distance, a free column first among equals
+    static long long rank(long long distance, bool taken) {
+        return distance * 2 + (taken ? 1 : 0);
+    }
+
+    void match(int r, int c) {
+        colOfRow[r] = c;
+        rowOfCol[c] = r;
+    }
+
+    // Cheapest reduced distance below limit from row r to a spare column,
+    // or LLONG_MAX if there is none
+    long long spareDistance(int r, int* spareOut, long long limit = LLONG_MAX) {
+        int distance;
+        IndexedPoint* spare = spareGrid.nearest(rows[r].x, rows[r].y, &distance,
+                                                limit == LLONG_MAX ? LLONG_MAX : limit + spareLevel);
+        if (spare == nullptr) {
+            return LLONG_MAX;
+        }
+        *spareOut = spare->index;
+        return distance - spareLevel;
+    }
+
+    // Gives each row, in order, the free active column on its cheapest
+    // reduced arc unless a spare is cheaper; stops at the deadline
+    void greedyMatch() {
+        for (int r = 0; r < (int)rows.size(); ++r) {
+            if (r % 256 == 0 && chrono::steady_clock::now() > deadline) {
+                break;
+            }
+            int bestCol = -1;
+            long long bestRank = LLONG_MAX;
+            for (size_t k = 0; k < active.size(); ++k) {
+                int c = active[k];
+                long long candidate = rank(cost(r, c) - colPotential[c], rowOfCol[c] != -1);
+                if (candidate < bestRank) {
+                    bestRank = candidate;
+                    bestCol = c;
+                }
+            }
+            int spare;
+            long long toSpare = spareDistance(r, &spare);
+            if ((toSpare == LLONG_MAX || rank(toSpare, true) >= bestRank) && rowOfCol[bestCol] == -1) {
+                match(r, bestCol);
+            }
+        }
+    }
+
+    void reduceColumns() {
+        int n = (int)rows.size(), m = (int)cols.size();
+        vector<IndexedPoint*> rowNodes(n);
+        for (int r = 0; r < n; ++r) {
+            rowNodes[r] = &rows[r];
+        }
+        PointGrid<IndexedPoint> rowGrid;
+        rowGrid.rebuild(rowNodes);
+        reduction.assign(m, 0);
+        for (int c = 0; c < m; ++c) {
+            int distance = 0;
+            rowGrid.nearest(cols[c].x, cols[c].y, &distance);
+            reduction[c] = distance;
+        }
+
+        vector<int> byReduction(m);
+        for (int c = 0; c < m; ++c) {
+            byReduction[c] = c;
+        }
+        farthest.clear();
+        if (m > n) {
+            nth_element(byReduction.begin(), byReduction.begin() + (m - n - 1), byReduction.end(),
+                [this](int a, int b) { return reduction[a] > reduction[b]; });
+            farthest.assign(byReduction.begin(), byReduction.begin() + (m - n));
+        }
+    }
+
+    // Hands the farthest columns to the spares at the given level, caps the
+    // other potentials there and runs the greedy pass
+    void start(long long level) {
+        int n = (int)rows.size(), m = (int)cols.size();
+        rowOfCol.assign(m, -1);
+        colOfRow.assign(n, -1);
+        vector<IndexedPoint*> spareNodes;
+        for (size_t k = 0; k < farthest.size(); ++k) {
+            rowOfCol[farthest[k]] = SPARE;
+            spareNodes.push_back(&cols[farthest[k]]);
+        }
+        spareGrid.rebuild(spareNodes);
+        spareLevel = level;
+        active.clear();
+        for (int c = 0; c < m; ++c) {
+            if (rowOfCol[c] != SPARE) {
+                activeSlot[c] = (int)active.size();
+                active.push_back(c);
+                colPotential[c] = min(reduction[c], level);
+            }
+        }
+        steps = 0;
+        greedyMatch();
+    }
+
+    // Augments every free row; gives up once more than maxSteps columns
+    // have been settled in total or the deadline has passed
+    bool augmentAll(size_t maxSteps) {
+        for (int r = 0; r < (int)rows.size(); ++r) {
+            if (colOfRow[r] == -1) {
+                if (steps > maxSteps || chrono::steady_clock::now() > deadline) {
+                    return false;
+                }
+                augment(r);
+            }
+        }
+        return true;
+    }
+
+    // Moves a column from the spares to the active set, or back
+    void activate(int c) {
+        spareGrid.remove(&cols[c]);
+        activeSlot[c] = (int)active.size();
+        active.push_back(c);
+        colPotential[c] = spareLevel;
+        rowOfCol[c] = -1;
+    }
+
+    void retire(int c) {
+        int last = active.back();
+        active[activeSlot[c]] = last;
+        activeSlot[last] = activeSlot[c];
+        active.pop_back();
+        rowOfCol[c] = SPARE;
+        spareGrid.insert(&cols[c]);
+    }
+
+    // Updates the open columns' distances through a settled column and
+    // returns the position in open of the closest one afterwards
+    size_t relax(int from, int r, long long base) {
+        size_t next = 0;
+        long long nextRank = LLONG_MAX;
+        for (size_t k = 0; k < open.size(); ++k) {
+            int c = open[k];
+            long long d = base - colPotential[c] + (r == -1 ? 0 : cost(r, c));
+            if (d < dist[c]) {
+                dist[c] = d;
+                predCol[c] = from;
+            }
+            long long candidate = rank(dist[c], rowOfCol[c] != -1);
+            if (candidate < nextRank) {
+                nextRank = candidate;
+                next = k;
+            }
+        }
+        return next;
+    }
+
+    // Grows a shortest path tree from free row s until it reaches a free
+    // column, then flips the path and moves the settled columns' potentials
+    void augment(int s) {
+        open = active;
+        settled.clear();
+        for (size_t k = 0; k < open.size(); ++k) {
+            dist[open[k]] = LLONG_MAX;
+        }
+        size_t next = relax(-1, s, 0);
+
+        // The cheapest spare found so far; entering it settles every spare
+        // at that distance, since they share a potential
+        int entry = -1, entryFrom = -1;
+        long long entryDist = spareDistance(s, &entry);
+        bool spareReached = false;
+
+        // There is a free active column for every free row, so one is always reached
+        while (true) {
+            int c = open[next];
+            if (!spareReached && entry != -1 && rank(entryDist, true) < rank(dist[c], rowOfCol[c] != -1)) {
+                spareReached = true;
+                predCol[entry] = entryFrom;
+                next = relax(entry, -1, entryDist + spareLevel);
+                continue;
+            }
+            if (rowOfCol[c] == -1) {
+                break;
+            }
+            open[next] = open.back();
+            open.pop_back();
+            settled.push_back(c);
+            ++steps;
+            int r = rowOfCol[c];
+            long long base = dist[c] - rowPotential(r);
+            if (!spareReached) {
+                int spare;
+                // Only a spare that would beat the current entry is looked for
+                long long toSpare = spareDistance(r, &spare, entryDist == LLONG_MAX ? LLONG_MAX : entryDist - base);
+                if (toSpare != LLONG_MAX && base + toSpare < entryDist) {
+                    entryDist = base + toSpare;
+                    entry = spare;
+                    entryFrom = c;
+                }
+            }
+            next = relax(c, r, base);
+        }
+
+        int reachedCol = open[next];
+        long long reached = dist[reachedCol];
+        for (size_t k = 0; k < settled.size(); ++k) {
+            int c = settled[k];
+            colPotential[c] += dist[c] - reached;
+        }
+        if (spareReached) {
+            spareLevel += entryDist - reached;
+        }
+        // Each row on the path moves to the column it reached; a column
+        // reached through the spares joins them and the entry spare leaves
+        for (int c = reachedCol;;) {
+            int from = predCol[c];
+            if (spareReached && from == entry) {
+                retire(c);
+                c = entry;
+                from = predCol[c];
+                activate(c);
+            }
+            if (from == -1) {
+                match(s, c);
+                break;
+            }
+            match(rowOfCol[from], c);
+            c = from;
+        }
+    }
+
+    // Gives every row the search left free its nearest column that no row holds
+    void matchRemainingGreedily() {
+        vector<IndexedPoint*> freeNodes;
+        for (size_t c = 0; c < cols.size(); ++c) {
+            if (rowOfCol[c] < 0) {
+                freeNodes.push_back(&cols[c]);
+            }
+        }
+        PointGrid<IndexedPoint> freeGrid;
+        freeGrid.rebuild(freeNodes);
+        for (int r = 0; r < (int)rows.size(); ++r) {
+            if (colOfRow[r] == -1) {
+                IndexedPoint* column = freeGrid.nearest(rows[r].x, rows[r].y);
+                freeGrid.remove(column);
+                match(r, column->index);
+            }
+        }
+    }
+
+public:
+    BatchAssignment(const vector<IndexedPoint>& rowPoints, const vector<IndexedPoint>& colPoints)
+        : rows(rowPoints), cols(colPoints), spareLevel(0), steps(0), exact(true) {
+        for (size_t c = 0; c < cols.size(); ++c) {
+            cols[c].index = (int)c;
+        }
+        for (size_t r = 0; r < rows.size(); ++r) {
+            rows[r].index = (int)r;
+        }
+    }
+
+    // Column index matched to each row; totalCost receives the summed distance
+    vector<int> solve(long long& totalCost) {
+        int n = (int)rows.size(), m = (int)cols.size();
+        colPotential.assign(m, 0);
+        activeSlot.assign(m, -1);
+        dist.assign(m, 0);
+        predCol.assign(m, -1);
+
+        totalCost = 0;
+        if (n == 0) {
+            colOfRow.clear();
+            return colOfRow;
+        }
+        deadline = chrono::steady_clock::now() + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(BATCH_SEARCH_SECONDS));
+        reduceColumns();
+        bool solved = false;
+        if (m > n) {
+            // The flat start is cheap unless the rows crowd the same columns
+            start(*min_element(reduction.begin(), reduction.end()));
+            solved = augmentAll(FLAT_START_STEPS * n);
+        }
+        if (!solved) {
+            long long level = LLONG_MAX;
+            for (size_t k = 0; k < farthest.size(); ++k) {
+                level = min(level, reduction[farthest[k]]);
+            }
+            start(level);
+            solved = augmentAll(SIZE_MAX);
+        }
+        exact = solved;
+        if (!solved) {
+            matchRemainingGreedily();
+        }
+
+        for (int r = 0; r < n; ++r) {
+            totalCost += cost(r, colOfRow[r]);
+        }
+        return colOfRow;
+    }
+
+    // False when solve stopped searching and finished greedily
+    bool isExact() const {
+        return exact;
+    }
+};
+
+// Discrete-event simulation of dispatching. Incidents arrive at their
+// report time and are served by the nearest idle unit, which drives there,
+// stays on scene for the incident's responseTime, then drives back to its
+// base and becomes idle again. Incidents that find no idle unit wait in
+// arrival order for the next unit to get home. Travel takes Manhattan
+// distance divided by speed.
+struct SimUnit {
+    int id;
+    int homeX, homeY;       // Base the unit returns to; idle units are always here
+    double busySince;
+    double busyTime;        // Total time spent away from base
+};
+
+inline int pointX(const SimUnit* unit) { return unit->homeX; }
+inline int pointY(const SimUnit* unit) { return unit->homeY; }
+inline int pointId(const SimUnit* unit) { return unit->id; }
+
+struct SimIncident {
+    int id, x, y;
+    double reportTime;
+    double serviceTime;     // Time on scene
+    double responseTime;    // Report to unit arrival, filled in by the run
+};
+
+struct SimulationReport {
+    size_t incidents;
+    size_t served;
+    size_t units;
+    size_t events;
+    size_t maxWaiting;          // Longest queue of incidents without a unit
+    double p50, p95, p99;       // Response time percentiles
+    double meanResponse;
+    double maxResponse;
+    double utilization;         // Share of unit time spent away from base
+    double makespan;            // First report to last unit back home
+    double wallSeconds;
+};
+
+class Simulator {
+private:
+    enum EventType { INCIDENT_REPORTED, UNIT_ON_SCENE, SERVICE_DONE, UNIT_HOME };
+
+    struct Event {
+        double time;
+        long long sequence;     // Keeps events at the same time in scheduling order
+        EventType type;
+        int unit;
+        int incident;
+
+        bool operator>(const Event& other) const {
+            if (time != other.time) {
+                return time > other.time;
+            }
+            return sequence > other.sequence;
+        }
+    };
+
+    vector<SimUnit> units;
+    vector<SimIncident> incidents;
+    priority_queue<Event, vector<Event>, greater<Event>> calendar;
+    long long scheduled;
+    double speed;
+
+    void schedule(double time, EventType type, int unit, int incident) {
+        calendar.push(Event{ time, scheduled++, type, unit, incident });
+    }
+
+    double travelTime(int x1, int y1, int x2, int y2) const {
+        return (abs(x1 - x2) + abs(y1 - y2)) / speed;
+    }
+
+    void dispatch(double now, int unit, int incident) {
+        SimUnit& u = units[unit];
+        const SimIncident& in = incidents[incident];
+        u.busySince = now;
+        schedule(now + travelTime(u.homeX, u.homeY, in.x, in.y), UNIT_ON_SCENE, unit, incident);
+    }
+
+public:
+    Simulator() : scheduled(0), speed(1.0) {}
+
+    void addUnit(int id, int x, int y) {
+        units.push_back(SimUnit{ id, x, y, 0, 0 });
+    }
+
+    void addIncident(int id, int x, int y, double reportTime, double serviceTime) {
+        incidents.push_back(SimIncident{ id, x, y, reportTime, max(serviceTime, 0.0), -1 });
+    }
+
+    // A burst of count incidents with exponentially distributed gaps and
+    // time on scene, spread uniformly over the box [0, extent) x [0, extent)
+    void addSurge(size_t count, double startTime, double meanGap, double meanService, int extent, unsigned seed) {
+        uint64_t state = seed * 0x9E3779B97F4A7C15ULL + 1;
+        // xorshift64*, uniform in (0, 1]
+        auto uniform = [&state]() {
+            state ^= state >> 12;
+            state ^= state << 25;
+            state ^= state >> 27;
+            return ((state * 0x2545F4914F6CDD1DULL) >> 11) * (1.0 / 9007199254740992.0) + (1.0 / 9007199254740992.0);
+        };
+        double time = startTime;
+        int nextId = incidents.empty() ? 0 : incidents.back().id + 1;
+        for (size_t i = 0; i < count; ++i) {
+            time += -meanGap * log(uniform());
+            int x = (int)(uniform() * extent);
+            int y = (int)(uniform() * extent);
+            addIncident(nextId++, min(x, extent - 1), min(y, extent - 1), time, -meanService * log(uniform()));
+        }
+    }
+
+    SimulationReport run(double unitSpeed) {
+        chrono::steady_clock::time_point started = chrono::steady_clock::now();
+        SimulationReport report = SimulationReport();
+        speed = unitSpeed > 0 ? unitSpeed : 1.0;
+        report.incidents = incidents.size();
+        report.units = units.size();
+
+        PointGrid<SimUnit> idle;
+        for (size_t u = 0; u < units.size(); ++u) {
+            units[u].busyTime = 0;
+            idle.insert(&units[u]);
+        }
+        for (size_t i = 0; i < incidents.size(); ++i) {
+            incidents[i].responseTime = -1;
+            schedule(incidents[i].reportTime, INCIDENT_REPORTED, -1, (int)i);
+        }
+
+        queue<int> waiting;
+        double firstTime = incidents.empty() ? 0 : calendar.top().time;
+        double now = firstTime;
+        while (!calendar.empty()) {
+            Event event = calendar.top();
+            calendar.pop();
+            now = event.time;
+            ++report.events;
+
+            switch (event.type) {
+            case INCIDENT_REPORTED: {
+                const SimIncident& in = incidents[event.incident];
+                SimUnit* unit = idle.nearest(in.x, in.y);
+                if (unit == nullptr) {
+                    waiting.push(event.incident);
+                    report.maxWaiting = max(report.maxWaiting, waiting.size());
+                }
+                else {
+                    idle.remove(unit);
+                    dispatch(now, (int)(unit - units.data()), event.incident);
+                }
+                break;
+            }
+            case UNIT_ON_SCENE: {
+                SimIncident& in = incidents[event.incident];
+                in.responseTime = now - in.reportTime;
+                schedule(now + in.serviceTime, SERVICE_DONE, event.unit, event.incident);
+                break;
+            }
+            case SERVICE_DONE: {
+                const SimIncident& in = incidents[event.incident];
+                const SimUnit& u = units[event.unit];
+                schedule(now + travelTime(in.x, in.y, u.homeX, u.homeY), UNIT_HOME, event.unit, -1);
+                break;
+            }
+            case UNIT_HOME: {
+                SimUnit& u = units[event.unit];
+                u.busyTime += now - u.busySince;
+                if (!waiting.empty()) {
+                    dispatch(now, event.unit, waiting.front());
+                    waiting.pop();
+                }
+                else {
+                    idle.insert(&u);
+                }
+                break;
+            }
+            }
+        }
+
+        vector<double> responses;
+        responses.reserve(incidents.size());
+        double total = 0;
+        for (size_t i = 0; i < incidents.size(); ++i) {
+            if (incidents[i].responseTime >= 0) {
+                responses.push_back(incidents[i].responseTime);
+                total += incidents[i].responseTime;
+            }
+        }
+        report.served = responses.size();
+        if (!responses.empty()) {
+            report.meanResponse = total / responses.size();
+            report.p50 = percentile(responses, 0.50);
+            report.p95 = percentile(responses, 0.95);
+            report.p99 = percentile(responses, 0.99);
+            report.maxResponse = percentile(responses, 1.0);
+        }
+        report.makespan = now - firstTime;
+        double busy = 0;
+        for (size_t u = 0; u < units.size(); ++u) {
+            busy += units[u].busyTime;
+        }
+        if (report.makespan > 0 && !units.empty()) {
+            report.utilization = busy / (report.makespan * units.size());
+        }
+        report.wallSeconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+        return report;
+    }
+
+    // Nearest-rank percentile: the smallest value with at least p of the
+    // values at or below it, rank ceil(p * n). Reorders values.
+    static double percentile(vector<double>& values, double p) {
+        // The slack keeps p * n from rounding just past a whole rank
+        double rank1 = ceil(p * values.size() - 1e-9);
+        size_t rank = rank1 < 1 ? 0 : min(values.size() - 1, (size_t)rank1 - 1);
+        nth_element(values.begin(), values.begin() + rank, values.end());
+        return values[rank];
+    }
+};
+
+// Bounded multi-producer/multi-consumer queue. Every cell carries a
+// sequence number that says whether it is ready to be written or read at a
+// given position, so producers and consumers only race on their own
+// position counter with a single compare-and-swap.
+template <typename T>
+class MpmcRing {
+private:
+    struct Cell {
+        atomic<size_t> sequence;
+        T value;
+    };
+
+    Cell* cells;
+    size_t mask;
+    alignas(64) atomic<size_t> enqueuePos;
+    alignas(64) atomic<size_t> dequeuePos;
+
+public:
+    // Capacity is rounded up to a power of two
+    explicit MpmcRing(size_t capacity) : enqueuePos(0), dequeuePos(0) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        cells = new Cell[size];
+        mask = size - 1;
+        for (size_t i = 0; i < size; ++i) {
+            cells[i].sequence.store(i, memory_order_relaxed);
+        }
+    }
+
+    ~MpmcRing() {
+        delete[] cells;
+    }
+
+    MpmcRing(const MpmcRing&) = delete;
+    MpmcRing& operator=(const MpmcRing&) = delete;
+
+    // False if the queue is full
+    bool tryPush(const T& value) {
+        size_t pos = enqueuePos.load(memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[pos & mask];
+            size_t sequence = cell.sequence.load(memory_order_acquire);
+            intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                    cell.value = value;
+                    cell.sequence.store(pos + 1, memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0) {
+                return false;
+            }
+            else {
+                pos = enqueuePos.load(memory_order_relaxed);
+            }
+        }
+    }
+
+    // False if the queue is empty
+    bool tryPop(T& value) {
+        size_t pos = dequeuePos.load(memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[pos & mask];
+            size_t sequence = cell.sequence.load(memory_order_acquire);
+            intptr_t diff = (intptr_t)sequence - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (dequeuePos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                    value = cell.value;
+                    cell.sequence.store(pos + mask + 1, memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0) {
+                return false;
+            }
+            else {
+                pos = dequeuePos.load(memory_order_relaxed);
+            }
+        }
+    }
+
+    // Approximate number of queued items
+    size_t depth() const {
+        size_t tail = enqueuePos.load(memory_order_relaxed);
+        size_t head = dequeuePos.load(memory_order_relaxed);
+        return tail > head ? tail - head : 0;
+    }
+};
+
+// An incident as handed over by a call-taker
+struct IntakeRequest {
+    int id, x, y;
+    int reportTime, responseTime;
+    int stationId;   // Reporting station, -1 if none
+    int severity;
+};
+
+// Counters of the intake pipeline since it was started
+struct IntakeMetrics {
+    uint64_t submitted;     // Accepted into the queue
+    uint64_t processed;     // Taken off the queue and handled
+    uint64_t assigned;      // Got a dispatcher
+    uint64_t unassigned;    // Added, but every dispatcher was already claimed
+    uint64_t rejected;      // Duplicate incident ID
+    uint64_t fullWaits;     // Times a producer found the queue full
+    size_t depth;           // Requests waiting right now
+    size_t maxDepth;        // Deepest the queue has been
+    double seconds;         // Time since start
+    double throughput;      // Processed requests per second
+};
+
+// Two-dimensional tree over the dispatchers free when intake starts. Every
+// node counts the units below it that no worker has claimed; a claim
+// decrements the counts up its leaf's path, so nearest searches skip whole
+// regions that are used up instead of scanning past them. Claims and
+// searches may run on any number of threads; the tree itself never changes.
+class ClaimTree {
+private:
+    static const int LEAF_SIZE = 8;
+
+    struct Node {
+        int minX, maxX, minY, maxY;
+        int begin, end;             // Range of units below the node
+        int left, right, parent;    // -1 when absent
+    };
+
+    vector<Node> nodes;
+    vector<atomic<int>> freeBelow;      // Unclaimed units per node
+    vector<DispatcherNode*> units;      // Ordered so each node covers a range
+    vector<int> unitSlot;               // Claim slot per position in units
+    vector<atomic<uint8_t>> claimed;    // Per slot, set once a worker takes the unit
+    vector<int> leafOfSlot;
+
+    int build(vector<pair<DispatcherNode*, int>>& items, int begin, int end, int parent) {
+        int index = (int)nodes.size();
+        Node node{ INT_MAX, INT_MIN, INT_MAX, INT_MIN, begin, end, -1, -1, parent };
+        for (int i = begin; i < end; ++i) {
+            const Dispatcher& d = items[i].first->dispatcher;
+            node.minX = min(node.minX, d.x);
+            node.maxX = max(node.maxX, d.x);
+            node.minY = min(node.minY, d.y);
+            node.maxY = max(node.maxY, d.y);
+        }
+        nodes.push_back(node);
+        if (end - begin <= LEAF_SIZE) {
+            for (int i = begin; i < end; ++i) {
+                leafOfSlot[items[i].second] = index;
+            }
+            return index;
+        }
+
+        // Split the wider side at the median
+        bool byX = (long long)node.maxX - node.minX >= (long long)node.maxY - node.minY;
+        int middle = begin + (end - begin) / 2;
+        nth_element(items.begin() + begin, items.begin() + middle, items.begin() + end,
+            [byX](const pair<DispatcherNode*, int>& a, const pair<DispatcherNode*, int>& b) {
+                return byX ? a.first->dispatcher.x < b.first->dispatcher.x : a.first->dispatcher.y < b.first->dispatcher.y;
+            });
+        int left = build(items, begin, middle, index);
+        int right = build(items, middle, end, index);
+        nodes[index].left = left;
+        nodes[index].right = right;
+        return index;
+    }
+
+    int boxDistance(int n, int x, int y) const {
+        const Node& node = nodes[n];
+        int dx = x < node.minX ? node.minX - x : (x > node.maxX ? x - node.maxX : 0);
+        int dy = y < node.minY ? node.minY - y : (y > node.maxY ? y - node.maxY : 0);
+        return dx + dy;
+    }
+
+    void search(int n, int x, int y, size_t k, priority_queue<DispatcherCandidate>& best) const {
+        if (freeBelow[n].load(memory_order_relaxed) == 0) {
+            return;
+        }
+        // Equal distances still have to be visited for the lower-ID tie break
+        if (best.size() == k && boxDistance(n, x, y) > best.top().distance) {
+            return;
+        }
+        const Node& node = nodes[n];
+        if (node.left == -1) {
+            for (int i = node.begin; i < node.end; ++i) {
+                if (claimed[unitSlot[i]].load(memory_order_relaxed) != 0) {
+                    continue;
+                }
+                const Dispatcher& d = units[i]->dispatcher;
+                DispatcherCandidate candidate{ abs(x - d.x) + abs(y - d.y), units[i] };
+                if (best.size() < k) {
+                    best.push(candidate);
+                }
+                else if (candidate < best.top()) {
+                    best.pop();
+                    best.push(candidate);
+                }
+            }
+            return;
+        }
+        int first = node.left, second = node.right;
+        if (boxDistance(second, x, y) < boxDistance(first, x, y)) {
+            swap(first, second);
+        }
+        search(first, x, y, k, best);
+        search(second, x, y, k, best);
+    }
+
+    void addToPath(int slot, int delta) {
+        for (int n = leafOfSlot[slot]; n != -1; n = nodes[n].parent) {
+            freeBelow[n].fetch_add(delta, memory_order_relaxed);
+        }
+    }
+
+public:
+    // Unit i gets claim slot i
+    explicit ClaimTree(const vector<DispatcherNode*>& freeUnits)
+        : claimed(freeUnits.size()), leafOfSlot(freeUnits.size(), -1) {
+        vector<pair<DispatcherNode*, int>> items(freeUnits.size());
+        for (size_t i = 0; i < freeUnits.size(); ++i) {
+            items[i] = make_pair(freeUnits[i], (int)i);
+            claimed[i].store(0, memory_order_relaxed);
+        }
+        if (!items.empty()) {
+            nodes.reserve(4 * items.size() / LEAF_SIZE + 1);
+            build(items, 0, (int)items.size(), -1);
+        }
+        units.resize(items.size());
+        unitSlot.resize(items.size());
+        for (size_t i = 0; i < items.size(); ++i) {
+            units[i] = items[i].first;
+            unitSlot[i] = items[i].second;
+        }
+        freeBelow = vector<atomic<int>>(nodes.size());
+        for (size_t n = 0; n < nodes.size(); ++n) {
+            freeBelow[n].store(nodes[n].end - nodes[n].begin, memory_order_relaxed);
+        }
+    }
+
+    // Marks a slot as taken; false if another thread got it first
+    bool tryClaim(int slot) {
+        uint8_t expected = 0;
+        if (!claimed[slot].compare_exchange_strong(expected, 1, memory_order_acq_rel)) {
+            return false;
+        }
+        addToPath(slot, -1);
+        return true;
+    }
+
+    void release(int slot) {
+        addToPath(slot, 1);
+        claimed[slot].store(0, memory_order_release);
+    }
+
+    // Up to k unclaimed units closest to (x, y), nearest first, ties to the
+    // lower ID. Units claimed meanwhile may still show up.
+    vector<DispatcherCandidate> kNearest(int x, int y, size_t k) const {
+        priority_queue<DispatcherCandidate> best;
+        if (!nodes.empty() && k > 0) {
+            search(0, x, y, k, best);
+        }
+        vector<DispatcherCandidate> ranked(best.size());
+        for (size_t i = ranked.size(); i > 0; --i) {
+            ranked[i - 1] = best.top();
+            best.pop();
+        }
+        return ranked;
+    }
+};
+
+// Shared state of a running intake pipeline
+struct IntakeState {
+    MpmcRing<IntakeRequest> queue;
+    vector<thread> workers;
+    ClaimTree claims;                  // Dispatchers free at the start, by claim slot
+    OpenHashMap<int> claimSlot;        // Dispatcher ID -> claim slot
+    mutex commitLock;                  // Serializes changes to the manager's lists and journal
+    vector<int> dispatched;            // Units sent out by workers, still in the search structures
+    atomic<bool> stopping;
+    atomic<uint64_t> submitted, processed, assigned, unassigned, rejected, fullWaits;
+    atomic<size_t> maxDepth;
+    atomic<size_t> unclaimed;          // Dispatchers still free to claim
+    chrono::steady_clock::time_point started;
+
+    IntakeState(size_t capacity, const vector<DispatcherNode*>& freeUnits)
+        : queue(capacity), claims(freeUnits), stopping(false), submitted(0), processed(0),
+          assigned(0), unassigned(0), rejected(0), fullWaits(0), maxDepth(0), unclaimed(freeUnits.size()), started(chrono::steady_clock::now()) {}
+};
+
+// Field readers for text records and batch command lines
+bool nextInt(const char*& p, const char* end, int& value) {
+    while (p < end && (*p == ' ' || *p == '\t')) {
+        ++p;
+    }
+    from_chars_result result = from_chars(p, end, value);
+    if (result.ec != errc()) {
+        return false;
+    }
+    p = result.ptr;
+    return true;
+}
+
+string restOfLine(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t')) {
+        ++p;
+    }
+    return string(p, end);
+}
+
+// Reads "kinds [x0 y0 x1 y1]" where kinds is * or any of s (stations),
+// i (incidents), d (dispatchers) and a (archived incidents)
+bool nextOutputFilter(const char*& p, const char* end, OutputFilter& filter) {
+    static const char LETTERS[] = "sida*";
+    static const int KINDS[] = { OUTPUT_STATIONS, OUTPUT_INCIDENTS, OUTPUT_DISPATCHERS, OUTPUT_ARCHIVED, OUTPUT_ALL };
+    while (p < end && (*p == ' ' || *p == '\t')) {
+        ++p;
+    }
+    filter = OUTPUT_EVERYTHING;
+    filter.kinds = 0;
+    for (; p < end && *p != ' ' && *p != '\t'; ++p) {
+        const char* kind = *p != '\0' ? strchr(LETTERS, *p) : nullptr;
+        if (kind == nullptr) {
+            return false;
+        }
+        filter.kinds |= KINDS[kind - LETTERS];
+    }
+    if (filter.kinds == 0) {
+        return false;
+    }
+    const char* box = p;
+    if (!nextInt(p, end, filter.minX)) {
+        p = box;
+        return true;
+    }
+    return nextInt(p, end, filter.minY) && nextInt(p, end, filter.maxX) && nextInt(p, end, filter.maxY);
+}
+
+// Text state files (see saveToFile) parsed in parallel. The file is split
+// into chunks at line boundaries; the section each chunk starts in is known
+// from a prior search for the section headers, so chunks are independent.
+enum TextSection { SECTION_NONE, SECTION_STATIONS, SECTION_INCIDENTS, SECTION_DISPATCHERS, SECTION_ARCHIVED, SECTION_UNITS };
+
+struct ParsedStation {
+    int id, x, y;
+    const char* name;       // Points into the file buffer
+    size_t nameLength;
+};
+
+struct ParseError {
+    long long line;
+    string message;
+};
+
+struct ParsedChunk {
+    const char* begin;
+    const char* end;
+    TextSection section;    // Section in effect at begin
+    long long lines;        // Lines in the chunk
+    vector<ParsedStation> stations;
+    vector<Incident> incidents;
+    vector<Dispatcher> dispatchers;
+    vector<Incident> archived;
+    vector<pair<int, int>> unitTimings;     // (speed, on-scene time) lines; the last one in the file applies
+    vector<ParseError> errors;  // Line numbers are relative to the chunk until parsing is done
+};
+
+// Section a header line opens, or SECTION_NONE for a record line
+inline TextSection sectionOfLine(const char* p, const char* end) {
+    size_t length = end - p;
+    if (length == 9 && memcmp(p, "Stations:", 9) == 0) {
+        return SECTION_STATIONS;
+    }
+    if (length == 10 && memcmp(p, "Incidents:", 10) == 0) {
+        return SECTION_INCIDENTS;
+    }
+    if (length == 12 && memcmp(p, "Dispatchers:", 12) == 0) {
+        return SECTION_DISPATCHERS;
+    }
+    if (length == 9 && memcmp(p, "Archived:", 9) == 0) {
+        return SECTION_ARCHIVED;
+    }
+    if (length == 6 && memcmp(p, "Units:", 6) == 0) {
+        return SECTION_UNITS;
+    }
+    return SECTION_NONE;
+}
+
+inline bool onlySpaces(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t')) {
+        ++p;
+    }
+    return p == end;
+}
+
+// Reads "from to [period [cell]]" for the hotspot commands
+bool nextHotspotOptions(const char*& p, const char* end, HotspotOptions& options) {
+    options = HotspotOptions{ 0, 0, 0, 0, 0 };
+    if (!nextInt(p, end, options.fromTime) || !nextInt(p, end, options.toTime)) {
+        return false;
+    }
+    if (!onlySpaces(p, end) && !nextInt(p, end, options.period)) {
+        return false;
+    }
+    return onlySpaces(p, end) || nextInt(p, end, options.cellSize);
+}
+
+inline void parseChunk(ParsedChunk& chunk) {
+    TextSection section = chunk.section;
+    const char* p = chunk.begin;
+    long long line = 0;
+    while (p < chunk.end) {
+        const char* newline = (const char*)memchr(p, '\n', chunk.end - p);
+        const char* lineEnd = newline != nullptr ? newline : chunk.end;
+        const char* next = newline != nullptr ? newline + 1 : chunk.end;
+        if (lineEnd > p && lineEnd[-1] == '\r') {
+            --lineEnd;
+        }
+        ++line;
+        if (onlySpaces(p, lineEnd)) {
+            p = next;
+            continue;
+        }
+
+        TextSection header = sectionOfLine(p, lineEnd);
+        if (header != SECTION_NONE) {
+            section = header;
+            p = next;
+            continue;
+        }
+
+        const char* field = p;
+        bool ok = true;
+        if (section == SECTION_STATIONS) {
+            ParsedStation station;
+            ok = nextInt(field, lineEnd, station.id) && nextInt(field, lineEnd, station.x) && nextInt(field, lineEnd, station.y);
+            if (ok) {
+                if (field < lineEnd) {
+                    ++field;    // The single separator before the name
+                }
+                station.name = field;
+                station.nameLength = lineEnd - field;
+                chunk.stations.push_back(station);
+            }
+            else {
+                chunk.errors.push_back(ParseError{ line, "malformed station record" });
+            }
+        }
+        else if (section == SECTION_INCIDENTS || section == SECTION_ARCHIVED) {
+            Incident incident;
+            incident.assignedDispatcherId = -1;   // Absent in files written before assignments were saved
+            incident.severity = SEVERITY_DEFAULT; // Absent in files written before severities were saved
+            ok = nextInt(field, lineEnd, incident.id) && nextInt(field, lineEnd, incident.x) && nextInt(field, lineEnd, incident.y)
+                && nextInt(field, lineEnd, incident.reportTime) && nextInt(field, lineEnd, incident.responseTime)
+                && nextInt(field, lineEnd, incident.reportedFromStationId);
+            if (ok && !onlySpaces(field, lineEnd)) {
+                ok = nextInt(field, lineEnd, incident.assignedDispatcherId);
+            }
+            if (ok && !onlySpaces(field, lineEnd)) {
+                ok = nextInt(field, lineEnd, incident.severity) && incident.severity >= SEVERITY_MINOR && incident.severity <= SEVERITY_CRITICAL;
+            }
+            ok = ok && onlySpaces(field, lineEnd);
+            if (ok) {
+                (section == SECTION_INCIDENTS ? chunk.incidents : chunk.archived).push_back(incident);
+            }
+            else {
+                chunk.errors.push_back(ParseError{ line, "malformed incident record" });
+            }
+        }
+        else if (section == SECTION_DISPATCHERS) {
+            Dispatcher dispatcher = Dispatcher();
+            ok = nextInt(field, lineEnd, dispatcher.id) && nextInt(field, lineEnd, dispatcher.x) && nextInt(field, lineEnd, dispatcher.y);
+            // Busy units carry their state after the position
+            if (ok && !onlySpaces(field, lineEnd)) {
+                int state = DISPATCHER_AVAILABLE;
+                ok = nextInt(field, lineEnd, state) && state > DISPATCHER_AVAILABLE && state <= DISPATCHER_RETURNING
+                    && nextInt(field, lineEnd, dispatcher.incidentId) && nextInt(field, lineEnd, dispatcher.baseX) && nextInt(field, lineEnd, dispatcher.baseY)
+                    && nextInt(field, lineEnd, dispatcher.targetX) && nextInt(field, lineEnd, dispatcher.targetY) && nextInt(field, lineEnd, dispatcher.remaining)
+                    && onlySpaces(field, lineEnd);
+                dispatcher.state = (DispatcherState)state;
+            }
+            if (ok) {
+                chunk.dispatchers.push_back(dispatcher);
+            }
+            else {
+                chunk.errors.push_back(ParseError{ line, "malformed dispatcher record" });
+            }
+        }
+        else if (section == SECTION_UNITS) {
+            int speed, sceneTime;
+            ok = nextInt(field, lineEnd, speed) && nextInt(field, lineEnd, sceneTime) && onlySpaces(field, lineEnd) && speed > 0 && sceneTime >= 0;
+            if (ok) {
+                chunk.unitTimings.push_back(make_pair(speed, sceneTime));
+            }
+            else {
+                chunk.errors.push_back(ParseError{ line, "malformed unit timing" });
+            }
+        }
+        else {
+            chunk.errors.push_back(ParseError{ line, "record before any section header" });
+        }
+        p = next;
+    }
+    chunk.lines = line;
+}
+
+// First occurrence of a string in [p, end), or nullptr
+inline const char* findText(const char* p, const char* end, const char* text, size_t length) {
+    while ((size_t)(end - p) >= length) {
+        const char* first = (const char*)memchr(p, text[0], end - p - length + 1);
+        if (first == nullptr) {
+            return nullptr;
+        }
+        if (memcmp(first, text, length) == 0) {
+            return first;
+        }
+        p = first + 1;
+    }
+    return nullptr;
+}
+
+// Parses a whole text state file into per-chunk record lists, in file order,
+// using up to one thread per core. Error line numbers are absolute.
+inline vector<ParsedChunk> parseTextState(const char* data, size_t size) {
+    vector<ParsedChunk> chunks;
+    if (size == 0) {
+        return chunks;
+    }
+    const char* end = data + size;
+
+    // Header lines, found by text search rather than walking every line; a match
+    // only counts when it fills a whole line
+    vector<pair<size_t, TextSection>> headers;
+    static const char* const NAMES[] = { "Stations:", "Incidents:", "Dispatchers:", "Archived:", "Units:" };
+    static const TextSection SECTIONS[] = { SECTION_STATIONS, SECTION_INCIDENTS, SECTION_DISPATCHERS, SECTION_ARCHIVED, SECTION_UNITS };
+    for (int h = 0; h < 5; ++h) {
+        size_t length = strlen(NAMES[h]);
+        const char* p = data;
+        while (p < end) {
+            const char* match = findText(p, end, NAMES[h], length);
+            if (match == nullptr) {
+                break;
+            }
+            const char* after = match + length;
+            if (after < end && *after == '\r') {
+                ++after;
+            }
+            if ((match == data || match[-1] == '\n') && (after == end || *after == '\n')) {
+                headers.push_back(make_pair((size_t)(match - data), SECTIONS[h]));
+            }
+            p = match + 1;
+        }
+    }
+    sort(headers.begin(), headers.end());
+
+    unsigned threads = max(1u, thread::hardware_concurrency());
+    size_t target = max((size_t)1 << 20, size / (threads * 4) + 1);
+    const char* p = data;
+    size_t header = 0;
+    TextSection section = SECTION_NONE;
+    while (p < end) {
+        const char* stop = p + min(target, (size_t)(end - p));
+        if (stop < end) {
+            const char* newline = (const char*)memchr(stop, '\n', end - stop);
+            stop = newline != nullptr ? newline + 1 : end;
+        }
+        while (header < headers.size() && data + headers[header].first < p) {
+            section = headers[header++].second;
+        }
+        ParsedChunk chunk = ParsedChunk();
+        chunk.begin = p;
+        chunk.end = stop;
+        chunk.section = section;
+        chunks.push_back(chunk);
+        p = stop;
+    }
+
+    atomic<size_t> nextChunk(0);
+    auto work = [&chunks, &nextChunk]() {
+        for (size_t c = nextChunk.fetch_add(1); c < chunks.size(); c = nextChunk.fetch_add(1)) {
+            parseChunk(chunks[c]);
+        }
+    };
+    vector<thread> workers;
+    for (unsigned t = 1; t < min((size_t)threads, chunks.size()); ++t) {
+        workers.push_back(thread(work));
+    }
+    work();
+    for (size_t t = 0; t < workers.size(); ++t) {
+        workers[t].join();
+    }
+
+    long long firstLine = 0;
+    for (size_t c = 0; c < chunks.size(); ++c) {
+        for (size_t e = 0; e < chunks[c].errors.size(); ++e) {
+            chunks[c].errors[e].line += firstLine;
+        }
+        firstLine += chunks[c].lines;
+    }
+    return chunks;
+}
+
+// Operations timed by OperationMetrics
+enum MetricOperation {
+    OP_ADD_STATION,
+    OP_ADD_INCIDENT,
+    OP_ADD_DISPATCHER,
+    OP_ASSIGN_DISPATCHER,
+    OP_REPORT_INCIDENT,
+    OP_DISTANCE_TO_STATION,
+    OP_SAVE_TO_FILE,
+    OP_LOAD_FROM_FILE,
+    OP_DISPATCH_NEXT,
+    OP_COUNT
+};
+
+const char* const METRIC_OPERATION_NAMES[OP_COUNT] = {
+    "add_station", "add_incident", "add_dispatcher", "assign_dispatcher",
+    "report_incident", "distance_to_station", "save_to_file", "load_from_file",
+    "dispatch_next"
+};
+
+// Log-linear latency histogram in nanoseconds: values below 16 get a bucket
+// each, larger ones fall into 16 buckets per power of two, which keeps the
+// relative error under 1/16. Recording is two relaxed atomic adds, so
+// several threads may record at once; the total is summed when read.
+class LatencyHistogram {
+public:
+    static const int SUB_BUCKETS = 16;
+    static const int BUCKETS = 61 * SUB_BUCKETS;
+
+private:
+    atomic<uint64_t> counts[BUCKETS];
+    atomic<uint64_t> sum;
+    atomic<uint64_t> maximum;
+
+public:
+    LatencyHistogram() {
+        reset();
+    }
+
+    static int bucketOf(uint64_t ns) {
+        if (ns < (uint64_t)SUB_BUCKETS) {
+            return (int)ns;
+        }
+        int exponent = 63 - __builtin_clzll(ns);
+        return (exponent - 3) * SUB_BUCKETS + (int)((ns >> (exponent - 4)) & (SUB_BUCKETS - 1));
+    }
+
+    // Largest value that lands in a bucket
+    static uint64_t bucketUpper(int bucket) {
+        if (bucket < SUB_BUCKETS) {
+            return (uint64_t)bucket;
+        }
+        int exponent = bucket / SUB_BUCKETS + 3;
+        uint64_t width = (uint64_t)1 << (exponent - 4);
+        return ((uint64_t)(SUB_BUCKETS + bucket % SUB_BUCKETS) << (exponent - 4)) + width - 1;
+    }
+
+    void record(uint64_t ns) {
+        counts[bucketOf(ns)].fetch_add(1, memory_order_relaxed);
+        sum.fetch_add(ns, memory_order_relaxed);
+        uint64_t seen = maximum.load(memory_order_relaxed);
+        while (ns > seen && !maximum.compare_exchange_weak(seen, ns, memory_order_relaxed)) {
+        }
+    }
+
+    void reset() {
+        for (int i = 0; i < BUCKETS; ++i) {
+            counts[i].store(0, memory_order_relaxed);
+        }
+        sum.store(0, memory_order_relaxed);
+        maximum.store(0, memory_order_relaxed);
+    }
+
+    uint64_t count() const {
+        uint64_t n = 0;
+        for (int i = 0; i < BUCKETS; ++i) {
+            n += counts[i].load(memory_order_relaxed);
+        }
+        return n;
+    }
+
+    uint64_t sumNs() const {
+        return sum.load(memory_order_relaxed);
+    }
+
+    uint64_t maxNs() const {
+        return maximum.load(memory_order_relaxed);
+    }
+
+    uint64_t bucketCount(int bucket) const {
+        return counts[bucket].load(memory_order_relaxed);
+    }
+
+    // Upper edge of the bucket holding the p-th fraction of samples
+    uint64_t percentile(double p) const {
+        uint64_t n = count();
+        if (n == 0) {
+            return 0;
+        }
+        uint64_t rank = (uint64_t)ceil(p * n);
+        rank = max(rank, (uint64_t)1);
+        uint64_t seen = 0;
+        for (int i = 0; i < BUCKETS; ++i) {
+            seen += bucketCount(i);
+            if (seen >= rank) {
+                return min(bucketUpper(i), maxNs());
+            }
+        }
+        return maxNs();
+    }
+};
+
+// One latency histogram per instrumented EmergencyManager operation
+class OperationMetrics {
+private:
+    LatencyHistogram histograms[OP_COUNT];
+
+public:
+    LatencyHistogram& operator[](MetricOperation op) {
+        return histograms[op];
+    }
+
+    const LatencyHistogram& operator[](MetricOperation op) const {
+        return histograms[op];
+    }
+
+    void reset() {
+        for (int op = 0; op < OP_COUNT; ++op) {
+            histograms[op].reset();
+        }
+    }
+};
+
+// Records the lifetime of a scope into a histogram
+class ScopedTimer {
+private:
+    LatencyHistogram& histogram;
+    chrono::steady_clock::time_point started;
+
+public:
+    explicit ScopedTimer(LatencyHistogram& histogram) : histogram(histogram), started(chrono::steady_clock::now()) {}
+
+    ~ScopedTimer() {
+        histogram.record((uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - started).count());
+    }
+};
+
+// Build with -DRESCUENET_NO_METRICS to compile the timers out entirely
+#ifdef RESCUENET_NO_METRICS
+#define RESCUENET_TIMED(op)
+#else
+#define RESCUENET_TIMED(op) ScopedTimer scopedTimer(metrics[op])
+#endif
+
+class EmergencyManager {
+private:
+    StationNode* stations;         // Head of stations linked list
+    IncidentNode* incidents;       // Head of incidents linked list
+    DispatcherNode* dispatchers;   // Head of dispatchers linked list
+    NodePool<StationNode> stationPool;         // Storage for the list nodes
+    NodePool<IncidentNode> incidentPool;
+    NodePool<DispatcherNode> dispatcherPool;
+
+    OpenHashMap<StationNode*> stationIndex;        // Station ID -> node
+    OpenHashMap<IncidentNode*> incidentIndex;      // Incident ID -> node
+    OpenHashMap<DispatcherNode*> dispatcherIndex;  // Dispatcher ID -> node
+    TimeIndex incidentTimes;                       // Incidents ordered by report time
+    TriageQueue triage;                            // Unassigned incidents, most urgent first
+    IncidentArchive archive;                       // Resolved incidents, compressed
+    StationCoverage stationCoverage;               // Closest station for any point
+    DispatcherGrid dispatcherGrid;                 // Spatial index over dispatchers
+    CoordinateStore dispatcherCoords;              // Available dispatchers for brute-force scans
+    vector<DispatcherNode*> busyUnits;             // Dispatchers that are not available
+    int unitSpeed;                                 // Grid steps a unit covers per time unit
+    int onSceneTime;                               // Time a unit spends at an incident
+    RoadNetwork roads;                             // Optional road graph for routing
+
+    Journal journal;                               // Operation log since the last snapshot
+    string journalFile;
+    string snapshotFile;                           // Snapshot the journal applies on top of
+    size_t compactEvery;                           // Journal records between automatic compactions
+    bool replaying;                                // Recovery in progress, nothing is journalled
+    IntakeState* intake;                           // Concurrent intake, nullptr when not running
+    OperationMetrics metrics;                      // Latency per public operation
+    RecordWriter listing;                          // Reused by printLocations
+
+    int calculateShortestDistance(int x1, int y1, int x2, int y2) {
+        return abs(x1 - x2) + abs(y1 - y2);
+    }
+
+    // Road distance when a network is loaded, Manhattan distance otherwise;
+    // -1 if the roads do not connect the two points
+    int travelDistance(int x1, int y1, int x2, int y2) {
+        if (roads.isLoaded()) {
+            return roads.distance(x1, y1, x2, y2);
+        }
+        return calculateShortestDistance(x1, y1, x2, y2);
+    }
+
+    // Ranks dispatchers by road distance. Candidates arrive from the grid in
+    // Manhattan order, and no route beats the straight line scaled by the
+    // network's manhattanScale, so the scan stops as soon as no later
+    // candidate can beat the k-th best route. A network with a road of no
+    // length between distinct points has no such bound; there every unit
+    // gets a landmark bound and units are routed in that order instead.
+    vector<pair<int, int>> kNearestByRoad(int x, int y, size_t k) {
+        return kNearestByRoad(x, y, k, [this, x, y](size_t fetch) { return dispatcherGrid.kNearest(x, y, fetch); });
+    }
+
+    // The same over the candidates a search returns for a given count, in
+    // Manhattan order
+    template <typename Search>
+    vector<pair<int, int>> kNearestByRoad(int x, int y, size_t k, Search nearestUnits) {
+        priority_queue<pair<int, int>> best;   // Max-heap of (road distance, dispatcher ID)
+        if (k == 0) {
+            return vector<pair<int, int>>();
+        }
+        auto route = [&](const Dispatcher& d) {
+            int distance = roads.distance(x, y, d.x, d.y);
+            if (distance < 0) {
+                return;
+            }
+            pair<int, int> entry = make_pair(distance, d.id);
+            if (best.size() < k) {
+                best.push(entry);
+            }
+            else if (entry < best.top()) {
+                best.pop();
+                best.push(entry);
+            }
+        };
+
+        int scale = roads.manhattanScale();
+        if (scale == 0) {
+            vector<DispatcherCandidate> candidates = nearestUnits(SIZE_MAX);
+            vector<pair<int, const Dispatcher*>> bounded;
+            for (size_t i = 0; i < candidates.size(); ++i) {
+                const Dispatcher& d = candidates[i].node->dispatcher;
+                bounded.push_back(make_pair(roads.lowerBoundDistance(x, y, d.x, d.y), &d));
+            }
+            sort(bounded.begin(), bounded.end(), [](const pair<int, const Dispatcher*>& a, const pair<int, const Dispatcher*>& b) {
+                return a.first != b.first ? a.first < b.first : a.second->id < b.second->id;
+            });
+            for (size_t i = 0; i < bounded.size(); ++i) {
+                // Equal bounds are still routed for the lower-ID tie break
+                if (best.size() == k && best.top().first < bounded[i].first) {
+                    break;
+                }
+                route(*bounded[i].second);
+            }
+        }
+        else {
+            size_t fetch = max(k, (size_t)8);
+            size_t evaluated = 0;
+            bool done = false;
+            while (!done) {
+                vector<DispatcherCandidate> candidates = nearestUnits(fetch);
+                for (size_t i = evaluated; i < candidates.size(); ++i) {
+                    if (best.size() == k && (long long)best.top().first * RoadNetwork::SCALE_ONE < (long long)candidates[i].distance * scale) {
+                        done = true;
+                        break;
+                    }
+                    route(candidates[i].node->dispatcher);
+                }
+                evaluated = candidates.size();
+                if (candidates.size() < fetch) {
+                    done = true;
+                }
+                fetch *= 2;
+            }
+        }
+
+        vector<pair<int, int>> ranked(best.size());
+        for (size_t i = ranked.size(); i > 0; --i) {
+            ranked[i - 1] = make_pair(best.top().second, best.top().first);
+            best.pop();
+        }
+        return ranked;
+    }
+
+    StationNode* findStation(int id) {
+        StationNode** node = stationIndex.find(id);
+        return node != nullptr ? *node : nullptr;
+    }
+
+    IncidentNode* findIncident(int id) {
+        IncidentNode** node = incidentIndex.find(id);
+        return node != nullptr ? *node : nullptr;
+    }
+
+    DispatcherNode* findDispatcher(int id) {
+        DispatcherNode** node = dispatcherIndex.find(id);
+        return node != nullptr ? *node : nullptr;
+    }
+
+    // Logs a successful operation and compacts once the journal grows long
+    void journalRecord(const string& record) {
+        if (!journal.isOpen() || replaying) {
+            return;
+        }
+        journal.append(record);
+        if (journal.sinceCompaction() >= compactEvery) {
+            compactJournal();
+        }
+    }
+
+    // Applies one journal line; returns false if it is malformed
+    bool replayRecord(const string& line) {
+        istringstream iss(line);
+        char op;
+        if (!(iss >> op)) {
+            return false;
+        }
+        if (op == 'S') {
+            int id, x, y;
+            string name;
+            if (!(iss >> id >> x >> y)) {
+                return false;
+            }
+            getline(iss, name);
+            if (findStation(id) == nullptr) {
+                addStation(id, x, y, name.empty() ? name : name.substr(1));
+            }
+        }
+        else if (op == 'I') {
+            int id, x, y, reportTime, responseTime, severity = SEVERITY_DEFAULT;
+            if (!(iss >> id >> x >> y >> reportTime >> responseTime)) {
+                return false;
+            }
+            iss >> severity;
+            if (findIncident(id) == nullptr) {
+                addIncident(id, x, y, reportTime, responseTime, severity);
+            }
+        }
+        else if (op == 'D') {
+            int id, x, y;
+            if (!(iss >> id >> x >> y)) {
+                return false;
+            }
+            if (findDispatcher(id) == nullptr) {
+                addDispatcher(id, x, y);
+            }
+        }
+        else if (op == 'R' || op == 'A') {
+            int incidentId, otherId;
+            if (!(iss >> incidentId >> otherId)) {
+                return false;
+            }
+            IncidentNode* incidentNode = findIncident(incidentId);
+            if (incidentNode == nullptr) {
+                return false;
+            }
+            if (op == 'R') {
+                incidentNode->incident.reportedFromStationId = otherId;
+            }
+            else {
+                DispatcherNode* unit = findDispatcher(otherId);
+                if (unit != nullptr && unit->dispatcher.state == DISPATCHER_AVAILABLE) {
+                    dispatchUnit(unit, incidentNode);
+                }
+                else {
+                    incidentNode->incident.assignedDispatcherId = otherId;
+                    triage.remove(incidentNode);
+                }
+            }
+        }
+        else if (op == 'E') {
+            int incidentId, severity;
+            if (!(iss >> incidentId >> severity)) {
+                return false;
+            }
+            setSeverity(incidentId, severity);
+        }
+        else if (op == 'a') {
+            int closedBefore;
+            if (!(iss >> closedBefore)) {
+                return false;
+            }
+            archiveResolved(closedBefore);
+        }
+        else if (op == 'V') {
+            int time;
+            if (!(iss >> time)) {
+                return false;
+            }
+            advanceTime(time);
+        }
+        else if (op == 'u') {
+            int speed, sceneTime;
+            if (!(iss >> speed >> sceneTime)) {
+                return false;
+            }
+            setUnitTiming(speed, sceneTime);
+        }
+        else {
+            return false;
+        }
+        return true;
+    }
+
+    // Marks a dispatcher slot as taken by this worker; false if another got it first
+    bool tryClaimSlot(int slot) {
+        if (!intake->claims.tryClaim(slot)) {
+            return false;
+        }
+        intake->unclaimed.fetch_sub(1, memory_order_relaxed);
+        return true;
+    }
+
+    bool tryClaim(int dispatcherId) {
+        int* slot = intake->claimSlot.find(dispatcherId);
+        return slot != nullptr && tryClaimSlot(*slot);
+    }
+
+    void releaseClaim(int dispatcherId) {
+        intake->claims.release(*intake->claimSlot.find(dispatcherId));
+        intake->unclaimed.fetch_add(1, memory_order_relaxed);
+    }
+
+    // Claims the closest dispatcher no other worker holds and returns its ID,
+    // or -1 if all are taken. The claim tree only offers unclaimed units and
+    // passes over used-up regions, so a search stays local however many are
+    // gone; losing a race for the unit it found means searching again. Tree
+    // searches only read, so workers run them side by side; road routing
+    // reuses shared scratch space and is done under the lock.
+    int claimNearest(int x, int y) {
+        while (intake->unclaimed.load(memory_order_relaxed) > 0) {
+            int dispatcherId;
+            if (roads.isLoaded()) {
+                lock_guard<mutex> guard(intake->commitLock);
+                vector<pair<int, int>> ranked = kNearestByRoad(x, y, 1,
+                    [this, x, y](size_t fetch) { return intake->claims.kNearest(x, y, fetch); });
+                if (ranked.empty()) {
+                    return -1;
+                }
+                dispatcherId = ranked[0].first;
+            }
+            else {
+                vector<DispatcherCandidate> candidates = intake->claims.kNearest(x, y, 1);
+                if (candidates.empty()) {
+                    return -1;
+                }
+                dispatcherId = candidates[0].node->dispatcher.id;
+            }
+            if (tryClaim(dispatcherId)) {
+                return dispatcherId;
+            }
+        }
+        return -1;
+    }
+
+    void processIntake(const IntakeRequest& request) {
+        int dispatcherId = claimNearest(request.x, request.y);
+
+        lock_guard<mutex> guard(intake->commitLock);
+        if (findIncident(request.id) != nullptr) {
+            if (dispatcherId != -1) {
+                releaseClaim(dispatcherId);
+            }
+            intake->rejected.fetch_add(1, memory_order_relaxed);
+        }
+        else {
+            addIncident(request.id, request.x, request.y, request.reportTime, request.responseTime, request.severity);
+            if (request.stationId != -1 && findStation(request.stationId) != nullptr) {
+                incidents->incident.reportedFromStationId = request.stationId;
+                journalRecord("R " + to_string(request.id) + " " + to_string(request.stationId));
+            }
+            if (dispatcherId != -1) {
+                // Workers search the grid without locks, so the unit stays in
+                // it, held by its claim, until intake stops
+                dispatchUnit(findDispatcher(dispatcherId), incidents, false);
+                intake->dispatched.push_back(dispatcherId);
+                journalRecord("A " + to_string(request.id) + " " + to_string(dispatcherId));
+                intake->assigned.fetch_add(1, memory_order_relaxed);
+            }
+            else {
+                intake->unassigned.fetch_add(1, memory_order_relaxed);
+            }
+        }
+        intake->processed.fetch_add(1, memory_order_relaxed);
+    }
+
+    void intakeWorker() {
+        IntakeRequest request;
+        int idle = 0;
+        while (true) {
+            if (intake->queue.tryPop(request)) {
+                processIntake(request);
+                idle = 0;
+                continue;
+            }
+            // Producers are done once stopping is set; drain what is left
+            if (intake->stopping.load(memory_order_acquire)) {
+                if (!intake->queue.tryPop(request)) {
+                    break;
+                }
+                processIntake(request);
+                continue;
+            }
+            if (++idle < 64) {
+                this_thread::yield();
+            }
+            else {
+                this_thread::sleep_for(chrono::microseconds(50));
+            }
+        }
+    }
+
+    // Put a new record at the head of its list and into the indexes; the
+    // caller has checked that the ID is free
+    void linkStation(const Station& station, bool repaintCoverage = true) {
+        StationNode* newNode = stationPool.create(StationNode{ station, stations });
+        stations = newNode;
+        stationIndex.insert(station.id, newNode);
+        stationCoverage.add(station.id, station.x, station.y, repaintCoverage);
+    }
+
+    // Bulk loads leave the coverage raster, grid, time index and triage
+    // queue out and rebuild them once at the end
+    void linkIncident(const Incident& incident, bool addToIndexes = true) {
+        IncidentNode* newNode = incidentPool.create(IncidentNode{ incident, incidents, TRIAGE_NOT_QUEUED });
+        incidents = newNode;
+        incidentIndex.insert(incident.id, newNode);
+        if (addToIndexes) {
+            incidentTimes.insert(newNode);
+            if (incident.assignedDispatcherId == -1) {
+                triage.push(newNode);
+            }
+        }
+    }
+
+    void linkDispatcher(const Dispatcher& dispatcher, bool addToGrid = true) {
+        DispatcherNode* newNode = dispatcherPool.create(DispatcherNode{ dispatcher, dispatchers, 0 });
+        dispatchers = newNode;
+        dispatcherIndex.insert(dispatcher.id, newNode);
+        if (dispatcher.state == DISPATCHER_AVAILABLE) {
+            newNode->dispatcher.baseX = dispatcher.x;
+            newNode->dispatcher.baseY = dispatcher.y;
+            putInService(newNode, addToGrid);
+        }
+        else {
+            newNode->slot = busyUnits.size();
+            busyUnits.push_back(newNode);
+        }
+    }
+
+    // Available units are the ones in the grid and the coordinate columns.
+    // Units only move while busy, so each state change is one insert or one
+    // removal there, and moving never touches the search structures.
+    void putInService(DispatcherNode* node, bool addToGrid = true) {
+        if (addToGrid) {
+            dispatcherGrid.insert(node);
+        }
+        node->slot = dispatcherCoords.size();
+        dispatcherCoords.add(node->dispatcher.id, node->dispatcher.x, node->dispatcher.y);
+    }
+
+    void takeOutOfService(DispatcherNode* node) {
+        dispatcherGrid.remove(node);
+        int movedId = dispatcherCoords.removeAt(node->slot);
+        if (movedId != -1) {
+            findDispatcher(movedId)->slot = node->slot;
+        }
+    }
+
+    // Sends an available unit to an incident at (x, y). Intake leaves the
+    // unit in the search structures and withdraws it once the workers stop.
+    void sendUnit(DispatcherNode* node, int incidentId, int x, int y, bool withdraw = true) {
+        if (withdraw) {
+            takeOutOfService(node);
+        }
+        Dispatcher& d = node->dispatcher;
+        d.state = DISPATCHER_EN_ROUTE;
+        d.incidentId = incidentId;
+        d.targetX = x;
+        d.targetY = y;
+        d.remaining = 0;
+        node->slot = busyUnits.size();
+        busyUnits.push_back(node);
+    }
+
+    void dispatchUnit(DispatcherNode* node, IncidentNode* incidentNode, bool withdraw = true) {
+        sendUnit(node, incidentNode->incident.id, incidentNode->incident.x, incidentNode->incident.y, withdraw);
+        incidentNode->incident.assignedDispatcherId = node->dispatcher.id;
+        triage.remove(incidentNode);
+    }
+
+    // Moves a unit up to steps grid steps towards its target, x first;
+    // returns true once it is there
+    static bool moveTowardsTarget(Dispatcher& d, long long steps) {
+        long long dx = min(steps, (long long)abs(d.targetX - d.x));
+        d.x += d.targetX > d.x ? (int)dx : -(int)dx;
+        steps -= dx;
+        long long dy = min(steps, (long long)abs(d.targetY - d.y));
+        d.y += d.targetY > d.y ? (int)dy : -(int)dy;
+        return d.x == d.targetX && d.y == d.targetY;
+    }
+
+    // Runs one busy unit forward by time units, through as many state
+    // changes as fit. Returns true if it became available again.
+    bool advanceUnit(DispatcherNode* node, long long time) {
+        Dispatcher& d = node->dispatcher;
+        while (time > 0) {
+            if (d.state == DISPATCHER_ON_SCENE) {
+                if (d.remaining > time) {
+                    d.remaining -= (int)time;
+                    return false;
+                }
+                time -= d.remaining;
+                d.remaining = 0;
+                d.state = DISPATCHER_RETURNING;
+                d.targetX = d.baseX;
+                d.targetY = d.baseY;
+                continue;
+            }
+            long long distance = (long long)abs(d.targetX - d.x) + abs(d.targetY - d.y);
+            long long needed = (distance + unitSpeed - 1) / unitSpeed;
+            if (needed > time) {
+                moveTowardsTarget(d, time * unitSpeed);
+                return false;
+            }
+            moveTowardsTarget(d, distance);
+            time -= needed;
+            if (d.state == DISPATCHER_EN_ROUTE) {
+                d.state = DISPATCHER_ON_SCENE;
+                d.remaining = onSceneTime;
+            }
+            else {
+                d.state = DISPATCHER_AVAILABLE;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Resolved once its unit has left the scene
+    bool isResolved(const Incident& incident) {
+        if (incident.assignedDispatcherId == -1) {
+            return false;
+        }
+        DispatcherNode* unit = findDispatcher(incident.assignedDispatcherId);
+        return unit == nullptr || unit->dispatcher.incidentId != incident.id
+            || unit->dispatcher.state == DISPATCHER_RETURNING || unit->dispatcher.state == DISPATCHER_AVAILABLE;
+    }
+
+    static void writeIncidentRecord(RecordWriter& out, const Incident& in) {
+        const int fields[] = { in.x, in.y, in.reportTime, in.responseTime, in.reportedFromStationId, in.assignedDispatcherId, in.severity };
+        out.number(in.id).fields(fields, sizeof(fields) / sizeof(fields[0])).put('\n');
+    }
+
+    // Text state format read by loadFromFile, one record per line; records
+    // outside the filter are skipped before anything is formatted
+    void writeState(RecordWriter& out, const OutputFilter& filter) {
+        // Goes first: readers that predate it drop it as lines outside any section
+        if (filter.kinds & OUTPUT_DISPATCHERS) {
+            out.text("Units:\n").number(unitSpeed).put(' ').number(onSceneTime).put('\n');
+        }
+        if (filter.kinds & OUTPUT_STATIONS) {
+            out.text("Stations:\n");
+            for (StationNode* node = stations; node != nullptr; node = node->next) {
+                const Station& st = node->station;
+                if (filter.wants(OUTPUT_STATIONS, st.x, st.y)) {
+                    out.number(st.id).put(' ').number(st.x).put(' ').number(st.y).put(' ').text(st.name).put('\n');
+                }
+            }
+        }
+        if (filter.kinds & OUTPUT_INCIDENTS) {
+            out.text("Incidents:\n");
+            for (IncidentNode* node = incidents; node != nullptr; node = node->next) {
+                const Incident& in = node->incident;
+                if (filter.wants(OUTPUT_INCIDENTS, in.x, in.y)) {
+                    writeIncidentRecord(out, in);
+                }
+            }
+        }
+        if (filter.kinds & OUTPUT_DISPATCHERS) {
+            out.text("Dispatchers:\n");
+            for (DispatcherNode* node = dispatchers; node != nullptr; node = node->next) {
+                const Dispatcher& d = node->dispatcher;
+                if (!filter.wants(OUTPUT_DISPATCHERS, d.x, d.y)) {
+                    continue;
+                }
+                out.number(d.id).put(' ').number(d.x).put(' ').number(d.y);
+                if (d.state != DISPATCHER_AVAILABLE) {
+                    const int fields[] = { (int)d.state, d.incidentId, d.baseX, d.baseY, d.targetX, d.targetY, d.remaining };
+                    out.fields(fields, sizeof(fields) / sizeof(fields[0]));
+                }
+                out.put('\n');
+            }
+        }
+        if ((filter.kinds & OUTPUT_ARCHIVED) && archive.size() > 0) {
+            vector<Incident> archived;
+            archive.decodeInBox(filter.minX, filter.minY, filter.maxX, filter.maxY, archived);
+            out.text("Archived:\n");
+            for (size_t i = 0; i < archived.size(); ++i) {
+                writeIncidentRecord(out, archived[i]);
+            }
+        }
+    }
+
+    // Counts live and archived incidents into a hotspot grid
+    bool buildHotspotGrid(const HotspotOptions& options, HotspotGrid& grid) {
+        bool periodic = options.period > 0;
+        if (options.period < 0 || options.cellSize < 0 || (!periodic && options.fromTime > options.toTime)
+            || (periodic && (options.fromTime < 0 || options.toTime < 0 || options.fromTime >= options.period || options.toTime >= options.period))) {
+            cout << "Invalid hotspot window.\n";
+            return false;
+        }
+        vector<int32_t> xs, ys, reports;
+        archive.decodePositions(xs, ys, reports);
+        for (IncidentNode* node = incidents; node != nullptr; node = node->next) {
+            xs.push_back(node->incident.x);
+            ys.push_back(node->incident.y);
+            reports.push_back(node->incident.reportTime);
+        }
+        if (!grid.build(xs.data(), ys.data(), reports.data(), xs.size(), options)) {
+            cout << "Hotspot grid too large; use a larger cell size.\n";
+            return false;
+        }
+        return true;
+    }
+
+    // Release every node and reset the ID indexes
+    void clear() {
+        triage.clear();
+        stationPool.clear();
+        incidentPool.clear();
+        dispatcherPool.clear();
+        stations = nullptr;
+        incidents = nullptr;
+        dispatchers = nullptr;
+        stationIndex.clear();
+        incidentIndex.clear();
+        dispatcherIndex.clear();
+        incidentTimes.clear();
+        stationCoverage.clear();
+        dispatcherGrid.clear();
+        dispatcherCoords.clear();
+        busyUnits.clear();
+        archive.clear();
+    }
+
+public:
+    EmergencyManager() : stations(nullptr), incidents(nullptr), dispatchers(nullptr), unitSpeed(DEFAULT_UNIT_SPEED), onSceneTime(DEFAULT_ON_SCENE_TIME), compactEvery(100000), replaying(false), intake(nullptr), listing(LISTING_BUFFER_SIZE) {}
+
+    ~EmergencyManager() {
+        stopIntake();
+        clear();
+    }
+
+    bool addStation(int id, int x, int y, const string& name) {
+        RESCUENET_TIMED(OP_ADD_STATION);
+        if (findStation(id) != nullptr) {
+            cout << "Station with ID " << id << " already exists.\n";
+            return false;
+        }
+        linkStation(Station{ id, x, y, name });
+        journalRecord("S " + to_string(id) + " " + to_string(x) + " " + to_string(y) + " " + name);
+        return true;
+    }
+
+    bool addIncident(int id, int x, int y, int reportTime, int responseTime, int severity = SEVERITY_DEFAULT) {
+        RESCUENET_TIMED(OP_ADD_INCIDENT);
+        if (findIncident(id) != nullptr) {
+            cout << "Incident with ID " << id << " already exists.\n";
+            return false;
+        }
+        if (severity < SEVERITY_MINOR || severity > SEVERITY_CRITICAL) {
+            cout << "Severity must be between " << SEVERITY_MINOR << " and " << SEVERITY_CRITICAL << ".\n";
+            return false;
+        }
+        linkIncident(Incident{ id, x, y, reportTime, responseTime, -1, -1, severity });
+        journalRecord("I " + to_string(id) + " " + to_string(x) + " " + to_string(y) + " " + to_string(reportTime) + " " + to_string(responseTime) + " " + to_string(severity));
+        return true;
+    }
+
+    bool addDispatcher(int id, int x, int y) {
+        RESCUENET_TIMED(OP_ADD_DISPATCHER);
+        if (intake != nullptr) {
+            cout << "Cannot add dispatchers while intake is running.\n";
+            return false;
+        }
+        if (findDispatcher(id) != nullptr) {
+            cout << "Dispatcher with ID " << id << " already exists.\n";
+            return false;
+        }
+        linkDispatcher(Dispatcher{ id, x, y, DISPATCHER_AVAILABLE, -1, x, y, x, y, 0 });
+        journalRecord("D " + to_string(id) + " " + to_string(x) + " " + to_string(y));
+        return true;
+    }
+
+    // Human-readable listing of what the filter selects, written in large chunks
+    void printLocations(const OutputFilter& filter = OUTPUT_EVERYTHING) {
+        RecordWriter& out = listing;
+        out.attach(cout.rdbuf());
+        if (filter.kinds & OUTPUT_STATIONS) {
+            out.text("Stations:\n");
+            for (StationNode* node = stations; node != nullptr; node = node->next) {
+                const Station& st = node->station;
+                if (filter.wants(OUTPUT_STATIONS, st.x, st.y)) {
+                    out.text("ID: ").number(st.id).text(", Name: ").text(st.name).text(", Coordinates: (");
+                    out.number(st.x).text(", ").number(st.y).text(")\n");
+                }
+            }
+        }
+        if (filter.kinds & OUTPUT_INCIDENTS) {
+            out.text("Incidents:\n");
+            for (IncidentNode* node = incidents; node != nullptr; node = node->next) {
+                const Incident& in = node->incident;
+                if (filter.wants(OUTPUT_INCIDENTS, in.x, in.y)) {
+                    out.text("ID: ").number(in.id).text(", Coordinates: (").number(in.x).text(", ").number(in.y).text(")\n");
+                }
+            }
+        }
+        if (filter.kinds & OUTPUT_DISPATCHERS) {
+            out.text("Dispatchers:\n");
+            for (DispatcherNode* node = dispatchers; node != nullptr; node = node->next) {
+                const Dispatcher& d = node->dispatcher;
+                if (!filter.wants(OUTPUT_DISPATCHERS, d.x, d.y)) {
+                    continue;
+                }
+                out.text("ID: ").number(d.id).text(", Coordinates: (").number(d.x).text(", ").number(d.y).put(')');
+                if (d.state != DISPATCHER_AVAILABLE) {
+                    out.text(", ").text(DISPATCHER_STATE_NAMES[d.state]).text(" for incident ").number(d.incidentId);
+                }
+                out.put('\n');
+            }
+        }
+        out.close();
+    }
+
+    // Draws a rows x cols window of the city whose top-left cell starts at
+    // (originX, originY); each cell covers zoom x zoom coordinate units. As
+    // before, rows follow x and columns follow y. A cell shows the most
+    // important entity in it (S station, I incident, D dispatcher) followed
+    // by the number of entities when there are several (+ for 10 or more).
+    // Every entity is binned once and the frame goes out in a single write.
+    void displayMap(int originX = 0, int originY = 0, int rows = 5, int cols = 5, int zoom = 1) {
+        const long long MAX_CELLS = 4000000;
+        if (rows <= 0 || cols <= 0 || zoom <= 0 || (long long)rows * cols > MAX_CELLS) {
+            cout << "Invalid map viewport.\n";
+            return;
+        }
+
+        size_t cells = (size_t)rows * cols;
+        vector<uint32_t> total(cells, 0);
+        vector<uint8_t> kind(cells, 0);     // 3 station, 2 incident, 1 dispatcher, 0 empty
+        long long spanX = (long long)rows * zoom;
+        long long spanY = (long long)cols * zoom;
+        auto bin = [&](int x, int y, uint8_t rank) {
+            // Unsigned compare rejects both sides of the window at once
+            unsigned long long dr = (unsigned long long)((long long)x - originX);
+            unsigned long long dc = (unsigned long long)((long long)y - originY);
+            if (dr >= (unsigned long long)spanX || dc >= (unsigned long long)spanY) {
+                return;
+            }
+            size_t cell = (size_t)(dr / zoom) * cols + (size_t)(dc / zoom);
+            ++total[cell];
+            kind[cell] = max(kind[cell], rank);
+        };
+        for (StationNode* node = stations; node != nullptr; node = node->next) {
+            bin(node->station.x, node->station.y, 3);
+        }
+        for (IncidentNode* node = incidents; node != nullptr; node = node->next) {
+            bin(node->incident.x, node->incident.y, 2);
+        }
+        // Every unit, busy ones at their current position on the way
+        for (DispatcherNode* node = dispatchers; node != nullptr; node = node->next) {
+            bin(node->dispatcher.x, node->dispatcher.y, 1);
+        }
+
+        static const char SYMBOL[] = { '.', 'D', 'I', 'S' };
+        string frame = "Visual Representation: x " + to_string(originX) + ".." + to_string(originX + (long long)rows * zoom - 1)
+            + ", y " + to_string(originY) + ".." + to_string(originY + (long long)cols * zoom - 1)
+            + ", " + to_string(zoom) + " per cell\n";
+        size_t header = frame.size();
+        frame.resize(header + (size_t)rows * (cols * 2 + 1));
+        char* out = &frame[header];
+        for (int r = 0; r < rows; ++r) {
+            const uint32_t* rowTotal = &total[(size_t)r * cols];
+            const uint8_t* rowKind = &kind[(size_t)r * cols];
+            for (int c = 0; c < cols; ++c) {
+                *out++ = SYMBOL[rowKind[c]];
+                uint32_t n = rowTotal[c];
+                *out++ = n <= 1 ? ' ' : (n < 10 ? (char)('0' + n) : '+');
+            }
+            *out++ = '\n';
+        }
+        cout.write(frame.data(), (streamsize)frame.size());
+    }
+
+    int calculateShortestDistanceToStation(int incidentId) {
+        RESCUENET_TIMED(OP_DISTANCE_TO_STATION);
+        // Find the incident
+        IncidentNode* incidentNode = findIncident(incidentId);
+        if (incidentNode == nullptr) {
+            cout << "Incident with ID " << incidentId << " not found.\n";
+            return -1;
+        }
+
+        // Find the reporting station
+        StationNode* stationNode = findStation(incidentNode->incident.reportedFromStationId);
+        if (stationNode == nullptr) {
+            cout << "Station with ID " << incidentNode->incident.reportedFromStationId << " not found.\n";
+            return -1;
+        }
+
+        int distance = travelDistance(incidentNode->incident.x, incidentNode->incident.y, stationNode->station.x, stationNode->station.y);
+        if (distance < 0) {
+            cout << "No road route between incident " << incidentId << " and station " << stationNode->station.id << ".\n";
+        }
+        return distance;
+    }
+
+    // ID of the station closest to an incident by Manhattan distance, lowest
+    // ID among equally close ones, or -1; the distance goes to distanceOut
+    int closestStation(int incidentId, int* distanceOut = nullptr) {
+        IncidentNode* incidentNode = findIncident(incidentId);
+        if (incidentNode == nullptr) {
+            cout << "Incident with ID " << incidentId << " not found.\n";
+            return -1;
+        }
+        int stationId = stationCoverage.nearest(incidentNode->incident.x, incidentNode->incident.y, distanceOut);
+        if (stationId == -1) {
+            cout << "No stations available.\n";
+        }
+        return stationId;
+    }
+
+    // Ranked (dispatcher ID, distance) pairs for the k units closest to an
+    // incident, by road when a road network is loaded
+    vector<pair<int, int>> kNearestDispatchers(int incidentId, int k) {
+        vector<pair<int, int>> ranked;
+        IncidentNode* incidentNode = findIncident(incidentId);
+        if (incidentNode == nullptr) {
+            cout << "Incident with ID " << incidentId << " not found.\n";
+            return ranked;
+        }
+        if (k <= 0) {
+            return ranked;
+        }
+        if (roads.isLoaded()) {
+            return kNearestByRoad(incidentNode->incident.x, incidentNode->incident.y, (size_t)k);
+        }
+
+        if (k == 1) {
+            int distance;
+            int id = nearestAvailable(incidentNode->incident.x, incidentNode->incident.y, &distance);
+            if (id != -1) {
+                ranked.push_back(make_pair(id, distance));
+            }
+            return ranked;
+        }
+
+        vector<DispatcherCandidate> candidates = dispatcherGrid.kNearest(incidentNode->incident.x, incidentNode->incident.y, (size_t)k);
+        ranked.reserve(candidates.size());
+        for (size_t i = 0; i < candidates.size(); ++i) {
+            ranked.push_back(make_pair(candidates[i].node->dispatcher.id, candidates[i].distance));
+        }
+        return ranked;
+    }
+
+    // IDs of incidents reported between from and to inclusive, in report order
+    vector<int> incidentsReportedBetween(int from, int to) {
+        vector<IncidentNode*> nodes;
+        incidentTimes.reportedBetween(from, to, nodes);
+        vector<int> ids(nodes.size());
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            ids[i] = nodes[i]->incident.id;
+        }
+        return ids;
+    }
+
+    // IDs of incidents open at some point between from and to inclusive,
+    // i.e. reported by to and not responded to before from; pass the same
+    // time twice for the incidents open at that moment
+    vector<int> incidentsOpenDuring(int from, int to) {
+        vector<IncidentNode*> nodes;
+        incidentTimes.openDuring(from, to, nodes);
+        vector<int> ids(nodes.size());
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            ids[i] = nodes[i]->incident.id;
+        }
+        return ids;
+    }
+
+    // Assigns the closest dispatcher and returns its ID, or -1 on failure
+    int assignDispatcher(int incidentId) {
+        RESCUENET_TIMED(OP_ASSIGN_DISPATCHER);
+        if (intake != nullptr) {
+            cout << "Cannot assign dispatchers while intake is running.\n";
+            return -1;
+        }
+        // Find the incident
+        IncidentNode* incidentNode = findIncident(incidentId);
+        if (incidentNode == nullptr) {
+            cout << "Incident with ID " << incidentId << " not found.\n";
+            return -1;
+        }
+
+        // Assigned once means handled, even after the unit has come back
+        if (incidentNode->incident.assignedDispatcherId != -1) {
+            cout << "Incident " << incidentId << " is already handled by dispatcher ID " << incidentNode->incident.assignedDispatcherId << ".\n";
+            return incidentNode->incident.assignedDispatcherId;
+        }
+
+        vector<pair<int, int>> ranked = kNearestDispatchers(incidentId, 1);
+        if (ranked.empty()) {
+            cout << "No available dispatchers.\n";
+            return -1;
+        }
+
+        dispatchUnit(findDispatcher(ranked[0].first), incidentNode);
+        journalRecord("A " + to_string(incidentId) + " " + to_string(ranked[0].first));
+        cout << "Incident assigned to dispatcher ID " << ranked[0].first << ".\n";
+        return ranked[0].first;
+    }
+
+    // Closest available unit to a point by Manhattan distance, ties to the
+    // lower ID; returns its ID, or -1 if none is free. Prints nothing.
+    int nearestAvailable(int x, int y, int* distanceOut) {
+        if (dispatcherCoords.size() <= DISPATCHER_SCAN_LIMIT) {
+            int index = dispatcherCoords.nearest(x, y, distanceOut);
+            return index >= 0 ? dispatcherCoords.idAt((size_t)index) : -1;
+        }
+        vector<DispatcherCandidate> candidates = dispatcherGrid.kNearest(x, y, 1);
+        if (candidates.empty()) {
+            return -1;
+        }
+        *distanceOut = candidates[0].distance;
+        return candidates[0].node->dispatcher.id;
+    }
+
+    // Halves of an assignment whose unit and incident are held by different
+    // managers (see ShardedManager). Neither is journalled.
+    bool sendAvailableUnit(int dispatcherId, int incidentId, int x, int y) {
+        DispatcherNode* node = findDispatcher(dispatcherId);
+        if (node == nullptr || node->dispatcher.state != DISPATCHER_AVAILABLE) {
+            return false;
+        }
+        sendUnit(node, incidentId, x, y);
+        return true;
+    }
+
+    bool recordAssignment(int incidentId, int dispatcherId) {
+        IncidentNode* incidentNode = findIncident(incidentId);
+        if (incidentNode == nullptr) {
+            return false;
+        }
+        incidentNode->incident.assignedDispatcherId = dispatcherId;
+        triage.remove(incidentNode);
+        return true;
+    }
+
+    // Sends the closest available unit to the most urgent unassigned
+    // incident. Returns the incident ID, or -1 if nothing is waiting or no
+    // unit is free; the incident then stays at the head of the queue.
+    int dispatchNext() {
+        RESCUENET_TIMED(OP_DISPATCH_NEXT);
+        if (intake != nullptr) {
+            cout << "Cannot assign dispatchers while intake is running.\n";
+            return -1;
+        }
+        IncidentNode* next = triage.top();
+        if (next == nullptr) {
+            cout << "No incidents awaiting dispatch.\n";
+            return -1;
+        }
+        if (assignDispatcher(next->incident.id) == -1) {
+            return -1;
+        }
+        return next->incident.id;
+    }
+
+    // Re-ranks an incident; a waiting one moves in the triage queue in O(log n)
+    bool setSeverity(int incidentId, int severity) {
+        IncidentNode* incidentNode = findIncident(incidentId);
+        if (incidentNode == nullptr) {
+            cout << "Incident with ID " << incidentId << " not found.\n";
+            return false;
+        }
+        if (severity < SEVERITY_MINOR || severity > SEVERITY_CRITICAL) {
+            cout << "Severity must be between " << SEVERITY_MINOR << " and " << SEVERITY_CRITICAL << ".\n";
+            return false;
+        }
+        incidentNode->incident.severity = severity;
+        if (triage.contains(incidentNode)) {
+            triage.update(incidentNode);
+        }
+        journalRecord("E " + to_string(incidentId) + " " + to_string(severity));
+        return true;
+    }
+
+    size_t pendingIncidents() const {
+        return triage.size();
+    }
+
+    // Most urgent incident still awaiting dispatch, or nullptr
+    const Incident* nextWaiting() const {
+        IncidentNode* next = triage.top();
+        return next != nullptr ? &next->incident : nullptr;
+    }
+
+    // The dispatcher assigned to an incident, -1 while unassigned or unknown
+    int assignedDispatcher(int incidentId) {
+        IncidentNode* incidentNode = findIncident(incidentId);
+        return incidentNode != nullptr ? incidentNode->incident.assignedDispatcherId : -1;
+    }
+
+    // Moves every resolved incident that closed (responded, or was reported
+    // when that is later) before closedBefore out of the live list and its
+    // indexes into the archive, and returns how many moved. The time index
+    // is rebuilt from what stays; archived IDs may be reused later.
+    size_t archiveResolved(int closedBefore) {
+        if (intake != nullptr) {
+            cout << "Cannot archive while intake is running.\n";
+            return 0;
+        }
+        vector<Incident> resolved;
+        IncidentNode** link = &incidents;
+        while (*link != nullptr) {
+            IncidentNode* node = *link;
+            const Incident& in = node->incident;
+            if (max(in.reportTime, in.responseTime) < closedBefore && isResolved(in)) {
+                resolved.push_back(in);
+                incidentIndex.erase(in.id);
+                *link = node->next;
+                incidentPool.release(node);
+            }
+            else {
+                link = &node->next;
+            }
+        }
+        if (resolved.empty()) {
+            return 0;
+        }
+
+        vector<TimeEntry> times;
+        times.reserve(incidentIndex.size());
+        for (IncidentNode* node = incidents; node != nullptr; node = node->next) {
+            times.push_back(TimeIndex::entryFor(node));
+        }
+        incidentTimes.build(times);
+        archive.append(resolved);
+        journalRecord("a " + to_string(closedBefore));
+        return resolved.size();
+    }
+
+    ArchiveSummary queryArchive(const ArchiveQuery& query) const {
+        return archive.summarize(query);
+    }
+
+    size_t archivedIncidents() const {
+        return archive.size();
+    }
+
+    size_t archiveBytes() const {
+        return archive.memoryBytes();
+    }
+
+    // The count cells with the most incidents in the window
+    bool incidentHotspots(size_t count, const HotspotOptions& options, vector<HotspotCell>& cells) {
+        HotspotGrid grid;
+        if (!buildHotspotGrid(options, grid)) {
+            return false;
+        }
+        cells = grid.hottest(count);
+        return true;
+    }
+
+    // Recommends k positions to station dispatchers at so the incidents in
+    // the window are as close as possible on average, and measures the
+    // same for where the dispatchers are based now
+    bool planStaging(size_t k, const HotspotOptions& options, StagingPlan& plan) {
+        chrono::steady_clock::time_point started = chrono::steady_clock::now();
+        HotspotGrid grid;
+        if (!buildHotspotGrid(options, grid)) {
+            return false;
+        }
+        plan = grid.recommend(k);
+        vector<IndexedPoint> homes;
+        for (DispatcherNode* node = dispatchers; node != nullptr; node = node->next) {
+            homes.push_back(IndexedPoint{ node->dispatcher.id, node->dispatcher.baseX, node->dispatcher.baseY });
+        }
+        plan.currentDistance = grid.meanDistance(homes);
+        plan.seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+        return true;
+    }
+
+    // Matches every pending incident to a distinct available dispatcher so
+    // that the total distance is minimal (see BatchAssignment; very large or
+    // crowded batches may end greedily). Returns
+    // (incident ID, dispatcher ID) pairs.
+    vector<pair<int, int>> assignPendingBatch() {
+        vector<pair<int, int>> result;
+        if (intake != nullptr) {
+            cout << "Cannot assign dispatchers while intake is running.\n";
+            return result;
+        }
+
+        vector<IncidentNode*> pending;
+        for (IncidentNode* node = incidents; node != nullptr; node = node->next) {
+            if (node->incident.assignedDispatcherId == -1) {
+                pending.push_back(node);
+            }
+        }
+        vector<DispatcherNode*> freeUnits;
+        for (size_t i = 0; i < dispatcherCoords.size(); ++i) {
+            freeUnits.push_back(findDispatcher(dispatcherCoords.idAt(i)));
+        }
+        if (pending.empty() || freeUnits.empty()) {
+            cout << "Nothing to assign: " << pending.size() << " pending incidents, " << freeUnits.size() << " free dispatchers.\n";
+            return result;
+        }
+
+        vector<IndexedPoint> incidentPoints, unitPoints;
+        for (size_t i = 0; i < pending.size(); ++i) {
+            incidentPoints.push_back(IndexedPoint{ (int)i, pending[i]->incident.x, pending[i]->incident.y });
+        }
+        for (size_t j = 0; j < freeUnits.size(); ++j) {
+            unitPoints.push_back(IndexedPoint{ (int)j, freeUnits[j]->dispatcher.x, freeUnits[j]->dispatcher.y });
+        }
+
+        // The smaller side is matched into the larger one
+        bool incidentsAreRows = pending.size() <= freeUnits.size();
+        long long totalCost = 0;
+        BatchAssignment solver(incidentsAreRows ? incidentPoints : unitPoints, incidentsAreRows ? unitPoints : incidentPoints);
+        vector<int> match = solver.solve(totalCost);
+        for (size_t r = 0; r < match.size(); ++r) {
+            IncidentNode* incidentNode = pending[incidentsAreRows ? r : match[r]];
+            DispatcherNode* unit = freeUnits[incidentsAreRows ? match[r] : r];
+            dispatchUnit(unit, incidentNode);
+            journalRecord("A " + to_string(incidentNode->incident.id) + " " + to_string(unit->dispatcher.id));
+            result.push_back(make_pair(incidentNode->incident.id, unit->dispatcher.id));
+        }
+
+        cout << "Batch assigned " << result.size() << " incidents, total distance " << totalCost
+            << (solver.isExact() ? ".\n" : " (approximate: search limit reached, the rest took the nearest free units).\n");
+        return result;
+    }
+
+    // Moves time forward for every busy unit: en-route units drive to their
+    // incident at unitSpeed steps per time unit, stay onSceneTime, drive back
+    // to base and become available there. Costs O(busy units); units that
+    // come back re-enter the search structures one by one. Returns how many did.
+    int advanceTime(int time) {
+        if (intake != nullptr) {
+            cout << "Cannot advance time while intake is running.\n";
+            return 0;
+        }
+        if (time <= 0) {
+            return 0;
+        }
+        int returned = 0;
+        // Back to front, so a unit swapped into a finished unit's place was already advanced
+        for (size_t i = busyUnits.size(); i > 0; --i) {
+            DispatcherNode* node = busyUnits[i - 1];
+            if (!advanceUnit(node, time)) {
+                continue;
+            }
+            busyUnits[i - 1] = busyUnits.back();
+            busyUnits[i - 1]->slot = i - 1;
+            busyUnits.pop_back();
+            putInService(node);
+            ++returned;
+        }
+        journalRecord("V " + to_string(time));
+        return returned;
+    }
+
+    // Travel speed in grid steps per time unit and time spent at each incident
+    bool setUnitTiming(int speed, int sceneTime) {
+        if (speed <= 0 || sceneTime < 0) {
+            cout << "Speed must be positive and on-scene time not negative.\n";
+            return false;
+        }
+        unitSpeed = speed;
+        onSceneTime = sceneTime;
+        journalRecord("u " + to_string(speed) + " " + to_string(sceneTime));
+        return true;
+    }
+
+    const Dispatcher* dispatcherStatus(int id) {
+        DispatcherNode* node = findDispatcher(id);
+        if (node == nullptr) {
+            cout << "Dispatcher with ID " << id << " not found.\n";
+            return nullptr;
+        }
+        return &node->dispatcher;
+    }
+
+    size_t availableDispatchers() const {
+        return dispatcherCoords.size();
+    }
+
+    void reportIncident(int incidentId) {
+        // Find the incident
+        IncidentNode* incidentNode = findIncident(incidentId);
+        if (incidentNode == nullptr) {
+            cout << "Incident with ID " << incidentId << " not found.\n";
+            return;
+        }
+
+        // Select a station
+        cout << "Select a station:\n";
+        StationNode* stationNode = stations;
+        int index = 1;
+        while (stationNode != nullptr) {
+            cout << index++ << ". " << stationNode->station.name << "\n";
+            stationNode = stationNode->next;
+        }
+
+        int stationIndex;
+        cout << "Enter station index: ";
+        cin >> stationIndex;
+
+        stationNode = stations;
+        for (int i = 1; i < stationIndex && stationNode != nullptr; ++i) {
+            stationNode = stationNode->next;
+        }
+
+        if (stationNode == nullptr) {
+            cout << "Invalid station index.\n";
+            return;
+        }
+
+        reportIncident(incidentId, stationNode->station.id);
+    }
+
+    // Non-interactive form: records the reporting station by ID
+    bool reportIncident(int incidentId, int stationId) {
+        RESCUENET_TIMED(OP_REPORT_INCIDENT);
+        IncidentNode* incidentNode = findIncident(incidentId);
+        if (incidentNode == nullptr) {
+            cout << "Incident with ID " << incidentId << " not found.\n";
+            return false;
+        }
+        if (findStation(stationId) == nullptr) {
+            cout << "Station with ID " << stationId << " not found.\n";
+            return false;
+        }
+
+        incidentNode->incident.reportedFromStationId = stationId;
+        journalRecord("R " + to_string(incidentId) + " " + to_string(stationId));
+        cout << "Incident reported from station ID " << stationId << ".\n";
+        return true;
+    }
+
+    // Starts a pool of dispatch workers fed by a lock-free intake queue.
+    // Any number of threads may then call submitIncident; workers search for
+    // the nearest dispatcher concurrently and claim units atomically, so no
+    // dispatcher is handed to two incidents. Only available dispatchers take
+    // part; a claimed one is dispatched as its incident is added. Until stopIntake
+    // returns, other threads must not call anything else on the manager.
+    bool startIntake(int workerCount, size_t capacity = 65536) {
+        if (intake != nullptr) {
+            cout << "Intake is already running.\n";
+            return false;
+        }
+        if (workerCount <= 0) {
+            cout << "Intake needs at least one worker.\n";
+            return false;
+        }
+
+        vector<DispatcherNode*> freeUnits(dispatcherCoords.size());
+        for (size_t i = 0; i < dispatcherCoords.size(); ++i) {
+            freeUnits[i] = findDispatcher(dispatcherCoords.idAt(i));
+        }
+        intake = new IntakeState(capacity, freeUnits);
+        intake->claimSlot.reserve(dispatcherCoords.size());
+        for (size_t i = 0; i < dispatcherCoords.size(); ++i) {
+            intake->claimSlot.insert(dispatcherCoords.idAt(i), (int)i);
+        }
+        for (int i = 0; i < workerCount; ++i) {
+            intake->workers.push_back(thread(&EmergencyManager::intakeWorker, this));
+        }
+        return true;
+    }
+
+    // Queues an incident for the workers, waiting while the queue is full.
+    // Safe to call from several threads at once.
+    bool submitIncident(int id, int x, int y, int reportTime, int responseTime, int stationId = -1, int severity = SEVERITY_DEFAULT) {
+        if (intake == nullptr) {
+            cout << "Intake is not running.\n";
+            return false;
+        }
+        IntakeRequest request{ id, x, y, reportTime, responseTime, stationId, severity };
+        while (!intake->queue.tryPush(request)) {
+            intake->fullWaits.fetch_add(1, memory_order_relaxed);
+            this_thread::yield();
+        }
+        intake->submitted.fetch_add(1, memory_order_relaxed);
+
+        size_t depth = intake->queue.depth();
+        size_t deepest = intake->maxDepth.load(memory_order_relaxed);
+        while (depth > deepest && !intake->maxDepth.compare_exchange_weak(deepest, depth, memory_order_relaxed)) {
+        }
+        return true;
+    }
+
+    bool intakeRunning() const {
+        return intake != nullptr;
+    }
+
+    IntakeMetrics intakeMetrics() const {
+        IntakeMetrics metrics = IntakeMetrics();
+        if (intake == nullptr) {
+            return metrics;
+        }
+        metrics.submitted = intake->submitted.load(memory_order_relaxed);
+        metrics.processed = intake->processed.load(memory_order_relaxed);
+        metrics.assigned = intake->assigned.load(memory_order_relaxed);
+        metrics.unassigned = intake->unassigned.load(memory_order_relaxed);
+        metrics.rejected = intake->rejected.load(memory_order_relaxed);
+        metrics.fullWaits = intake->fullWaits.load(memory_order_relaxed);
+        metrics.depth = intake->queue.depth();
+        metrics.maxDepth = intake->maxDepth.load(memory_order_relaxed);
+        metrics.seconds = chrono::duration<double>(chrono::steady_clock::now() - intake->started).count();
+        metrics.throughput = metrics.seconds > 0 ? metrics.processed / metrics.seconds : 0;
+        return metrics;
+    }
+
+    // Lets the workers drain the queue, joins them and returns the final
+    // counters. Every producer must have finished submitting.
+    IntakeMetrics stopIntake() {
+        if (intake == nullptr) {
+            return IntakeMetrics();
+        }
+        intake->stopping.store(true, memory_order_release);
+        for (size_t i = 0; i < intake->workers.size(); ++i) {
+            intake->workers[i].join();
+        }
+        // Units sent out during intake stayed searchable for the workers. Take
+        // them out highest slot first, so the unit moved into a freed slot is
+        // always one that is still available.
+        vector<int> slots;
+        for (size_t i = 0; i < intake->dispatched.size(); ++i) {
+            slots.push_back(*intake->claimSlot.find(intake->dispatched[i]));
+        }
+        sort(slots.begin(), slots.end(), greater<int>());
+        for (size_t i = 0; i < slots.size(); ++i) {
+            dispatcherGrid.remove(findDispatcher(dispatcherCoords.idAt(slots[i])));
+            int movedId = dispatcherCoords.removeAt(slots[i]);
+            if (movedId != -1) {
+                findDispatcher(movedId)->slot = slots[i];
+            }
+        }
+        IntakeMetrics metrics = intakeMetrics();
+        delete intake;
+        intake = nullptr;
+        return metrics;
+    }
+
+    // Replays the current incidents against the dispatchers as units (the
+    // lowest unitLimit IDs, or all when 0), optionally followed by a
+    // synthetic surge, and prints the response-time distribution
+    SimulationReport simulate(size_t unitLimit, double speed, size_t surgeCount = 0, double meanGap = 1.0, double meanService = 10.0, unsigned seed = 1) {
+        vector<const Dispatcher*> fleet;
+        int extent = 1;
+        for (DispatcherNode* node = dispatchers; node != nullptr; node = node->next) {
+            fleet.push_back(&node->dispatcher);
+            extent = max(extent, max(node->dispatcher.x, node->dispatcher.y) + 1);
+        }
+        sort(fleet.begin(), fleet.end(), [](const Dispatcher* a, const Dispatcher* b) { return a->id < b->id; });
+        if (unitLimit > 0 && unitLimit < fleet.size()) {
+            fleet.resize(unitLimit);
+        }
+
+        Simulator simulator;
+        for (size_t i = 0; i < fleet.size(); ++i) {
+            simulator.addUnit(fleet[i]->id, fleet[i]->x, fleet[i]->y);
+        }
+        // The list holds the newest incident first
+        vector<const Incident*> history;
+        double lastReport = 0;
+        for (IncidentNode* node = incidents; node != nullptr; node = node->next) {
+            history.push_back(&node->incident);
+            lastReport = max(lastReport, (double)node->incident.reportTime);
+        }
+        for (size_t i = history.size(); i > 0; --i) {
+            const Incident& in = *history[i - 1];
+            simulator.addIncident(in.id, in.x, in.y, in.reportTime, in.responseTime);
+        }
+        if (surgeCount > 0) {
+            simulator.addSurge(surgeCount, lastReport, meanGap, meanService, extent, seed);
+        }
+
+        SimulationReport report = simulator.run(speed);
+        cout << "Simulated " << report.incidents << " incidents with " << report.units << " units: "
+            << report.events << " events in " << report.wallSeconds << " s\n";
+        cout << "Response time p50 " << report.p50 << ", p95 " << report.p95 << ", p99 " << report.p99
+            << ", mean " << report.meanResponse << ", max " << report.maxResponse << "\n";
+        cout << "Unit utilization " << report.utilization * 100 << "%, longest queue " << report.maxWaiting
+            << ", makespan " << report.makespan << "\n";
+        return report;
+    }
+
+    // Count, mean and percentiles per operation, in microseconds
+    void printMetrics() const {
+        cout << "Operation             count      mean       p50       p90       p99       max  (us)\n";
+        char line[160];
+        for (int op = 0; op < OP_COUNT; ++op) {
+            const LatencyHistogram& h = metrics[(MetricOperation)op];
+            uint64_t n = h.count();
+            snprintf(line, sizeof(line), "%-20s %6llu %9.2f %9.2f %9.2f %9.2f %9.2f\n", METRIC_OPERATION_NAMES[op],
+                (unsigned long long)n, n > 0 ? h.sumNs() / 1000.0 / n : 0.0, h.percentile(0.50) / 1000.0,
+                h.percentile(0.90) / 1000.0, h.percentile(0.99) / 1000.0, h.maxNs() / 1000.0);
+            cout << line;
+        }
+        cout << "Entities: " << stationIndex.size() << " stations, " << incidentIndex.size() << " incidents, "
+            << dispatcherIndex.size() << " dispatchers\n";
+    }
+
+    // Writes the metrics in the Prometheus text exposition format
+    bool exportMetrics(const string& filename) const {
+        static const double BOUNDS[] = { 1e-7, 2.5e-7, 5e-7, 1e-6, 2.5e-6, 5e-6, 1e-5, 2.5e-5, 5e-5, 1e-4, 2.5e-4, 5e-4,
+            1e-3, 2.5e-3, 5e-3, 1e-2, 2.5e-2, 5e-2, 0.1, 0.25, 0.5, 1, 2.5, 5, 10 };
+        ofstream outFile(filename);
+        if (!outFile) {
+            cerr << "Error opening metrics file for writing.\n";
+            return false;
+        }
+
+        outFile << "# HELP rescuenet_operation_duration_seconds Latency of EmergencyManager operations.\n";
+        outFile << "# TYPE rescuenet_operation_duration_seconds histogram\n";
+        for (int op = 0; op < OP_COUNT; ++op) {
+            const LatencyHistogram& h = metrics[(MetricOperation)op];
+            string label = string("{op=\"") + METRIC_OPERATION_NAMES[op] + "\"";
+            // A histogram bucket counts towards a bound once its upper edge is within it
+            int bucket = 0;
+            uint64_t cumulative = 0;
+            for (size_t b = 0; b < sizeof(BOUNDS) / sizeof(BOUNDS[0]); ++b) {
+                uint64_t limit = (uint64_t)(BOUNDS[b] * 1e9);
+                while (bucket < LatencyHistogram::BUCKETS && LatencyHistogram::bucketUpper(bucket) <= limit) {
+                    cumulative += h.bucketCount(bucket);
+                    ++bucket;
+                }
+                outFile << "rescuenet_operation_duration_seconds_bucket" << label << ",le=\"" << BOUNDS[b] << "\"} " << cumulative << "\n";
+            }
+            outFile << "rescuenet_operation_duration_seconds_bucket" << label << ",le=\"+Inf\"} " << h.count() << "\n";
+            outFile << "rescuenet_operation_duration_seconds_sum" << label << "} " << h.sumNs() / 1e9 << "\n";
+            outFile << "rescuenet_operation_duration_seconds_count" << label << "} " << h.count() << "\n";
+        }
+
+        outFile << "# HELP rescuenet_entities Entities currently held.\n";
+        outFile << "# TYPE rescuenet_entities gauge\n";
+        outFile << "rescuenet_entities{kind=\"station\"} " << stationIndex.size() << "\n";
+        outFile << "rescuenet_entities{kind=\"incident\"} " << incidentIndex.size() << "\n";
+        outFile << "rescuenet_entities{kind=\"dispatcher\"} " << dispatcherIndex.size() << "\n";
+        outFile.close();
+        cout << "Metrics exported to " << filename << "\n";
+        return true;
+    }
+
+    void resetMetrics() {
+        metrics.reset();
+    }
+
+    // Recovers state from a snapshot plus the journal written after it, then
+    // keeps journalling every change. Either file may be missing on first use;
+    // without a snapshot the state in memory is the starting point and
+    // becomes the first snapshot.
+    bool enableJournal(const string& snapshotFilename, const string& journalFilename) {
+        journal.close();
+        snapshotFile = snapshotFilename;
+        journalFile = journalFilename;
+
+        replaying = true;
+        ifstream snapshotProbe(snapshotFile);
+        if (snapshotProbe) {
+            snapshotProbe.close();
+            if (!loadSnapshot(snapshotFile)) {
+                replaying = false;
+                return false;
+            }
+        }
+
+        size_t replayed = 0;
+        ifstream inFile(journalFile, ios::binary);
+        if (inFile) {
+            string content((istreambuf_iterator<char>(inFile)), istreambuf_iterator<char>());
+            size_t start = 0;
+            int lineNumber = 0;
+            while (start < content.size()) {
+                size_t end = content.find('\n', start);
+                if (end == string::npos) {
+                    cerr << "Ignoring torn journal record at line " << lineNumber + 1 << ".\n";
+                    break;
+                }
+                ++lineNumber;
+                string line = content.substr(start, end - start);
+                if (!line.empty() && !replayRecord(line)) {
+                    cerr << "Skipping malformed journal record at line " << lineNumber << ".\n";
+                }
+                ++replayed;
+                start = end + 1;
+            }
+        }
+        replaying = false;
+
+        // Fold the replayed records into a fresh snapshot so the journal starts empty
+        if (!compactJournal()) {
+            return false;
+        }
+        cout << "Recovered " << replayed << " journal records; journalling to " << journalFile << "\n";
+        return true;
+    }
+
+    // Writes the current state as the new snapshot and empties the journal
+    bool compactJournal() {
+        if (snapshotFile.empty()) {
+            return false;
+        }
+        journal.commit();
+        string temporary = snapshotFile + ".tmp";
+#ifdef _WIN32
+        bool written = writeSnapshot(temporary) && (remove(snapshotFile.c_str()), rename(temporary.c_str(), snapshotFile.c_str()) == 0);
+#else
+        bool written = writeSnapshot(temporary) && rename(temporary.c_str(), snapshotFile.c_str()) == 0;
+#endif
+        if (!written) {
+            cerr << "Journal compaction failed.\n";
+            return false;
+        }
+        if (!journal.truncate(journalFile)) {
+            cerr << "Error reopening journal.\n";
+            return false;
+        }
+        return true;
+    }
+
+    bool loadRoadNetwork(const string& filename) {
+        return roads.loadFromFile(filename);
+    }
+
+    void autoAddCustomerAssignIncident() {
+        addStation(1, 0, 0, "Central");
+        addIncident(1, 3, 3, 12, 13);
+
+        reportIncident(1);
+        assignDispatcher(1);
+
+        int shortestDistance = calculateShortestDistanceToStation(1);
+        if (shortestDistance != -1) {
+            cout << "Shortest distance to station for incident with ID 1 is: " << shortestDistance << "\n";
+        }
+    }
+
+    void saveToFile(const string& filename) {
+        RESCUENET_TIMED(OP_SAVE_TO_FILE);
+        RecordWriter out;
+        if (!out.open(filename)) {
+            cerr << "Error opening file for writing.\n";
+            return;
+        }
+        writeState(out, OUTPUT_EVERYTHING);
+        if (!out.close()) {
+            cerr << "Error writing " << filename << ".\n";
+            return;
+        }
+        cout << "Data saved to " << filename << "\n";
+    }
+
+    // Writes the part of the state the filter selects in the saveToFile
+    // format, to a file or pipe, or to standard output when target is "-".
+    // Sections for kinds the filter leaves out are omitted entirely.
+    bool dumpState(const string& target, const OutputFilter& filter) {
+        RecordWriter out;
+        if (target == "-") {
+            out.attach(cout.rdbuf());
+        }
+        else if (!out.open(target)) {
+            cerr << "Error opening " << target << " for writing.\n";
+            return false;
+        }
+        writeState(out, filter);
+        if (!out.close()) {
+            cerr << "Error writing " << target << ".\n";
+            return false;
+        }
+        return true;
+    }
+
+    // Writes the binary snapshot format; the text format stays the interchange format
+    bool saveSnapshot(const string& filename) {
+        if (!writeSnapshot(filename)) {
+            return false;
+        }
+        cout << "Snapshot saved to " << filename << "\n";
+        return true;
+    }
+
+    bool writeSnapshot(const string& filename) {
+        vector<StationRecord> stationRecords;
+        vector<IncidentRecord> incidentRecords;
+        vector<DispatcherRecord> dispatcherRecords;
+        string strings;
+        for (StationNode* node = stations; node != nullptr; node = node->next) {
+            const Station& st = node->station;
+            stationRecords.push_back(StationRecord{ st.id, st.x, st.y, (uint32_t)strings.size(), (uint32_t)st.name.size() });
+            strings += st.name;
+        }
+        for (IncidentNode* node = incidents; node != nullptr; node = node->next) {
+            const Incident& in = node->incident;
+            incidentRecords.push_back(IncidentRecord{ in.id, in.x, in.y, in.reportTime, in.responseTime, in.reportedFromStationId, in.assignedDispatcherId, in.severity });
+        }
+        for (DispatcherNode* node = dispatchers; node != nullptr; node = node->next) {
+            const Dispatcher& d = node->dispatcher;
+            dispatcherRecords.push_back(DispatcherRecord{ d.id, d.x, d.y, (int32_t)d.state, d.incidentId, d.baseX, d.baseY, d.targetX, d.targetY, d.remaining });
+        }
+
+        string archiveBlocks;
+        archive.serialize(archiveBlocks);
+
+        SnapshotHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+        header.version = SNAPSHOT_VERSION;
+        header.headerSize = sizeof(SnapshotHeader);
+        header.stationCount = stationRecords.size();
+        header.incidentCount = incidentRecords.size();
+        header.dispatcherCount = dispatcherRecords.size();
+        uint64_t offset = sizeof(SnapshotHeader);
+        header.stationOffset = offset;
+        offset = (offset + stationRecords.size() * sizeof(StationRecord) + 7) & ~7ULL;
+        header.incidentOffset = offset;
+        offset = (offset + incidentRecords.size() * sizeof(IncidentRecord) + 7) & ~7ULL;
+        header.dispatcherOffset = offset;
+        offset = (offset + dispatcherRecords.size() * sizeof(DispatcherRecord) + 7) & ~7ULL;
+        header.stringsOffset = offset;
+        header.stringsSize = strings.size();
+        offset = (offset + strings.size() + 7) & ~7ULL;
+        header.archiveOffset = offset;
+        header.archiveSize = archiveBlocks.size();
+        header.unitSpeed = unitSpeed;
+        header.onSceneTime = onSceneTime;
+
+        ofstream outFile(filename, ios::binary);
+        if (!outFile) {
+            cerr << "Error opening file for writing.\n";
+            return false;
+        }
+        const char padding[8] = { 0 };
+        uint64_t written = 0;
+        outFile.write((const char*)&header, sizeof(header));
+        written += sizeof(header);
+        outFile.write((const char*)stationRecords.data(), stationRecords.size() * sizeof(StationRecord));
+        written += stationRecords.size() * sizeof(StationRecord);
+        outFile.write(padding, header.incidentOffset - written);
+        written = header.incidentOffset;
+        outFile.write((const char*)incidentRecords.data(), incidentRecords.size() * sizeof(IncidentRecord));
+        written += incidentRecords.size() * sizeof(IncidentRecord);
+        outFile.write(padding, header.dispatcherOffset - written);
+        written = header.dispatcherOffset;
+        outFile.write((const char*)dispatcherRecords.data(), dispatcherRecords.size() * sizeof(DispatcherRecord));
+        written += dispatcherRecords.size() * sizeof(DispatcherRecord);
+        outFile.write(padding, header.stringsOffset - written);
+        outFile.write(strings.data(), strings.size());
+        written = header.stringsOffset + strings.size();
+        outFile.write(padding, header.archiveOffset - written);
+        outFile.write(archiveBlocks.data(), archiveBlocks.size());
+        if (!outFile) {
+            cerr << "Error writing snapshot.\n";
+            return false;
+        }
+        outFile.close();
+        return true;
+    }
+
+    // Maps a binary snapshot and rebuilds the lists straight from its record arrays
+    bool loadSnapshot(const string& filename) {
+        MappedFile file;
+        if (!file.open(filename)) {
+            cerr << "Error opening file for reading.\n";
+            return false;
+        }
+
+        SnapshotHeader header;
+        memset(&header, 0, sizeof(header));
+        if (file.size() < SNAPSHOT_HEADER_V3_SIZE) {
+            cerr << "Snapshot is truncated.\n";
+            return false;
+        }
+        memcpy(&header, file.data(), SNAPSHOT_HEADER_V3_SIZE);
+        if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0) {
+            cerr << "Not a snapshot file.\n";
+            return false;
+        }
+        uint32_t headerSize = header.version <= 3 ? SNAPSHOT_HEADER_V3_SIZE : header.version == 4 ? SNAPSHOT_HEADER_V4_SIZE : sizeof(SnapshotHeader);
+        if (header.version < 1 || header.version > SNAPSHOT_VERSION || header.headerSize != headerSize) {
+            cerr << "Unsupported snapshot version " << header.version << ".\n";
+            return false;
+        }
+        if (file.size() < headerSize) {
+            cerr << "Snapshot is truncated.\n";
+            return false;
+        }
+        memcpy(&header, file.data(), headerSize);
+        if (header.version <= 4) {
+            header.unitSpeed = DEFAULT_UNIT_SPEED;
+            header.onSceneTime = DEFAULT_ON_SCENE_TIME;
+        }
+        if (header.unitSpeed <= 0 || header.onSceneTime < 0) {
+            cerr << "Snapshot has invalid unit timing.\n";
+            return false;
+        }
+        uint64_t size = file.size();
+        uint64_t incidentRecordSize = header.version <= 2 ? sizeof(IncidentRecordV2) : sizeof(IncidentRecord);
+        uint64_t dispatcherRecordSize = header.version == 1 ? sizeof(DispatcherRecordV1) : sizeof(DispatcherRecord);
+        if (header.stationOffset + header.stationCount * sizeof(StationRecord) > size
+            || header.incidentOffset + header.incidentCount * incidentRecordSize > size
+            || header.dispatcherOffset + header.dispatcherCount * dispatcherRecordSize > size
+            || header.stringsOffset + header.stringsSize > size
+            || header.archiveOffset + header.archiveSize > size
+            || header.stationOffset % 8 != 0 || header.incidentOffset % 8 != 0 || header.dispatcherOffset % 8 != 0) {
+            cerr << "Snapshot sections are out of bounds.\n";
+            return false;
+        }
+
+        const StationRecord* stationRecords = (const StationRecord*)(file.data() + header.stationOffset);
+        const char* incidentRecords = file.data() + header.incidentOffset;
+        const char* dispatcherRecords = file.data() + header.dispatcherOffset;
+        const char* strings = file.data() + header.stringsOffset;
+
+        clear();
+        unitSpeed = header.unitSpeed;
+        onSceneTime = header.onSceneTime;
+        stationIndex.reserve(header.stationCount);
+        incidentIndex.reserve(header.incidentCount);
+        dispatcherIndex.reserve(header.dispatcherCount);
+        stationPool.reserve(header.stationCount);
+        incidentPool.reserve(header.incidentCount);
+        dispatcherPool.reserve(header.dispatcherCount);
+        dispatcherCoords.reserve(header.dispatcherCount);
+        stationCoverage.reserve(header.stationCount);
+
+        // Records are stored head first; inserting them back to front restores list order
+        for (uint64_t i = header.stationCount; i > 0; --i) {
+            const StationRecord& r = stationRecords[i - 1];
+            if ((uint64_t)r.nameOffset + r.nameLength > header.stringsSize) {
+                cerr << "Station " << r.id << " has an invalid name reference.\n";
+                continue;
+            }
+            if (findStation(r.id) != nullptr) {
+                cout << "Station with ID " << r.id << " already exists.\n";
+                continue;
+            }
+            linkStation(Station{ r.id, r.x, r.y, string(strings + r.nameOffset, r.nameLength) }, false);
+        }
+        stationCoverage.rebuild();
+        for (uint64_t i = header.incidentCount; i > 0; --i) {
+            Incident in;
+            if (header.version <= 2) {
+                const IncidentRecordV2& r = ((const IncidentRecordV2*)incidentRecords)[i - 1];
+                in = Incident{ r.id, r.x, r.y, r.reportTime, r.responseTime, r.reportedFromStationId, r.assignedDispatcherId, SEVERITY_DEFAULT };
+            }
+            else {
+                const IncidentRecord& r = ((const IncidentRecord*)incidentRecords)[i - 1];
+                in = Incident{ r.id, r.x, r.y, r.reportTime, r.responseTime, r.reportedFromStationId, r.assignedDispatcherId, r.severity };
+                if (r.severity < SEVERITY_MINOR || r.severity > SEVERITY_CRITICAL) {
+                    cerr << "Incident " << r.id << " has an invalid severity.\n";
+                    continue;
+                }
+            }
+            if (findIncident(in.id) != nullptr) {
+                cout << "Incident with ID " << in.id << " already exists.\n";
+                continue;
+            }
+            linkIncident(in);
+        }
+        for (uint64_t i = header.dispatcherCount; i > 0; --i) {
+            Dispatcher d = Dispatcher();
+            if (header.version == 1) {
+                const DispatcherRecordV1& r = ((const DispatcherRecordV1*)dispatcherRecords)[i - 1];
+                d.id = r.id;
+                d.x = r.x;
+                d.y = r.y;
+            }
+            else {
+                const DispatcherRecord& r = ((const DispatcherRecord*)dispatcherRecords)[i - 1];
+                d = Dispatcher{ r.id, r.x, r.y, (DispatcherState)r.state, r.incidentId, r.baseX, r.baseY, r.targetX, r.targetY, r.remaining };
+                if (r.state < DISPATCHER_AVAILABLE || r.state > DISPATCHER_RETURNING) {
+                    cerr << "Dispatcher " << r.id << " has an invalid state.\n";
+                    continue;
+                }
+            }
+            if (findDispatcher(d.id) != nullptr) {
+                cout << "Dispatcher with ID " << d.id << " already exists.\n";
+                continue;
+            }
+            linkDispatcher(d);
+        }
+        if (!archive.deserialize(file.data() + header.archiveOffset, header.archiveSize)) {
+            cerr << "Snapshot archive is corrupt; archived incidents were not loaded.\n";
+            archive.clear();
+        }
+
+        if (journal.isOpen() && !replaying) {
+            compactJournal();
+        }
+        cout << "Snapshot loaded from " << filename << "\n";
+        return true;
+    }
+
+    // Reads a text state file in one go, parses it on all cores (see
+    // parseTextState) and links the records in file order. Malformed lines
+    // are reported with their line numbers and skipped.
+    void loadFromFile(const string& filename) {
+        RESCUENET_TIMED(OP_LOAD_FROM_FILE);
+        MappedFile file;
+        if (!file.open(filename)) {
+            cerr << "Error opening file for reading.\n";
+            return;
+        }
+        vector<ParsedChunk> chunks = parseTextState(file.data(), file.size());
+
+        const size_t MAX_REPORTED = 10;
+        size_t errors = 0;
+        size_t stationCount = 0, incidentCount = 0, dispatcherCount = 0, archivedCount = 0;
+        for (size_t c = 0; c < chunks.size(); ++c) {
+            for (size_t e = 0; e < chunks[c].errors.size(); ++e, ++errors) {
+                if (errors < MAX_REPORTED) {
+                    cerr << "Line " << chunks[c].errors[e].line << ": " << chunks[c].errors[e].message << ".\n";
+                }
+            }
+            stationCount += chunks[c].stations.size();
+            incidentCount += chunks[c].incidents.size();
+            dispatcherCount += chunks[c].dispatchers.size();
+            archivedCount += chunks[c].archived.size();
+        }
+        if (errors > MAX_REPORTED) {
+            cerr << "... and " << errors - MAX_REPORTED << " more malformed lines.\n";
+        }
+
+        // Clear existing data
+        clear();
+        unitSpeed = DEFAULT_UNIT_SPEED;
+        onSceneTime = DEFAULT_ON_SCENE_TIME;
+        for (size_t c = 0; c < chunks.size(); ++c) {
+            if (!chunks[c].unitTimings.empty()) {
+                unitSpeed = chunks[c].unitTimings.back().first;
+                onSceneTime = chunks[c].unitTimings.back().second;
+            }
+        }
+        stationIndex.reserve(stationCount);
+        incidentIndex.reserve(incidentCount);
+        dispatcherIndex.reserve(dispatcherCount);
+        stationPool.reserve(stationCount);
+        incidentPool.reserve(incidentCount);
+        dispatcherPool.reserve(dispatcherCount);
+        dispatcherCoords.reserve(dispatcherCount);
+        stationCoverage.reserve(stationCount);
+
+        for (size_t c = 0; c < chunks.size(); ++c) {
+            const ParsedChunk& chunk = chunks[c];
+            for (size_t i = 0; i < chunk.stations.size(); ++i) {
+                const ParsedStation& r = chunk.stations[i];
+                if (findStation(r.id) != nullptr) {
+                    cout << "Station with ID " << r.id << " already exists.\n";
+                    continue;
+                }
+                linkStation(Station{ r.id, r.x, r.y, string(r.name, r.nameLength) }, false);
+            }
+            for (size_t i = 0; i < chunk.incidents.size(); ++i) {
+                if (findIncident(chunk.incidents[i].id) != nullptr) {
+                    cout << "Incident with ID " << chunk.incidents[i].id << " already exists.\n";
+                    continue;
+                }
+                linkIncident(chunk.incidents[i], false);
+            }
+            for (size_t i = 0; i < chunk.dispatchers.size(); ++i) {
+                if (findDispatcher(chunk.dispatchers[i].id) != nullptr) {
+                    cout << "Dispatcher with ID " << chunk.dispatchers[i].id << " already exists.\n";
+                    continue;
+                }
+                linkDispatcher(chunk.dispatchers[i], false);
+            }
+        }
+        vector<DispatcherNode*> units;
+        units.reserve(dispatcherCount);
+        for (DispatcherNode* node = dispatchers; node != nullptr; node = node->next) {
+            if (node->dispatcher.state == DISPATCHER_AVAILABLE) {
+                units.push_back(node);
+            }
+        }
+        dispatcherGrid.rebuild(units);
+        stationCoverage.rebuild();
+        vector<TimeEntry> times;
+        vector<IncidentNode*> waiting;
+        times.reserve(incidentCount);
+        for (IncidentNode* node = incidents; node != nullptr; node = node->next) {
+            times.push_back(TimeIndex::entryFor(node));
+            if (node->incident.assignedDispatcherId == -1) {
+                waiting.push_back(node);
+            }
+        }
+        incidentTimes.build(times);
+        triage.build(waiting);
+        vector<Incident> archived;
+        archived.reserve(archivedCount);
+        for (size_t c = 0; c < chunks.size(); ++c) {
+            archived.insert(archived.end(), chunks[c].archived.begin(), chunks[c].archived.end());
+        }
+        archive.append(archived);
+
+        if (journal.isOpen()) {
+            compactJournal();
+        }
+        cout << "Data loaded from " << filename << "\n";
+    }
+};
+
+// An incident waiting for its shard's worker
+struct ShardTask {
+    int id, x, y;
+    int reportTime, responseTime;
+    int severity;
+};
+
+// Counters of a ShardedManager since it was created
+struct ShardedMetrics {
+    uint64_t submitted;     // Incidents accepted for a shard
+    uint64_t assigned;      // Got a dispatcher
+    uint64_t unassigned;    // Still waiting: no dispatcher was available anywhere
+    uint64_t rejected;      // Duplicate incident ID
+    uint64_t spilled;       // Searches that had to look past the home shard
+    uint64_t remote;        // Units sent from a shard other than the incident's
+};
+
+// Splits the plane into vertical strips at fixed x positions and gives each
+// strip its own EmergencyManager and worker thread. A record lives in the
+// shard whose strip holds its x coordinate, and units stay in their shard
+// for good since they always return to base.
+//
+// An incident is added and assigned by its home shard's worker. The home
+// shard is searched first; the strip next door can only hold a closer unit
+// if the horizontal gap to it is no larger than the best distance found, so
+// the search takes in more strips only in that case, which is rare while
+// strips are much wider than the typical unit spacing. Each shard has a
+// mutex and several are always locked in strip order, so workers only wait
+// for each other near boundaries and throughput grows with the shard count
+// up to the number of cores.
+//
+// One thread submits incidents and adds stations and dispatchers; only the
+// workers touch the shards in between. The result matches a single manager
+// with the same records: closest available unit by Manhattan distance, ties
+// to the lower ID. Road networks and journals are not used by shards.
+class ShardedManager {
+private:
+    struct Shard {
+        EmergencyManager manager;
+        mutex lock;                     // Held while the manager is read or changed
+        MpmcRing<ShardTask> queue;
+        thread worker;
+        atomic<uint64_t> submitted, processed;
+
+        explicit Shard(size_t capacity) : queue(capacity), submitted(0), processed(0) {}
+    };
+
+    vector<int> splits;                 // Strip i covers [splits[i - 1], splits[i])
+    vector<Shard*> shards;
+    OpenHashMap<int> incidentShard;     // Incident ID -> shard, used by the submitting thread only
+    OpenHashMap<int> dispatcherShard;
+    OpenHashMap<int> stationShard;
+    atomic<bool> stopping;
+    atomic<uint64_t> assigned, unassigned, rejected, spilled, remote;
+
+    size_t shardOf(int x) const {
+        return upper_bound(splits.begin(), splits.end(), x) - splits.begin();
+    }
+
+    // Smallest Manhattan distance from a point with this x to strip i
+    long long gapTo(size_t i, int x) const {
+        if (i > 0 && x < splits[i - 1]) {
+            return (long long)splits[i - 1] - x;
+        }
+        if (i < splits.size() && x >= splits[i]) {
+            return (long long)x - splits[i] + 1;
+        }
+        return 0;
+    }
+
+    // Assigns the closest available unit in any shard to an incident held by
+    // shard home and returns its ID, or -1 if every unit is busy. Starts
+    // with the home shard alone and widens to a range of strips, in strip
+    // order, until no strip outside the range can beat the best unit in it.
+    int assignNearest(size_t home, int incidentId, int x, int y) {
+        size_t lo = home, hi = home;
+        while (true) {
+            for (size_t i = lo; i <= hi; ++i) {
+                shards[i]->lock.lock();
+            }
+            int bestId = -1;
+            int bestDistance = INT_MAX;
+            size_t bestShard = home;
+            for (size_t i = lo; i <= hi; ++i) {
+                int distance;
+                int id = shards[i]->manager.nearestAvailable(x, y, &distance);
+                if (id != -1 && (distance < bestDistance || (distance == bestDistance && id < bestId))) {
+                    bestId = id;
+                    bestDistance = distance;
+                    bestShard = i;
+                }
+            }
+            size_t needLo = lo, needHi = hi;
+            while (needLo > 0 && gapTo(needLo - 1, x) <= bestDistance) {
+                --needLo;
+            }
+            while (needHi + 1 < shards.size() && gapTo(needHi + 1, x) <= bestDistance) {
+                ++needHi;
+            }
+            bool settled = needLo == lo && needHi == hi;
+            if (settled && bestId != -1) {
+                shards[bestShard]->manager.sendAvailableUnit(bestId, incidentId, x, y);
+                shards[home]->manager.recordAssignment(incidentId, bestId);
+            }
+            for (size_t i = lo; i <= hi; ++i) {
+                shards[i]->lock.unlock();
+            }
+            if (settled) {
+                if (hi > lo) {
+                    spilled.fetch_add(1, memory_order_relaxed);
+                }
+                if (bestId != -1 && bestShard != home) {
+                    remote.fetch_add(1, memory_order_relaxed);
+                }
+                return bestId;
+            }
+            lo = needLo;
+            hi = needHi;
+        }
+    }
+
+    void process(size_t home, const ShardTask& task) {
+        {
+            lock_guard<mutex> guard(shards[home]->lock);
+            shards[home]->manager.addIncident(task.id, task.x, task.y, task.reportTime, task.responseTime, task.severity);
+        }
+        if (assignNearest(home, task.id, task.x, task.y) != -1) {
+            assigned.fetch_add(1, memory_order_relaxed);
+        }
+        else {
+            unassigned.fetch_add(1, memory_order_relaxed);
+        }
     }
 
-public:
-    EmergencyManager() : stations(nullptr), incidents(nullptr), dispatchers(nullptr) {}
-
-    ~EmergencyManager() {
-        StationNode* currentStation = stations;
-        while (currentStation != nullptr) {
-            StationNode* nextStation = currentStation->next;
-            delete currentStation;
-            currentStation = nextStation;
+    // Hands free units to incidents left waiting, most urgent first across
+    // all shards, in the order one manager's dispatchNext would. Stops once
+    // no unit is free anywhere. Only called while the workers are idle.
+    int assignWaiting() {
+        int count = 0;
+        while (true) {
+            size_t best = shards.size();
+            Incident next = Incident();
+            for (size_t i = 0; i < shards.size(); ++i) {
+                lock_guard<mutex> guard(shards[i]->lock);
+                const Incident* waiting = shards[i]->manager.nextWaiting();
+                if (waiting != nullptr && (best == shards.size() || TriageQueue::moreUrgent(*waiting, next))) {
+                    best = i;
+                    next = *waiting;
+                }
+            }
+            if (best == shards.size() || assignNearest(best, next.id, next.x, next.y) == -1) {
+                return count;
+            }
+            assigned.fetch_add(1, memory_order_relaxed);
+            unassigned.fetch_sub(1, memory_order_relaxed);
+            ++count;
         }
+    }
 
-        IncidentNode* currentIncident = incidents;
-        while (currentIncident != nullptr) {
-            IncidentNode* nextIncident = currentIncident->next;
-            delete currentIncident;
-            currentIncident = nextIncident;
+    void worker(size_t home) {
+        Shard* shard = shards[home];
+        ShardTask task;
+        int idle = 0;
+        while (true) {
+            if (shard->queue.tryPop(task)) {
+                process(home, task);
+                shard->processed.fetch_add(1, memory_order_release);
+                idle = 0;
+                continue;
+            }
+            if (stopping.load(memory_order_acquire)) {
+                if (!shard->queue.tryPop(task)) {
+                    break;
+                }
+                process(home, task);
+                shard->processed.fetch_add(1, memory_order_release);
+                continue;
+            }
+            if (++idle < 64) {
+                this_thread::yield();
+            }
+            else {
+                this_thread::sleep_for(chrono::microseconds(50));
+            }
         }
+    }
 
-        DispatcherNode* currentDispatcher = dispatchers;
-        while (currentDispatcher != nullptr) {
-            DispatcherNode* nextDispatcher = currentDispatcher->next;
-            delete currentDispatcher;
-            currentDispatcher = nextDispatcher;
+public:
+    // splits must be ascending; there is one shard more than split points
+    explicit ShardedManager(const vector<int>& splitPoints, size_t queueCapacity = 65536)
+        : splits(splitPoints), stopping(false), assigned(0), unassigned(0), rejected(0), spilled(0), remote(0) {
+        sort(splits.begin(), splits.end());
+        splits.erase(unique(splits.begin(), splits.end()), splits.end());
+        for (size_t i = 0; i <= splits.size(); ++i) {
+            shards.push_back(new Shard(queueCapacity));
+        }
+        for (size_t i = 0; i < shards.size(); ++i) {
+            shards[i]->worker = thread(&ShardedManager::worker, this, i);
         }
     }
 
-    void addStation(int id, int x, int y, const string& name) {
-        StationNode* newNode = new StationNode{ {id, x, y, name}, stations };
-        stations = newNode;
+    ~ShardedManager() {
+        stop();
+        for (size_t i = 0; i < shards.size(); ++i) {
+            delete shards[i];
+        }
     }
 
-    void addIncident(int id, int x, int y, int reportTime, int responseTime) {
-        IncidentNode* newNode = new IncidentNode{ {id, x, y, reportTime, responseTime, -1}, incidents };
-        incidents = newNode;
+    ShardedManager(const ShardedManager&) = delete;
+    ShardedManager& operator=(const ShardedManager&) = delete;
+
+    // Split points that give each of shardCount strips about the same
+    // number of the given x coordinates
+    static vector<int> balancedSplits(vector<int> xs, size_t shardCount) {
+        vector<int> result;
+        if (xs.empty() || shardCount < 2) {
+            return result;
+        }
+        for (size_t i = 1; i < shardCount; ++i) {
+            size_t rank = xs.size() * i / shardCount;
+            nth_element(xs.begin(), xs.begin() + rank, xs.end());
+            result.push_back(xs[rank]);
+        }
+        sort(result.begin(), result.end());
+        return result;
     }
 
-    void addDispatcher(int id, int x, int y) {
-        DispatcherNode* newNode = new DispatcherNode{ {id, x, y}, dispatchers };
-        dispatchers = newNode;
+    size_t shardCount() const {
+        return shards.size();
     }
 
-    void printLocations() {
-        cout << "Stations:\n";
-        StationNode* currentStation = stations;
-        while (currentStation != nullptr) {
-            currentStation->station.printDetails();
-            currentStation = currentStation->next;
+    bool addStation(int id, int x, int y, const string& name) {
+        if (stationShard.find(id) != nullptr) {
+            cout << "Station with ID " << id << " already exists.\n";
+            return false;
         }
+        size_t home = shardOf(x);
+        lock_guard<mutex> guard(shards[home]->lock);
+        stationShard.insert(id, (int)home);
+        return shards[home]->manager.addStation(id, x, y, name);
+    }
 
-        cout << "Incidents:\n";
-        IncidentNode* currentIncident = incidents;
-        while (currentIncident != nullptr) {
-            cout << "ID: " << currentIncident->incident.id << ", Coordinates: (" << currentIncident->incident.x << ", " << currentIncident->incident.y << ")" << endl;
-            currentIncident = currentIncident->next;
+    bool addDispatcher(int id, int x, int y) {
+        if (dispatcherShard.find(id) != nullptr) {
+            cout << "Dispatcher with ID " << id << " already exists.\n";
+            return false;
         }
+        size_t home = shardOf(x);
+        lock_guard<mutex> guard(shards[home]->lock);
+        dispatcherShard.insert(id, (int)home);
+        return shards[home]->manager.addDispatcher(id, x, y);
+    }
 
-        cout << "Dispatchers:\n";
-        DispatcherNode* currentDispatcher = dispatchers;
-        while (currentDispatcher != nullptr) {
-            cout << "ID: " << currentDispatcher->dispatcher.id << ", Coordinates: (" << currentDispatcher->dispatcher.x << ", " << currentDispatcher->dispatcher.y << ")" << endl;
-            currentDispatcher = currentDispatcher->next;
+    // Queues an incident for its home shard, waiting while that queue is full
+    bool submitIncident(int id, int x, int y, int reportTime, int responseTime, int severity = SEVERITY_DEFAULT) {
+        if (stopping.load(memory_order_relaxed)) {
+            cout << "Sharded manager is stopped.\n";
+            return false;
+        }
+        if (incidentShard.find(id) != nullptr) {
+            rejected.fetch_add(1, memory_order_relaxed);
+            cout << "Incident with ID " << id << " already exists.\n";
+            return false;
+        }
+        if (severity < SEVERITY_MINOR || severity > SEVERITY_CRITICAL) {
+            cout << "Severity must be between " << SEVERITY_MINOR << " and " << SEVERITY_CRITICAL << ".\n";
+            return false;
+        }
+        size_t home = shardOf(x);
+        incidentShard.insert(id, (int)home);
+        ShardTask task{ id, x, y, reportTime, responseTime, severity };
+        while (!shards[home]->queue.tryPush(task)) {
+            this_thread::yield();
         }
+        shards[home]->submitted.fetch_add(1, memory_order_relaxed);
+        return true;
     }
 
-    void displayMap() {
-        cout << "Visual Representation:\n";
-        for (int i = 0; i < 5; ++i) {
-            for (int j = 0; j < 5; ++j) {
-                bool found = false;
-
-                // Check stations
-                StationNode* currentStation = stations;
-                while (currentStation != nullptr) {
-                    if (currentStation->station.x == i && currentStation->station.y == j) {
-                        cout << "S ";
-                        found = true;
-                        break;
-                    }
-                    currentStation = currentStation->next;
-                }
-
-                // Check incidents if no station found
-                if (!found) {
-                    IncidentNode* currentIncident = incidents;
-                    while (currentIncident != nullptr) {
-                        if (currentIncident->incident.x == i && currentIncident->incident.y == j) {
-                            cout << "I ";
-                            found = true;
-                            break;
-                        }
-                        currentIncident = currentIncident->next;
-                    }
-                }
-
-                // Empty space
-                if (!found) {
-                    cout << ". ";
-                }
+    // Waits until every submitted incident has been handled
+    void drain() {
+        for (size_t i = 0; i < shards.size(); ++i) {
+            while (shards[i]->processed.load(memory_order_acquire) < shards[i]->submitted.load(memory_order_relaxed)) {
+                this_thread::yield();
             }
-            cout << endl;
         }
     }
 
-    int calculateShortestDistanceToStation(int incidentId) {
-        // Find the incident
-        IncidentNode* incidentNode = incidents;
-        while (incidentNode != nullptr && incidentNode->incident.id != incidentId) {
-            incidentNode = incidentNode->next;
+    // Moves every shard's busy units forward; see EmergencyManager::advanceTime.
+    // Units that come back are sent on to incidents that found none free.
+    int advanceTime(int time) {
+        drain();
+        int returned = 0;
+        for (size_t i = 0; i < shards.size(); ++i) {
+            lock_guard<mutex> guard(shards[i]->lock);
+            returned += shards[i]->manager.advanceTime(time);
         }
-        if (incidentNode == nullptr) {
-            cout << "Incident with ID " << incidentId << " not found.\n";
-            return -1;
+        if (returned > 0) {
+            assignWaiting();
         }
+        return returned;
+    }
 
-        // Find the reporting station
-        StationNode* stationNode = stations;
-        while (stationNode != nullptr && stationNode->station.id != incidentNode->incident.reportedFromStationId) {
-            stationNode = stationNode->next;
+    size_t availableDispatchers() {
+        size_t total = 0;
+        for (size_t i = 0; i < shards.size(); ++i) {
+            lock_guard<mutex> guard(shards[i]->lock);
+            total += shards[i]->manager.availableDispatchers();
         }
-        if (stationNode == nullptr) {
-            cout << "Station with ID " << incidentNode->incident.reportedFromStationId << " not found.\n";
+        return total;
+    }
+
+    // The dispatcher assigned to an incident, -1 while unassigned or unknown
+    int assignedDispatcher(int incidentId) {
+        drain();
+        int* home = incidentShard.find(incidentId);
+        if (home == nullptr) {
             return -1;
         }
-
-        return calculateShortestDistance(incidentNode->incident.x, incidentNode->incident.y, stationNode->station.x, stationNode->station.y);
+        lock_guard<mutex> guard(shards[*home]->lock);
+        return shards[*home]->manager.assignedDispatcher(incidentId);
     }
 
-    void assignDispatcher(int incidentId) {
-        // Find the incident
-        IncidentNode* incidentNode = incidents;
-        while (incidentNode != nullptr && incidentNode->incident.id != incidentId) {
-            incidentNode = incidentNode->next;
+    ShardedMetrics metrics() const {
+        ShardedMetrics m = ShardedMetrics();
+        for (size_t i = 0; i < shards.size(); ++i) {
+            m.submitted += shards[i]->submitted.load(memory_order_relaxed);
         }
-        if (incidentNode == nullptr) {
-            cout << "Incident with ID " << incidentId << " not found.\n";
+        m.assigned = assigned.load(memory_order_relaxed);
+        m.unassigned = unassigned.load(memory_order_relaxed);
+        m.rejected = rejected.load(memory_order_relaxed);
+        m.spilled = spilled.load(memory_order_relaxed);
+        m.remote = remote.load(memory_order_relaxed);
+        return m;
+    }
+
+    // Lets the workers finish their queues and joins them; nothing can be
+    // submitted afterwards
+    void stop() {
+        if (stopping.exchange(true)) {
             return;
         }
+        for (size_t i = 0; i < shards.size(); ++i) {
+            shards[i]->worker.join();
+        }
+    }
+};
 
-        int minDistance = INT_MAX;
-        DispatcherNode* closestDispatcher = nullptr;
-        DispatcherNode* dispatcherNode = dispatchers;
-        while (dispatcherNode != nullptr) {
-            int distance = calculateShortestDistance(incidentNode->incident.x, incidentNode->incident.y, dispatcherNode->dispatcher.x, dispatcherNode->dispatcher.y);
-            if (distance < minDistance) {
-                minDistance = distance;
-                closestDispatcher = dispatcherNode;
-            }
-            dispatcherNode = dispatcherNode->next;
+// Output buffer for batch mode: collects results and hands them to the
+// underlying FILE in large writes instead of one write per line
+class ChunkedOutput : public streambuf {
+private:
+    vector<char> buffer;
+    FILE* sink;
+
+    void drain() {
+        size_t used = pptr() - pbase();
+        if (used > 0) {
+            fwrite(pbase(), 1, used, sink);
         }
+        setp(buffer.data(), buffer.data() + buffer.size());
+    }
 
-        if (closestDispatcher == nullptr) {
-            cout << "No available dispatchers.\n";
-            return;
+protected:
+    int overflow(int ch) override {
+        drain();
+        if (ch != EOF) {
+            *pptr() = (char)ch;
+            pbump(1);
         }
+        return ch;
+    }
 
-        cout << "Incident assigned to dispatcher ID " << closestDispatcher->dispatcher.id << ".\n";
+    int sync() override {
+        drain();
+        fflush(sink);
+        return 0;
     }
 
-    void reportIncident(int incidentId) {
-        // Find the incident
-        IncidentNode* incidentNode = incidents;
-        while (incidentNode != nullptr && incidentNode->incident.id != incidentId) {
-            incidentNode = incidentNode->next;
-        }
-        if (incidentNode == nullptr) {
-            cout << "Incident with ID " << incidentId << " not found.\n";
-            return;
-        }
+public:
+    explicit ChunkedOutput(FILE* sink, size_t size = 1 << 20) : buffer(size), sink(sink) {
+        setp(buffer.data(), buffer.data() + buffer.size());
+    }
 
-        // Select a station
-        cout << "Select a station:\n";
-        StationNode* stationNode = stations;
-        int index = 1;
-        while (stationNode != nullptr) {
-            cout << index++ << ". " << stationNode->station.name << endl;
-            stationNode = stationNode->next;
-        }
+    ~ChunkedOutput() override {
+        sync();
+    }
+};
 
-        int stationIndex;
-        cout << "Enter station index: ";
-        cin >> stationIndex;
+// One line: ID, state, position, and the incident while busy
+void printDispatcherStatus(const Dispatcher& d) {
+    cout << "U " << d.id << " " << DISPATCHER_STATE_NAMES[d.state] << " " << d.x << " " << d.y;
+    if (d.state != DISPATCHER_AVAILABLE) {
+        cout << " incident " << d.incidentId;
+    }
+    cout << "\n";
+}
 
-        stationNode = stations;
-        for (int i = 1; i < stationIndex && stationNode != nullptr; ++i) {
-            stationNode = stationNode->next;
-        }
+// One line: matches, response times and matches per severity
+void printArchiveSummary(const ArchiveSummary& summary) {
+    cout << "q incidents " << summary.incidents << " mean_response " << summary.meanResponse << " max_response " << summary.maxResponse
+        << " blocks " << summary.blocksScanned << " skipped " << summary.blocksSkipped << " severity";
+    for (int s = SEVERITY_MINOR; s <= SEVERITY_CRITICAL; ++s) {
+        cout << " " << summary.bySeverity[s];
+    }
+    cout << "\n";
+}
 
-        if (stationNode == nullptr) {
-            cout << "Invalid station index.\n";
-            return;
-        }
+// One line: the plan's measures, then each position as x:y:incidents
+void printStagingPlan(const StagingPlan& plan) {
+    cout << "p " << plan.points.size() << " incidents " << plan.incidents << " cells " << plan.cells << " cell_size " << plan.cellSize
+        << " expected " << plan.expectedDistance << " current " << plan.currentDistance << " rounds " << plan.iterations
+        << " seconds " << plan.seconds << " staging";
+    for (size_t i = 0; i < plan.points.size(); ++i) {
+        cout << " " << plan.points[i].x << ":" << plan.points[i].y << ":" << plan.points[i].incidents;
+    }
+    cout << "\n";
+}
 
-        incidentNode->incident.reportedFromStationId = stationNode->station.id;
-        cout << "Incident reported from station ID " << stationNode->station.id << ".\n";
+void printHotspots(const vector<HotspotCell>& cells) {
+    cout << "y " << cells.size();
+    for (size_t i = 0; i < cells.size(); ++i) {
+        cout << " " << cells[i].x << ":" << cells[i].y << ":" << cells[i].incidents;
     }
+    cout << "\n";
+}
 
-    void autoAddCustomerAssignIncident() {
-        addStation(1, 0, 0, "Central");
-        addIncident(1, 3, 3, 12, 13);
+// One line: the command letter and window, then the matching incident IDs
+void printIncidentIds(char op, int from, int to, const vector<int>& ids) {
+    cout << op << " " << from << " " << to;
+    for (size_t i = 0; i < ids.size(); ++i) {
+        cout << " " << ids[i];
+    }
+    cout << "\n";
+}
 
-        reportIncident(1);
-        assignDispatcher(1);
+void printIntakeMetrics(const IntakeMetrics& m) {
+    cout << "Q submitted=" << m.submitted << " processed=" << m.processed << " assigned=" << m.assigned
+        << " unassigned=" << m.unassigned << " rejected=" << m.rejected << " full_waits=" << m.fullWaits
+        << " depth=" << m.depth << " max_depth=" << m.maxDepth << " seconds=" << m.seconds
+        << " per_second=" << m.throughput << "\n";
+}
 
-        int shortestDistance = calculateShortestDistanceToStation(1);
-        if (shortestDistance != -1) {
-            cout << "Shortest distance to station for incident with ID 1 is: " << shortestDistance << endl;
+// Executes one batch command line; returns false if it is malformed.
+//   S id x y name        add station          W file   save text state
+//   I id x y rep resp    add incident         L file   load text state
+//   D id x y             add dispatcher       w file   save binary snapshot
+//   R incident station   report from station  l file   load binary snapshot
+//   A incident           assign dispatcher    G file   load road network
+//   N incident k         k nearest units      J snap journal   enable journal
+//   C incident           distance to station  K        compact journal
+//   B                    batch assign         P [filter]   print locations
+//   M [x y rows cols zoom]  display map       # ...    comment
+//   T workers            start intake         X id x y rep resp station   submit to intake
+//   Q                    intake metrics       t        stop intake
+//   Z units speed [count gap service seed]    simulate, optionally with a synthetic surge
+//   H                    print metrics        h file   export metrics (Prometheus text)
+//   F from to            incidents reported in [from, to]
+//   c incident           closest station and its distance
+//   V time               advance busy units   U id     dispatcher state
+//   u speed scene        unit travel speed and on-scene time
+//   O from [to]          incidents open at time from, or at any point in [from, to]
+//   n                    dispatch the most urgent waiting incident
+//   E incident severity  change severity (1 minor .. 5 critical); I and X
+//                        take the same as an optional last field
+//   a time               archive incidents resolved before time
+//   q from to [x0 y0 x1 y1]  summary of archived incidents reported in [from, to]
+//   d filter file        write the selected state in the text format, to stdout for -
+//                        a filter is kinds [x0 y0 x1 y1], kinds being * or letters of
+//                        sida (stations, incidents, dispatchers, archived)
+//   p k from to [period [cell]]      k dispatcher staging positions for incidents reported
+//                        in [from, to], taken modulo period when given
+//   y count from to [period [cell]]  the count cells with the most incidents
+// While intake runs its workers own the manager's state, so only the intake
+// commands, metrics and comments are accepted until t stops it.
+bool runCommand(EmergencyManager& manager, const char* p, const char* end) {
+    char op = *p++;
+    int a, b, c, d, e;
+    if (manager.intakeRunning() && (op == '\0' || strchr("TXQtHh#", op) == nullptr)) {
+        cout << "Cannot run " << op << " while intake is running.\n";
+        return true;
+    }
+    switch (op) {
+    case 'S':
+        if (!nextInt(p, end, a) || !nextInt(p, end, b) || !nextInt(p, end, c)) {
+            return false;
+        }
+        manager.addStation(a, b, c, restOfLine(p, end));
+        return true;
+    case 'I': {
+        int severity = SEVERITY_DEFAULT;
+        if (!nextInt(p, end, a) || !nextInt(p, end, b) || !nextInt(p, end, c) || !nextInt(p, end, d) || !nextInt(p, end, e)) {
+            return false;
         }
+        if (!onlySpaces(p, end) && !nextInt(p, end, severity)) {
+            return false;
+        }
+        manager.addIncident(a, b, c, d, e, severity);
+        return true;
     }
-
-    void saveToFile(const string& filename) {
-        ofstream outFile(filename);
-        if (!outFile) {
-            cerr << "Error opening file for writing.\n";
-            return;
+    case 'D':
+        if (!nextInt(p, end, a) || !nextInt(p, end, b) || !nextInt(p, end, c)) {
+            return false;
         }
-
-        outFile << "Stations:\n";
-        StationNode* stationNode = stations;
-        while (stationNode != nullptr) {
-            outFile << stationNode->station.id << " " << stationNode->station.x << " " << stationNode->station.y << " " << stationNode->station.name << "\n";
-            stationNode = stationNode->next;
+        manager.addDispatcher(a, b, c);
+        return true;
+    case 'R':
+        if (!nextInt(p, end, a) || !nextInt(p, end, b)) {
+            return false;
         }
-
-        outFile << "Incidents:\n";
-        IncidentNode* incidentNode = incidents;
-        while (incidentNode != nullptr) {
-            outFile << incidentNode->incident.id << " " << incidentNode->incident.x << " " << incidentNode->incident.y << " "
-                << incidentNode->incident.reportTime << " " << incidentNode->incident.responseTime << " "
-                << incidentNode->incident.reportedFromStationId << "\n";
-            incidentNode = incidentNode->next;
+        manager.reportIncident(a, b);
+        return true;
+    case 'A':
+        if (!nextInt(p, end, a)) {
+            return false;
         }
-
-        outFile << "Dispatchers:\n";
-        DispatcherNode* dispatcherNode = dispatchers;
-        while (dispatcherNode != nullptr) {
-            outFile << dispatcherNode->dispatcher.id << " " << dispatcherNode->dispatcher.x << " " << dispatcherNode->dispatcher.y << "\n";
-            dispatcherNode = dispatcherNode->next;
+        manager.assignDispatcher(a);
+        return true;
+    case 'N': {
+        if (!nextInt(p, end, a) || !nextInt(p, end, b)) {
+            return false;
         }
-
-        outFile.close();
-        cout << "Data saved to " << filename << endl;
+        vector<pair<int, int>> ranked = manager.kNearestDispatchers(a, b);
+        cout << "N " << a;
+        for (size_t i = 0; i < ranked.size(); ++i) {
+            cout << " " << ranked[i].first << ":" << ranked[i].second;
+        }
+        cout << "\n";
+        return true;
+    }
+    case 'C':
+        if (!nextInt(p, end, a)) {
+            return false;
+        }
+        b = manager.calculateShortestDistanceToStation(a);
+        if (b != -1) {
+            cout << "C " << a << " " << b << "\n";
+        }
+        return true;
+    case 'B':
+        manager.assignPendingBatch();
+        return true;
+    case 'P': {
+        OutputFilter filter = OUTPUT_EVERYTHING;
+        if (!onlySpaces(p, end) && !nextOutputFilter(p, end, filter)) {
+            return false;
+        }
+        manager.printLocations(filter);
+        return true;
+    }
+    case 'M': {
+        int rows = 5, cols = 5, zoom = 1;
+        a = 0;
+        b = 0;
+        if (nextInt(p, end, a) && (!nextInt(p, end, b) || !nextInt(p, end, rows) || !nextInt(p, end, cols) || !nextInt(p, end, zoom))) {
+            return false;
+        }
+        manager.displayMap(a, b, rows, cols, zoom);
+        return true;
     }
+    case 'W':
+        manager.saveToFile(restOfLine(p, end));
+        return true;
+    case 'L':
+        manager.loadFromFile(restOfLine(p, end));
+        return true;
+    case 'w':
+        manager.saveSnapshot(restOfLine(p, end));
+        return true;
+    case 'l':
+        manager.loadSnapshot(restOfLine(p, end));
+        return true;
+    case 'G':
+        manager.loadRoadNetwork(restOfLine(p, end));
+        return true;
+    case 'J': {
+        string files = restOfLine(p, end);
+        size_t split = files.find(' ');
+        if (split == string::npos) {
+            return false;
+        }
+        manager.enableJournal(files.substr(0, split), restOfLine(files.c_str() + split, files.c_str() + files.size()));
+        return true;
+    }
+    case 'K':
+        manager.compactJournal();
+        return true;
+    case 'T':
+        if (!nextInt(p, end, a)) {
+            return false;
+        }
+        manager.startIntake(a);
+        return true;
+    case 'X': {
+        int station, severity = SEVERITY_DEFAULT;
+        if (!nextInt(p, end, a) || !nextInt(p, end, b) || !nextInt(p, end, c) || !nextInt(p, end, d) || !nextInt(p, end, e) || !nextInt(p, end, station)) {
+            return false;
+        }
+        if (!onlySpaces(p, end) && !nextInt(p, end, severity)) {
+            return false;
+        }
+        manager.submitIncident(a, b, c, d, e, station, severity);
+        return true;
+    }
+    case 'Q':
+        printIntakeMetrics(manager.intakeMetrics());
+        return true;
+    case 't':
+        printIntakeMetrics(manager.stopIntake());
+        return true;
+    case 'Z': {
+        double speed, gap = 1.0, service = 10.0;
+        int count = 0, seed = 1;
+        istringstream iss(string(p, end));
+        if (!(iss >> a >> speed) || a < 0) {
+            return false;
+        }
+        iss >> count >> gap >> service >> seed;
+        manager.simulate((size_t)a, speed, (size_t)max(count, 0), gap, service, (unsigned)seed);
+        return true;
+    }
+    case 'H':
+        manager.printMetrics();
+        return true;
+    case 'h':
+        manager.exportMetrics(restOfLine(p, end));
+        return true;
+    case 'c':
+        if (!nextInt(p, end, a)) {
+            return false;
+        }
+        b = manager.closestStation(a, &c);
+        if (b != -1) {
+            cout << "c " << a << " " << b << " " << c << "\n";
+        }
+        return true;
+    case 'V':
+        if (!nextInt(p, end, a)) {
+            return false;
+        }
+        b = manager.advanceTime(a);
+        cout << "V " << a << " returned " << b << " available " << manager.availableDispatchers() << "\n";
+        return true;
+    case 'U': {
+        if (!nextInt(p, end, a)) {
+            return false;
+        }
+        const Dispatcher* d = manager.dispatcherStatus(a);
+        if (d != nullptr) {
+            printDispatcherStatus(*d);
+        }
+        return true;
+    }
+    case 'u':
+        if (!nextInt(p, end, a) || !nextInt(p, end, b)) {
+            return false;
+        }
+        manager.setUnitTiming(a, b);
+        return true;
+    case 'F':
+        if (!nextInt(p, end, a) || !nextInt(p, end, b)) {
+            return false;
+        }
+        printIncidentIds('F', a, b, manager.incidentsReportedBetween(a, b));
+        return true;
+    case 'O':
+        if (!nextInt(p, end, a)) {
+            return false;
+        }
+        if (!nextInt(p, end, b)) {
+            b = a;
+        }
+        printIncidentIds('O', a, b, manager.incidentsOpenDuring(a, b));
+        return true;
+    case 'n':
+        a = manager.dispatchNext();
+        if (a != -1) {
+            cout << "n " << a << "\n";
+        }
+        return true;
+    case 'E':
+        if (!nextInt(p, end, a) || !nextInt(p, end, b)) {
+            return false;
+        }
+        manager.setSeverity(a, b);
+        return true;
+    case 'a': {
+        if (!nextInt(p, end, a)) {
+            return false;
+        }
+        size_t moved = manager.archiveResolved(a);
+        cout << "a " << a << " archived " << moved << " total " << manager.archivedIncidents() << " bytes " << manager.archiveBytes() << "\n";
+        return true;
+    }
+    case 'q': {
+        ArchiveQuery query{ INT_MIN, INT_MAX, INT_MIN, INT_MIN, INT_MAX, INT_MAX };
+        if (!nextInt(p, end, query.fromTime) || !nextInt(p, end, query.toTime)) {
+            return false;
+        }
+        if (!onlySpaces(p, end) && (!nextInt(p, end, query.minX) || !nextInt(p, end, query.minY) || !nextInt(p, end, query.maxX) || !nextInt(p, end, query.maxY))) {
+            return false;
+        }
+        printArchiveSummary(manager.queryArchive(query));
+        return true;
+    }
+    case 'd': {
+        OutputFilter filter;
+        if (!nextOutputFilter(p, end, filter)) {
+            return false;
+        }
+        string target = restOfLine(p, end);
+        if (target.empty()) {
+            return false;
+        }
+        manager.dumpState(target, filter);
+        return true;
+    }
+    case 'p':
+    case 'y': {
+        HotspotOptions options;
+        if (!nextInt(p, end, a) || a <= 0 || !nextHotspotOptions(p, end, options)) {
+            return false;
+        }
+        if (op == 'p') {
+            StagingPlan plan;
+            if (manager.planStaging((size_t)a, options, plan)) {
+                printStagingPlan(plan);
+            }
+        }
+        else {
+            vector<HotspotCell> cells;
+            if (manager.incidentHotspots((size_t)a, options, cells)) {
+                printHotspots(cells);
+            }
+        }
+        return true;
+    }
+    case '#':
+        return true;
+    default:
+        return false;
+    }
+}
 
-    void loadFromFile(const string& filename) {
-        ifstream inFile(filename);
-        if (!inFile) {
-            cerr << "Error opening file for reading.\n";
-            return;
+// Reads what is available, up to size bytes: a file fills the request, a
+// pipe returns whatever has arrived. Returns 0 at the end, -1 on error.
+long long readAvailable(int fd, char* p, size_t size) {
+    while (true) {
+#ifdef _WIN32
+        long long got = _read(fd, p, (unsigned)min(size, (size_t)INT_MAX));
+#else
+        long long got = ::read(fd, p, size);
+#endif
+        if (got >= 0 || errno != EINTR) {
+            return got;
         }
+    }
+}
 
-        // Clear existing data
-        this->~EmergencyManager();
+// Runs commands from a file, or from stdin when the name is "-", with no
+// menus or prompts. Input is read in chunks of up to 1 MiB but each read
+// takes what is there, so a live pipe is processed as it arrives; output
+// is buffered and written in large blocks, and flushed whenever the input
+// runs dry so replies to piped commands are not held back.
+int runBatch(EmergencyManager& manager, const string& source) {
+#ifdef _WIN32
+    int in = source == "-" ? _fileno(stdin) : _open(source.c_str(), _O_RDONLY | _O_BINARY);
+#else
+    int in = source == "-" ? STDIN_FILENO : ::open(source.c_str(), O_RDONLY);
+#endif
+    if (in < 0) {
+        cerr << "Error opening batch file " << source << ".\n";
+        return 1;
+    }
+#ifdef _WIN32
+    if (source == "-") {
+        _setmode(in, _O_BINARY);
+    }
+#endif
 
-        string line;
+    ios::sync_with_stdio(false);
+    ChunkedOutput output(stdout);
+    streambuf* console = cout.rdbuf(&output);
 
-        // Load stations
-        getline(inFile, line);  // Skip "Stations:"
-        while (getline(inFile, line) && !line.empty()) {
-            int id, x, y;
-            string name;
-            istringstream iss(line);
-            iss >> id >> x >> y;
-            getline(iss, name);
-            addStation(id, x, y, name.substr(1));  // Skip leading space
+    const size_t CHUNK = 1 << 20;
+    vector<char> buffer(CHUNK);
+    size_t carried = 0;   // Bytes of an incomplete line kept from the previous chunk
+    long long lineNumber = 0;
+    long long failures = 0;
+    while (true) {
+        if (carried == buffer.size()) {
+            buffer.resize(buffer.size() * 2);   // A single line longer than the buffer
         }
-
-        // Load incidents
-        getline(inFile, line);  // Skip "Incidents:"
-        while (getline(inFile, line) && !line.empty()) {
-            int id, x, y, reportTime, responseTime, reportedFromStationId;
-            istringstream iss(line);
-            iss >> id >> x >> y >> reportTime >> responseTime >> reportedFromStationId;
-            addIncident(id, x, y, reportTime, responseTime);
-            incidents->incident.reportedFromStationId = reportedFromStationId;
+        size_t wanted = buffer.size() - carried;
+        long long got = readAvailable(in, buffer.data() + carried, wanted);
+        if (got < 0) {
+            cerr << "Error reading batch input.\n";
+            got = 0;
         }
-
-        // Load dispatchers
-        getline(inFile, line);  // Skip "Dispatchers:"
-        while (getline(inFile, line) && !line.empty()) {
-            int id, x, y;
-            istringstream iss(line);
-            iss >> id >> x >> y;
-            addDispatcher(id, x, y);
+        size_t filled = carried + (size_t)got;
+        bool atEnd = got == 0;
+        const char* p = buffer.data();
+        const char* limit = buffer.data() + filled;
+        while (p < limit) {
+            const char* newline = (const char*)memchr(p, '\n', limit - p);
+            if (newline == nullptr && !atEnd) {
+                break;
+            }
+            const char* lineEnd = newline != nullptr ? newline : limit;
+            const char* trimmed = lineEnd;
+            if (trimmed > p && trimmed[-1] == '\r') {
+                --trimmed;
+            }
+            ++lineNumber;
+            if (trimmed > p && !runCommand(manager, p, trimmed)) {
+                cout << "ERR line " << lineNumber << "\n";
+                ++failures;
+            }
+            p = newline != nullptr ? newline + 1 : limit;
+        }
+        carried = limit - p;
+        memmove(buffer.data(), p, carried);
+        if (atEnd) {
+            break;
+        }
+        if ((size_t)got < wanted) {
+            cout.flush();   // Caught up with the writer; the next read may wait
         }
+    }
 
-        inFile.close();
-        cout << "Data loaded from " << filename << endl;
+#ifdef _WIN32
+    if (source != "-") {
+        _close(in);
     }
-};
+#else
+    if (source != "-") {
+        ::close(in);
+    }
+#endif
+    cout.flush();
+    cout.rdbuf(console);
+    return failures == 0 ? 0 : 2;
+}
 
-int main() {
+int main(int argc, char* argv[]) {
     EmergencyManager manager;
     int choice;
 
+    // Scripted mode: rescuenet --batch [file|-]
+    if (argc >= 2 && string(argv[1]) == "--batch") {
+        return runBatch(manager, argc >= 3 ? argv[2] : "-");
+    }
+
     while (true) {
         cout << "1. Add Station\n";
         cout << "2. Add Incident\n";
@@ -360,6 +7093,28 @@ int main() {
         cout << "9. Auto Add and Assign Incident\n";
         cout << "10. Save Data to File\n";
         cout << "11. Load Data from File\n";
+        cout << "12. List Nearest Dispatchers\n";
+        cout << "13. Load Road Network\n";
+        cout << "14. Batch Assign Pending Incidents\n";
+        cout << "15. Save Binary Snapshot\n";
+        cout << "16. Load Binary Snapshot\n";
+        cout << "17. Enable Journal\n";
+        cout << "18. Compact Journal\n";
+        cout << "19. Run Simulation\n";
+        cout << "20. Show Metrics\n";
+        cout << "21. Export Metrics\n";
+        cout << "22. Incidents Reported Between\n";
+        cout << "23. Incidents Open At Time\n";
+        cout << "24. Closest Station\n";
+        cout << "25. Advance Time\n";
+        cout << "26. Dispatcher Status\n";
+        cout << "27. Dispatch Most Urgent Incident\n";
+        cout << "28. Set Incident Severity\n";
+        cout << "29. Archive Resolved Incidents\n";
+        cout << "30. Query Archive\n";
+        cout << "31. Dump State\n";
+        cout << "32. Plan Dispatcher Staging\n";
+        cout << "33. Show Incident Hotspots\n";
         cout << "0. Exit\n";
         cout << "Enter your choice: ";
         cin >> choice;
@@ -376,10 +7131,10 @@ int main() {
             break;
         }
         case 2: {
-            int id, x, y, reportTime, responseTime;
-            cout << "Enter Incident ID, X, Y, Report Time, Response Time: ";
-            cin >> id >> x >> y >> reportTime >> responseTime;
-            manager.addIncident(id, x, y, reportTime, responseTime);
+            int id, x, y, reportTime, responseTime, severity;
+            cout << "Enter Incident ID, X, Y, Report Time, Response Time, Severity (1-5): ";
+            cin >> id >> x >> y >> reportTime >> responseTime >> severity;
+            manager.addIncident(id, x, y, reportTime, responseTime, severity);
             break;
         }
         case 3: {
@@ -392,9 +7147,13 @@ int main() {
         case 4:
             manager.printLocations();
             break;
-        case 5:
-            manager.displayMap();
+        case 5: {
+            int originX, originY, rows, cols, zoom;
+            cout << "Enter map origin X, Y, rows, columns and zoom (e.g. 0 0 5 5 1): ";
+            cin >> originX >> originY >> rows >> cols >> zoom;
+            manager.displayMap(originX, originY, rows, cols, zoom);
             break;
+        }
         case 6: {
             int incidentId;
             cout << "Enter Incident ID to report: ";
@@ -433,6 +7192,185 @@ int main() {
             manager.loadFromFile(filename);
             break;
         }
+        case 12: {
+            int incidentId, k;
+            cout << "Enter Incident ID and number of dispatchers: ";
+            cin >> incidentId >> k;
+            vector<pair<int, int>> ranked = manager.kNearestDispatchers(incidentId, k);
+            for (size_t i = 0; i < ranked.size(); ++i) {
+                cout << i + 1 << ". Dispatcher ID " << ranked[i].first << ", Distance: " << ranked[i].second << "\n";
+            }
+            break;
+        }
+        case 13: {
+            string filename;
+            cout << "Enter road network filename: ";
+            cin >> filename;
+            manager.loadRoadNetwork(filename);
+            break;
+        }
+        case 14: {
+            vector<pair<int, int>> assignments = manager.assignPendingBatch();
+            for (size_t i = 0; i < assignments.size(); ++i) {
+                cout << "Incident " << assignments[i].first << " -> dispatcher " << assignments[i].second << "\n";
+            }
+            break;
+        }
+        case 15: {
+            string filename;
+            cout << "Enter snapshot filename to save: ";
+            cin >> filename;
+            manager.saveSnapshot(filename);
+            break;
+        }
+        case 16: {
+            string filename;
+            cout << "Enter snapshot filename to load: ";
+            cin >> filename;
+            manager.loadSnapshot(filename);
+            break;
+        }
+        case 17: {
+            string snapshotFilename, journalFilename;
+            cout << "Enter snapshot and journal filenames: ";
+            cin >> snapshotFilename >> journalFilename;
+            manager.enableJournal(snapshotFilename, journalFilename);
+            break;
+        }
+        case 18:
+            manager.compactJournal();
+            break;
+        case 19: {
+            size_t units, surge;
+            double speed;
+            cout << "Enter number of units (0 for all), travel speed and synthetic surge size (0 for none): ";
+            cin >> units >> speed >> surge;
+            manager.simulate(units, speed, surge);
+            break;
+        }
+        case 20:
+            manager.printMetrics();
+            break;
+        case 21: {
+            string filename;
+            cout << "Enter metrics filename: ";
+            cin >> filename;
+            manager.exportMetrics(filename);
+            break;
+        }
+        case 22: {
+            int from, to;
+            cout << "Enter start and end report times: ";
+            cin >> from >> to;
+            printIncidentIds('F', from, to, manager.incidentsReportedBetween(from, to));
+            break;
+        }
+        case 23: {
+            int time;
+            cout << "Enter time: ";
+            cin >> time;
+            printIncidentIds('O', time, time, manager.incidentsOpenDuring(time, time));
+            break;
+        }
+        case 24: {
+            int incidentId, distance;
+            cout << "Enter Incident ID to find the closest station: ";
+            cin >> incidentId;
+            int stationId = manager.closestStation(incidentId, &distance);
+            if (stationId != -1) {
+                cout << "Closest station to incident " << incidentId << " is ID " << stationId << " at distance " << distance << "\n";
+            }
+            break;
+        }
+        case 25: {
+            int time;
+            cout << "Enter time to advance: ";
+            cin >> time;
+            int returned = manager.advanceTime(time);
+            cout << returned << " dispatchers back in service, " << manager.availableDispatchers() << " available.\n";
+            break;
+        }
+        case 26: {
+            int dispatcherId;
+            cout << "Enter Dispatcher ID: ";
+            cin >> dispatcherId;
+            const Dispatcher* d = manager.dispatcherStatus(dispatcherId);
+            if (d != nullptr) {
+                printDispatcherStatus(*d);
+            }
+            break;
+        }
+        case 27: {
+            cout << manager.pendingIncidents() << " incidents awaiting dispatch.\n";
+            manager.dispatchNext();
+            break;
+        }
+        case 28: {
+            int incidentId, severity;
+            cout << "Enter Incident ID and new Severity (1-5): ";
+            cin >> incidentId >> severity;
+            if (manager.setSeverity(incidentId, severity)) {
+                cout << "Severity of incident " << incidentId << " set to " << severity << ".\n";
+            }
+            break;
+        }
+        case 29: {
+            int closedBefore;
+            cout << "Archive incidents resolved before time: ";
+            cin >> closedBefore;
+            size_t moved = manager.archiveResolved(closedBefore);
+            cout << "Archived " << moved << " incidents; " << manager.archivedIncidents() << " in the archive using "
+                << manager.archiveBytes() << " bytes.\n";
+            break;
+        }
+        case 30: {
+            ArchiveQuery query;
+            cout << "Enter report time range and box (from to minX minY maxX maxY): ";
+            cin >> query.fromTime >> query.toTime >> query.minX >> query.minY >> query.maxX >> query.maxY;
+            printArchiveSummary(manager.queryArchive(query));
+            break;
+        }
+        case 31: {
+            string line;
+            cout << "Enter kinds (* or letters of sida), optional box (minX minY maxX maxY) and a filename, - for the screen: ";
+            cin >> ws;
+            getline(cin, line);
+            const char* p = line.c_str();
+            const char* end = p + line.size();
+            OutputFilter filter;
+            string target;
+            if (!nextOutputFilter(p, end, filter) || (target = restOfLine(p, end)).empty()) {
+                cout << "Invalid dump request.\n";
+                break;
+            }
+            manager.dumpState(target, filter);
+            break;
+        }
+        case 32:
+        case 33: {
+            int count;
+            HotspotOptions options = HotspotOptions{ 0, 0, 0, 0, 0 };
+            cout << (choice == 32 ? "Enter number of staging positions" : "Enter number of hotspots")
+                << ", report time window (from to), period (0 for none) and cell size (0 for automatic): ";
+            cin >> count >> options.fromTime >> options.toTime >> options.period >> options.cellSize;
+            if (count <= 0) {
+                cout << "Invalid count.\n";
+                break;
+            }
+            if (choice == 32) {
+                StagingPlan plan;
+                if (manager.planStaging((size_t)count, options, plan)) {
+                    printStagingPlan(plan);
+                }
+            }
+            else {
+                vector<HotspotCell> cells;
+                if (manager.incidentHotspots((size_t)count, options, cells)) {
+                    printHotspots(cells);
+                }
+            }
+            break;
+        }
         case 0:
             return 0;
         default:
@@ -0,0 +1,317 @@
+// Growable entity storage for the array build of EmergencyManager, which
+// keeps its records here and finds them by ID through maps of handles.
+//
+// EntityStore keeps records in one contiguous vector, so iteration is a
+// linear walk with no pointer chasing. ListEntityStore keeps each record in
+// its own linked node, like the list build. Both give out stable handles
+// that survive growth and removal of other records, and both iterate in
+// insertion order until something is erased.
+//
+// EntityBackend<T> is the store a build should use: the contiguous one by
+// default, or the linked one when compiled with -DRESCUENET_LIST_BACKEND.
+#ifndef RESCUENET_ENTITY_STORE_H
+#define RESCUENET_ENTITY_STORE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+struct EntityHandle {
+    uint32_t slot;         // Entry in the store's handle table
+    uint32_t generation;   // Must match the slot's generation to resolve
+};
+
+const EntityHandle NO_ENTITY = { UINT32_MAX, 0 };
+
+// Maps handles to wherever a record currently lives. Erasing bumps the
+// slot's generation, so a stale handle stops resolving once its slot is
+// reused.
+template <typename Location>
+class HandleTable {
+private:
+    struct Slot {
+        Location where;
+        uint32_t generation;
+        bool live;
+    };
+
+    std::vector<Slot> slots;
+    std::vector<uint32_t> freeSlots;
+
+public:
+    EntityHandle acquire(Location where) {
+        uint32_t slot;
+        if (!freeSlots.empty()) {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        else {
+            slot = (uint32_t)slots.size();
+            slots.push_back(Slot{ where, 0, false });
+        }
+        slots[slot].where = where;
+        slots[slot].live = true;
+        return EntityHandle{ slot, slots[slot].generation };
+    }
+
+    bool resolve(EntityHandle handle, Location& where) const {
+        if (handle.slot >= slots.size()) {
+            return false;
+        }
+        const Slot& entry = slots[handle.slot];
+        if (!entry.live || entry.generation != handle.generation) {
+            return false;
+        }
+        where = entry.where;
+        return true;
+    }
+
+    void move(uint32_t slot, Location where) {
+        slots[slot].where = where;
+    }
+
+    void release(uint32_t slot) {
+        slots[slot].live = false;
+        ++slots[slot].generation;
+        freeSlots.push_back(slot);
+    }
+
+    // Invalidates every handle but keeps the slots, so generations keep counting up
+    void clear() {
+        freeSlots.clear();
+        for (size_t i = slots.size(); i-- > 0;) {
+            if (slots[i].live) {
+                slots[i].live = false;
+                ++slots[i].generation;
+            }
+            freeSlots.push_back((uint32_t)i);
+        }
+    }
+
+    void reserve(size_t n) {
+        slots.reserve(n);
+    }
+};
+
+// Contiguous store: amortized O(1) insert, O(1) lookup by handle, and O(1)
+// erase by moving the last record into the hole
+template <typename T>
+class EntityStore {
+private:
+    std::vector<T> items;
+    std::vector<uint32_t> slotOf;   // Handle slot of each record, parallel to items
+    HandleTable<uint32_t> handles;  // Handle slot -> index into items
+
+public:
+    typedef T* iterator;
+    typedef const T* const_iterator;
+
+    EntityHandle insert(const T& item) {
+        EntityHandle handle = handles.acquire((uint32_t)items.size());
+        items.push_back(item);
+        slotOf.push_back(handle.slot);
+        return handle;
+    }
+
+    T* get(EntityHandle handle) {
+        uint32_t index;
+        return handles.resolve(handle, index) ? &items[index] : nullptr;
+    }
+
+    bool erase(EntityHandle handle) {
+        uint32_t index;
+        if (!handles.resolve(handle, index)) {
+            return false;
+        }
+        size_t last = items.size() - 1;
+        if (index != last) {
+            items[index] = std::move(items[last]);
+            slotOf[index] = slotOf[last];
+            handles.move(slotOf[index], index);
+        }
+        items.pop_back();
+        slotOf.pop_back();
+        handles.release(handle.slot);
+        return true;
+    }
+
+    void reserve(size_t n) {
+        items.reserve(n);
+        slotOf.reserve(n);
+        handles.reserve(n);
+    }
+
+    void clear() {
+        items.clear();
+        slotOf.clear();
+        handles.clear();
+    }
+
+    size_t size() const {
+        return items.size();
+    }
+
+    bool empty() const {
+        return items.empty();
+    }
+
+    iterator begin() {
+        return items.data();
+    }
+
+    iterator end() {
+        return items.data() + items.size();
+    }
+
+    const_iterator begin() const {
+        return items.data();
+    }
+
+    const_iterator end() const {
+        return items.data() + items.size();
+    }
+};
+
+// Linked store with the same interface: one node per record, appended at
+// the tail and unlinked in O(1) on erase
+template <typename T>
+class ListEntityStore {
+private:
+    struct Node {
+        T item;
+        Node* prev;
+        Node* next;
+        uint32_t slot;
+    };
+
+    Node* head;
+    Node* tail;
+    size_t count;
+    HandleTable<Node*> handles;
+
+    template <typename Value, typename NodeType>
+    class Iterator {
+    private:
+        NodeType* node;
+
+    public:
+        explicit Iterator(NodeType* node) : node(node) {}
+
+        Value& operator*() const {
+            return node->item;
+        }
+
+        Value* operator->() const {
+            return &node->item;
+        }
+
+        Iterator& operator++() {
+            node = node->next;
+            return *this;
+        }
+
+        bool operator==(const Iterator& other) const {
+            return node == other.node;
+        }
+
+        bool operator!=(const Iterator& other) const {
+            return node != other.node;
+        }
+    };
+
+public:
+    typedef Iterator<T, Node> iterator;
+    typedef Iterator<const T, const Node> const_iterator;
+
+    ListEntityStore() : head(nullptr), tail(nullptr), count(0) {}
+
+    ~ListEntityStore() {
+        clear();
+    }
+
+    ListEntityStore(const ListEntityStore&) = delete;
+    ListEntityStore& operator=(const ListEntityStore&) = delete;
+
+    EntityHandle insert(const T& item) {
+        Node* node = new Node{ item, tail, nullptr, 0 };
+        EntityHandle handle = handles.acquire(node);
+        node->slot = handle.slot;
+        if (tail != nullptr) {
+            tail->next = node;
+        }
+        else {
+            head = node;
+        }
+        tail = node;
+        ++count;
+        return handle;
+    }
+
+    T* get(EntityHandle handle) {
+        Node* node;
+        return handles.resolve(handle, node) ? &node->item : nullptr;
+    }
+
+    bool erase(EntityHandle handle) {
+        Node* node;
+        if (!handles.resolve(handle, node)) {
+            return false;
+        }
+        (node->prev != nullptr ? node->prev->next : head) = node->next;
+        (node->next != nullptr ? node->next->prev : tail) = node->prev;
+        handles.release(node->slot);
+        delete node;
+        --count;
+        return true;
+    }
+
+    void reserve(size_t n) {
+        handles.reserve(n);
+    }
+
+    void clear() {
+        while (head != nullptr) {
+            Node* next = head->next;
+            delete head;
+            head = next;
+        }
+        tail = nullptr;
+        count = 0;
+        handles.clear();
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    bool empty() const {
+        return count == 0;
+    }
+
+    iterator begin() {
+        return iterator(head);
+    }
+
+    iterator end() {
+        return iterator(nullptr);
+    }
+
+    const_iterator begin() const {
+        return const_iterator(head);
+    }
+
+    const_iterator end() const {
+        return const_iterator(nullptr);
+    }
+};
+
+#ifdef RESCUENET_LIST_BACKEND
+template <typename T>
+using EntityBackend = ListEntityStore<T>;
+#else
+template <typename T>
+using EntityBackend = EntityStore<T>;
+#endif
+
+#endif
@@ -0,0 +1,767 @@
+// Behavioural tests for the list build, dsProject_22i0503_21i0281_verfinal.cpp.
+//
+// Each test checks one structure against a brute-force answer, or two
+// routes to the same state against each other. The entity stores of the
+// array build are checked here too:
+//   batch    - BatchAssignment against a Hungarian reference
+//   grid     - PointGrid k-nearest against a linear scan, with sparse and
+//              negative coordinates
+//   archive  - IncidentArchive decode, serialize and summaries against the
+//              rows that went in
+//   snapshot - binary and text snapshots reload to the same state
+//   journal  - replay after a compaction rebuilds the same state
+//   sharded  - ShardedManager assigns the units one manager would
+//   store    - EntityStore and ListEntityStore handles against a map of
+//              live records, through erases and clears
+//
+// Build:  g++ -std=c++17 -O2 -pthread -o tests tests.cpp
+// Usage:  tests [--tests batch,grid,archive,snapshot,journal,sharded,store]
+//               [--seed S] [--tmp DIR]
+//
+// Prints one PASS or FAIL line per test and exits with 1 if any failed.
+#define main rescuenet_list_main
+#include "dsProject_22i0503_21i0281_verfinal.cpp"
+#undef main
+
+#include "entity_store.h"
+#include <map>
+#include <random>
+#include <tuple>
+
+struct Options {
+    vector<string> tests;
+    uint64_t seed;
+    string tmpDir;
+};
+
+// Swallows what the managers print while a test runs
+class NullBuffer : public streambuf {
+protected:
+    int overflow(int c) override {
+        return c;
+    }
+
+    streamsize xsputn(const char*, streamsize n) override {
+        return n;
+    }
+};
+
+vector<string> splitList(const string& text) {
+    vector<string> parts;
+    stringstream ss(text);
+    string part;
+    while (getline(ss, part, ',')) {
+        if (!part.empty()) {
+            parts.push_back(part);
+        }
+    }
+    return parts;
+}
+
+bool wants(const vector<string>& list, const string& name) {
+    return find(list.begin(), list.end(), name) != list.end();
+}
+
+int randomInt(mt19937_64& rng, int lo, int hi) {
+    return uniform_int_distribution<int>(lo, hi)(rng);
+}
+
+long long manhattan(const IndexedPoint& a, const IndexedPoint& b) {
+    return llabs((long long)a.x - b.x) + llabs((long long)a.y - b.y);
+}
+
+// Minimum total distance over every matching of rows to distinct columns,
+// by the O(n^2 m) Hungarian method with potentials
+long long referenceAssignment(const vector<IndexedPoint>& rows, const vector<IndexedPoint>& cols) {
+    const long long INF = LLONG_MAX / 4;
+    size_t n = rows.size(), m = cols.size();
+    vector<long long> u(n + 1, 0), v(m + 1, 0);
+    vector<size_t> rowOf(m + 1, 0), way(m + 1, 0);
+    for (size_t i = 1; i <= n; ++i) {
+        rowOf[0] = i;
+        size_t col = 0;
+        vector<long long> minv(m + 1, INF);
+        vector<bool> used(m + 1, false);
+        do {
+            used[col] = true;
+            size_t row = rowOf[col], next = 0;
+            long long delta = INF;
+            for (size_t j = 1; j <= m; ++j) {
+                if (used[j]) {
+                    continue;
+                }
+                long long cur = manhattan(rows[row - 1], cols[j - 1]) - u[row] - v[j];
+                if (cur < minv[j]) {
+                    minv[j] = cur;
+                    way[j] = col;
+                }
+                if (minv[j] < delta) {
+                    delta = minv[j];
+                    next = j;
+                }
+            }
+            for (size_t j = 0; j <= m; ++j) {
+                if (used[j]) {
+                    u[rowOf[j]] += delta;
+                    v[j] -= delta;
+                }
+                else {
+                    minv[j] -= delta;
+                }
+            }
+            col = next;
+        } while (rowOf[col] != 0);
+        do {
+            size_t previous = way[col];
+            rowOf[col] = rowOf[previous];
+            col = previous;
+        } while (col != 0);
+    }
+    long long total = 0;
+    for (size_t j = 1; j <= m; ++j) {
+        if (rowOf[j] != 0) {
+            total += manhattan(rows[rowOf[j] - 1], cols[j - 1]);
+        }
+    }
+    return total;
+}
+
+// Each test returns an empty string when it passes, or what went wrong
+
+string testBatch(mt19937_64& rng, const Options&) {
+    const int spans[] = { 3, 50, 100000, 100000000 };
+    for (int trial = 0; trial < 1000; ++trial) {
+        int n = randomInt(rng, 1, 40);
+        int m = n + (trial % 3 == 0 ? 0 : randomInt(rng, 0, 40));
+        int span = spans[trial % 4];
+        vector<IndexedPoint> rows(n), cols(m);
+        for (int i = 0; i < n; ++i) {
+            rows[i] = IndexedPoint{ i, randomInt(rng, -span, span), randomInt(rng, -span, span) };
+        }
+        for (int j = 0; j < m; ++j) {
+            cols[j] = IndexedPoint{ j, randomInt(rng, -span, span), randomInt(rng, -span, span) };
+        }
+        // Columns on one short line, so many matchings tie
+        if (trial % 5 == 0) {
+            for (int j = 0; j < m; ++j) {
+                cols[j].x = randomInt(rng, 0, 60);
+                cols[j].y = 0;
+            }
+        }
+
+        BatchAssignment solver(rows, cols);
+        long long totalCost;
+        vector<int> match = solver.solve(totalCost);
+        ostringstream where;
+        where << "trial " << trial << " (" << n << " rows, " << m << " columns)";
+        if ((int)match.size() != n || !solver.isExact()) {
+            return where.str() + ": incomplete or approximate result";
+        }
+        vector<bool> taken(m, false);
+        long long sum = 0;
+        for (int i = 0; i < n; ++i) {
+            if (match[i] < 0 || match[i] >= m || taken[match[i]]) {
+                return where.str() + ": column used twice or out of range";
+            }
+            taken[match[i]] = true;
+            sum += manhattan(rows[i], cols[match[i]]);
+        }
+        long long expected = referenceAssignment(rows, cols);
+        if (sum != totalCost || totalCost != expected) {
+            ostringstream detail;
+            detail << where.str() << ": cost " << totalCost << ", matching sums to " << sum << ", optimum " << expected;
+            return detail.str();
+        }
+    }
+    return "";
+}
+
+string testGrid(mt19937_64& rng, const Options&) {
+    const int spans[] = { 10, 1000, 100000, 100000000 };
+    const int POINTS = 400;
+    for (int trial = 0; trial < 200; ++trial) {
+        int span = spans[trial % 4];
+        PointGrid<IndexedPoint> grid(trial % 2 ? 16 : 1);
+        vector<IndexedPoint> points(POINTS);
+        vector<bool> inGrid(POINTS, false);
+        for (int i = 0; i < POINTS; ++i) {
+            points[i] = IndexedPoint{ i, randomInt(rng, -span, span), randomInt(rng, -span, span) };
+        }
+        // Sparse: a tight cluster at the origin and a few points at the far corners
+        if (trial % 5 == 0) {
+            for (int i = 0; i < POINTS; ++i) {
+                bool far = i % 40 == 0;
+                int sx = far && i % 80 == 0 ? -1 : 1;
+                int sy = far && i % 120 == 0 ? -1 : 1;
+                points[i].x = far ? sx * 100000000 + randomInt(rng, -5, 5) : randomInt(rng, -5, 5);
+                points[i].y = far ? sy * 100000000 + randomInt(rng, -5, 5) : randomInt(rng, -5, 5);
+            }
+        }
+        if (trial % 3 == 0) {
+            vector<IndexedPoint*> initial;
+            for (int i = 0; i < POINTS / 2; ++i) {
+                initial.push_back(&points[i]);
+                inGrid[i] = true;
+            }
+            grid.rebuild(initial);
+        }
+
+        for (int op = 0; op < 600; ++op) {
+            int i = randomInt(rng, 0, POINTS - 1);
+            if (!inGrid[i]) {
+                grid.insert(&points[i]);
+                inGrid[i] = true;
+            }
+            else if (randomInt(rng, 0, 2) == 0) {
+                if (!grid.remove(&points[i])) {
+                    return "trial " + to_string(trial) + ": remove of a present point failed";
+                }
+                inGrid[i] = false;
+            }
+
+            int qx = randomInt(rng, -2 * span, 2 * span);
+            int qy = randomInt(rng, -2 * span, 2 * span);
+            size_t k = (size_t)randomInt(rng, 1, 12);
+            long long limit = randomInt(rng, 0, 3) == 0 ? randomInt(rng, 0, 2 * span) : LLONG_MAX;
+            vector<pair<int, int>> expected;   // (distance, ID)
+            for (int j = 0; j < POINTS; ++j) {
+                long long distance = llabs((long long)qx - points[j].x) + llabs((long long)qy - points[j].y);
+                if (inGrid[j] && distance < limit) {
+                    expected.push_back(make_pair((int)distance, j));
+                }
+            }
+            sort(expected.begin(), expected.end());
+            if (expected.size() > k) {
+                expected.resize(k);
+            }
+
+            vector<GridCandidate<IndexedPoint>> found = grid.kNearest(qx, qy, k, limit);
+            bool same = found.size() == expected.size();
+            for (size_t j = 0; same && j < found.size(); ++j) {
+                same = found[j].distance == expected[j].first && found[j].node->index == expected[j].second;
+            }
+            if (!same) {
+                ostringstream detail;
+                detail << "trial " << trial << ", query (" << qx << ", " << qy << ") k " << k << ": found "
+                    << found.size() << " points, expected " << expected.size() << " or a different order";
+                return detail.str();
+            }
+        }
+    }
+    return "";
+}
+
+tuple<int, int, int, int, int, int, int, int> incidentKey(const Incident& in) {
+    return make_tuple(in.reportTime, in.id, in.x, in.y, in.responseTime, in.reportedFromStationId, in.assignedDispatcherId, in.severity);
+}
+
+bool sameIncidents(vector<Incident> a, vector<Incident> b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    auto byKey = [](const Incident& l, const Incident& r) { return incidentKey(l) < incidentKey(r); };
+    sort(a.begin(), a.end(), byKey);
+    sort(b.begin(), b.end(), byKey);
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (incidentKey(a[i]) != incidentKey(b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Coordinates near zero, at the int limits, or anywhere between
+int archiveCoordinate(mt19937_64& rng) {
+    switch (randomInt(rng, 0, 5)) {
+    case 0:
+        return INT_MIN + randomInt(rng, 0, 3);
+    case 1:
+        return INT_MAX - randomInt(rng, 0, 3);
+    case 2:
+        return randomInt(rng, INT_MIN, INT_MAX);
+    default:
+        return randomInt(rng, -1000, 1000);
+    }
+}
+
+string testArchive(mt19937_64& rng, const Options&) {
+    IncidentArchive archive;
+    vector<Incident> rows;
+    // The short middle batch leaves a partly filled block for the next to merge with
+    const size_t batches[] = { 5000, 700, 9000 };
+    int nextId = -20000;
+    for (size_t b = 0; b < 3; ++b) {
+        vector<Incident> batch;
+        for (size_t i = 0; i < batches[b]; ++i) {
+            Incident in;
+            in.id = nextId;
+            nextId += randomInt(rng, 1, 3);
+            in.x = archiveCoordinate(rng);
+            in.y = archiveCoordinate(rng);
+            in.reportTime = randomInt(rng, -1000, 1000000);
+            in.responseTime = in.reportTime + randomInt(rng, -100, 100000);
+            in.reportedFromStationId = randomInt(rng, -1, 1000000);
+            in.assignedDispatcherId = randomInt(rng, -1, 1000000);
+            in.severity = randomInt(rng, SEVERITY_MINOR, SEVERITY_CRITICAL);
+            batch.push_back(in);
+        }
+        rows.insert(rows.end(), batch.begin(), batch.end());
+        archive.append(batch);
+    }
+    if (archive.size() != rows.size()) {
+        return "archive holds " + to_string(archive.size()) + " rows, " + to_string(rows.size()) + " went in";
+    }
+
+    vector<Incident> decoded;
+    archive.decodeAll(decoded);
+    if (!sameIncidents(decoded, rows)) {
+        return "decoded rows differ from the rows appended";
+    }
+
+    string stored;
+    archive.serialize(stored);
+    IncidentArchive reloaded;
+    if (!reloaded.deserialize(stored.data(), stored.size())) {
+        return "serialized blocks did not load back";
+    }
+    vector<Incident> redecoded;
+    reloaded.decodeAll(redecoded);
+    if (redecoded.size() != decoded.size()) {
+        return "reloaded archive has a different row count";
+    }
+    for (size_t i = 0; i < decoded.size(); ++i) {
+        if (incidentKey(redecoded[i]) != incidentKey(decoded[i])) {
+            return "reloaded archive differs at row " + to_string(i);
+        }
+    }
+
+    for (int q = 0; q < 200; ++q) {
+        ArchiveQuery query;
+        query.fromTime = randomInt(rng, -2000, 1000000);
+        query.toTime = query.fromTime + randomInt(rng, 0, 600000);
+        if (q % 4 == 0) {
+            query.minX = query.minY = INT_MIN;
+            query.maxX = query.maxY = INT_MAX;
+        }
+        else {
+            query.minX = archiveCoordinate(rng);
+            query.maxX = max(query.minX, archiveCoordinate(rng));
+            query.minY = archiveCoordinate(rng);
+            query.maxY = max(query.minY, archiveCoordinate(rng));
+        }
+
+        ArchiveSummary expected = ArchiveSummary();
+        long long totalResponse = 0;
+        long long maxResponse = LLONG_MIN;
+        vector<Incident> inBox;
+        for (size_t i = 0; i < rows.size(); ++i) {
+            const Incident& in = rows[i];
+            bool boxed = in.x >= query.minX && in.x <= query.maxX && in.y >= query.minY && in.y <= query.maxY;
+            if (boxed) {
+                inBox.push_back(in);
+            }
+            if (boxed && in.reportTime >= query.fromTime && in.reportTime <= query.toTime) {
+                long long response = (long long)in.responseTime - in.reportTime;
+                ++expected.incidents;
+                ++expected.bySeverity[in.severity];
+                totalResponse += response;
+                maxResponse = max(maxResponse, response);
+            }
+        }
+        expected.meanResponse = expected.incidents > 0 ? (double)totalResponse / expected.incidents : 0;
+        expected.maxResponse = expected.incidents > 0 ? maxResponse : 0;
+
+        ArchiveSummary got = archive.summarize(query);
+        bool same = got.incidents == expected.incidents && got.meanResponse == expected.meanResponse && got.maxResponse == expected.maxResponse;
+        for (int s = 0; s <= SEVERITY_CRITICAL; ++s) {
+            same = same && got.bySeverity[s] == expected.bySeverity[s];
+        }
+        if (!same) {
+            return "query " + to_string(q) + ": summary of " + to_string(got.incidents) + " incidents, expected " + to_string(expected.incidents);
+        }
+
+        vector<Incident> found;
+        archive.decodeInBox(query.minX, query.minY, query.maxX, query.maxY, found);
+        if (!sameIncidents(found, inBox)) {
+            return "query " + to_string(q) + ": box decode returned " + to_string(found.size()) + " rows, expected " + to_string(inBox.size());
+        }
+    }
+    return "";
+}
+
+string readFile(const string& filename) {
+    ifstream in(filename, ios::binary);
+    return string((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+}
+
+// Everything the text format records, archived incidents included
+string stateOf(EmergencyManager& manager, const string& scratch) {
+    if (!manager.dumpState(scratch, OUTPUT_EVERYTHING)) {
+        return "";
+    }
+    string state = readFile(scratch);
+    remove(scratch.c_str());
+    return state;
+}
+
+// Stations, units and incidents around the origin, some reported, assigned,
+// under way, resolved and archived, with units still out
+void populate(EmergencyManager& manager, mt19937_64& rng, int incidentCount) {
+    manager.setUnitTiming(2, 5);
+    for (int id = 1; id <= 8; ++id) {
+        manager.addStation(id, randomInt(rng, -500, 500), randomInt(rng, -500, 500), "Station " + to_string(id));
+    }
+    for (int id = 1; id <= 30; ++id) {
+        manager.addDispatcher(id, randomInt(rng, -500, 500), randomInt(rng, -500, 500));
+    }
+    for (int i = 0; i < incidentCount; ++i) {
+        int id = 1000 + i;
+        manager.addIncident(id, randomInt(rng, -500, 500), randomInt(rng, -500, 500), i, i + randomInt(rng, 1, 50), randomInt(rng, SEVERITY_MINOR, SEVERITY_CRITICAL));
+        if (i % 3 != 0) {
+            manager.reportIncident(id, randomInt(rng, 1, 8));
+        }
+        if (i % 4 == 0) {
+            manager.setSeverity(id, SEVERITY_CRITICAL);
+        }
+        if (i % 2 == 0) {
+            manager.assignDispatcher(id);
+        }
+        if (i % 10 == 9) {
+            manager.advanceTime(randomInt(rng, 20, 200));
+            while (manager.dispatchNext() != -1) {
+            }
+        }
+        if (i % 25 == 24) {
+            manager.archiveResolved(i - 10);
+        }
+    }
+}
+
+// The same state with the records of each section in sorted order. Loading
+// the text format links each record at the head of its list, which
+// reverses the order the file lists them in.
+string sortedSections(const string& state) {
+    istringstream in(state);
+    string line, result;
+    vector<string> records;
+    while (true) {
+        bool more = (bool)getline(in, line);
+        if (!more || (!line.empty() && line.back() == ':')) {
+            sort(records.begin(), records.end());
+            for (size_t i = 0; i < records.size(); ++i) {
+                result += records[i] + "\n";
+            }
+            records.clear();
+            if (!more) {
+                return result;
+            }
+            result += line + "\n";
+        }
+        else {
+            records.push_back(line);
+        }
+    }
+}
+
+string testSnapshot(mt19937_64& rng, const Options& options) {
+    string binary = options.tmpDir + "/rescuenet_test_snapshot.bin";
+    string text = options.tmpDir + "/rescuenet_test_snapshot.txt";
+    string scratch = options.tmpDir + "/rescuenet_test_state.txt";
+
+    EmergencyManager* original = new EmergencyManager();
+    populate(*original, rng, 120);
+    string state = stateOf(*original, scratch);
+    string result;
+    if (state.empty() || original->archivedIncidents() == 0) {
+        result = "could not build a state with archived incidents";
+    }
+
+    EmergencyManager* fromBinary = new EmergencyManager();
+    if (result.empty() && !(original->writeSnapshot(binary) && fromBinary->loadSnapshot(binary))) {
+        result = "binary snapshot did not save and load";
+    }
+    if (result.empty() && stateOf(*fromBinary, scratch) != state) {
+        result = "binary snapshot reloaded to a different state";
+    }
+    // Units still out must carry on the same way
+    if (result.empty()) {
+        original->advanceTime(300);
+        fromBinary->advanceTime(300);
+        while (original->dispatchNext() != -1) {
+        }
+        while (fromBinary->dispatchNext() != -1) {
+        }
+        state = stateOf(*original, scratch);
+        if (stateOf(*fromBinary, scratch) != state || fromBinary->availableDispatchers() != original->availableDispatchers()) {
+            result = "binary snapshot diverged once time moved on";
+        }
+    }
+
+    EmergencyManager* fromText = new EmergencyManager();
+    if (result.empty()) {
+        original->saveToFile(text);
+        fromText->loadFromFile(text);
+        if (sortedSections(stateOf(*fromText, scratch)) != sortedSections(state)) {
+            result = "text snapshot reloaded to a different state";
+        }
+    }
+
+    delete original;
+    delete fromBinary;
+    delete fromText;
+    remove(binary.c_str());
+    remove(text.c_str());
+    return result;
+}
+
+string testJournal(mt19937_64& rng, const Options& options) {
+    string snapshot = options.tmpDir + "/rescuenet_test_journal.snap";
+    string journal = options.tmpDir + "/rescuenet_test_journal.log";
+    string scratch = options.tmpDir + "/rescuenet_test_state.txt";
+    remove(snapshot.c_str());
+    remove(journal.c_str());
+
+    // Half the history goes into the snapshot at the compaction, half stays in the journal
+    EmergencyManager* original = new EmergencyManager();
+    string result;
+    if (!original->enableJournal(snapshot, journal)) {
+        result = "journal did not start";
+    }
+    if (result.empty()) {
+        populate(*original, rng, 60);
+        if (!original->compactJournal()) {
+            result = "compaction failed";
+        }
+    }
+    string state;
+    if (result.empty()) {
+        for (int i = 0; i < 60; ++i) {
+            int id = 5000 + i;
+            original->addIncident(id, randomInt(rng, -500, 500), randomInt(rng, -500, 500), 200 + i, 260 + i, randomInt(rng, SEVERITY_MINOR, SEVERITY_CRITICAL));
+            original->reportIncident(id, randomInt(rng, 1, 8));
+            original->assignDispatcher(id);
+            if (i % 15 == 14) {
+                original->advanceTime(100);
+                while (original->dispatchNext() != -1) {
+                }
+                original->archiveResolved(200 + i);
+            }
+        }
+        original->addDispatcher(99, -700, 700);
+        original->setUnitTiming(3, 4);
+        state = stateOf(*original, scratch);
+    }
+    // Closing commits the journal's last group, as a clean shutdown would
+    delete original;
+
+    EmergencyManager* recovered = new EmergencyManager();
+    if (result.empty() && !recovered->enableJournal(snapshot, journal)) {
+        result = "recovery failed";
+    }
+    if (result.empty() && stateOf(*recovered, scratch) != state) {
+        result = "replayed state differs from the state before shutdown";
+    }
+    delete recovered;
+    remove(snapshot.c_str());
+    remove(journal.c_str());
+    return result;
+}
+
+string testSharded(mt19937_64& rng, const Options&) {
+    const size_t shardCounts[] = { 1, 2, 4 };
+    for (size_t s = 0; s < 3; ++s) {
+        size_t shardCount = shardCounts[s];
+        vector<int> splits;
+        for (size_t i = 1; i < shardCount; ++i) {
+            splits.push_back(-1000 + (int)(2000 * i / shardCount));
+        }
+        ShardedManager* sharded = new ShardedManager(splits);
+        EmergencyManager* single = new EmergencyManager();
+        for (int id = 1; id <= 60; ++id) {
+            int x = randomInt(rng, -1000, 1000), y = randomInt(rng, -300, 300);
+            sharded->addDispatcher(id, x, y);
+            single->addDispatcher(id, x, y);
+        }
+
+        // One incident at a time, so the workers see them in submission order
+        string result;
+        vector<int> ids;
+        for (int i = 0; i < 400 && result.empty(); ++i) {
+            int id = 1 + i;
+            int x = randomInt(rng, -1000, 1000), y = randomInt(rng, -300, 300);
+            int severity = randomInt(rng, SEVERITY_MINOR, SEVERITY_CRITICAL);
+            sharded->submitIncident(id, x, y, i, i + 10, severity);
+            sharded->drain();
+            single->addIncident(id, x, y, i, i + 10, severity);
+            single->assignDispatcher(id);
+            ids.push_back(id);
+
+            // Units that come back go to the waiting incidents, most urgent first
+            if (i % 40 == 39) {
+                int time = randomInt(rng, 100, 1500);
+                sharded->advanceTime(time);
+                if (single->advanceTime(time) > 0) {
+                    while (single->dispatchNext() != -1) {
+                    }
+                }
+            }
+            if (i % 20 == 19 || i == 399) {
+                for (size_t j = 0; j < ids.size() && result.empty(); ++j) {
+                    int expected = single->assignedDispatcher(ids[j]);
+                    int got = sharded->assignedDispatcher(ids[j]);
+                    if (got != expected) {
+                        ostringstream detail;
+                        detail << shardCount << " shards: incident " << ids[j] << " got unit " << got << ", one manager sent " << expected;
+                        result = detail.str();
+                    }
+                }
+                if (result.empty() && sharded->availableDispatchers() != single->availableDispatchers()) {
+                    result = to_string(shardCount) + " shards: free unit count differs from one manager";
+                }
+            }
+        }
+        delete sharded;
+        delete single;
+        if (!result.empty()) {
+            return result;
+        }
+    }
+    return "";
+}
+
+// Random inserts and erases, with stale handles kept around to check they
+// stop resolving, against a map of what should be live
+template <typename Store>
+string checkStore(mt19937_64& rng, const string& name) {
+    Store store;
+    map<int, EntityHandle> live;    // Value -> handle
+    vector<EntityHandle> stale;
+    int nextValue = 0;
+    for (int op = 0; op < 20000; ++op) {
+        int choice = randomInt(rng, 0, 9);
+        if (op % 5000 == 4999) {
+            store.clear();
+            for (auto it = live.begin(); it != live.end(); ++it) {
+                stale.push_back(it->second);
+            }
+            live.clear();
+        }
+        else if (choice < 5 || live.empty()) {
+            live[nextValue] = store.insert(nextValue);
+            ++nextValue;
+        }
+        else if (choice < 8) {
+            auto victim = live.lower_bound(randomInt(rng, 0, nextValue));
+            if (victim == live.end()) {
+                victim = live.begin();
+            }
+            if (!store.erase(victim->second)) {
+                return name + ": erase of a live record failed";
+            }
+            stale.push_back(victim->second);
+            live.erase(victim);
+        }
+        else if (!stale.empty()) {
+            EntityHandle handle = stale[randomInt(rng, 0, (int)stale.size() - 1)];
+            if (store.get(handle) != nullptr || store.erase(handle)) {
+                return name + ": a handle still resolved after its record was erased";
+            }
+        }
+
+        if (store.size() != live.size()) {
+            return name + ": holds " + to_string(store.size()) + " records, expected " + to_string(live.size());
+        }
+        if (op % 500 == 0) {
+            for (auto it = live.begin(); it != live.end(); ++it) {
+                int* value = store.get(it->second);
+                if (value == nullptr || *value != it->first) {
+                    return name + ": handle of record " + to_string(it->first) + " does not resolve to it";
+                }
+            }
+            vector<int> seen;
+            for (auto it = store.begin(); it != store.end(); ++it) {
+                seen.push_back(*it);
+            }
+            sort(seen.begin(), seen.end());
+            if (seen.size() != live.size()) {
+                return name + ": iteration does not visit exactly the live records";
+            }
+            size_t i = 0;
+            for (auto it = live.begin(); it != live.end(); ++it, ++i) {
+                if (seen[i] != it->first) {
+                    return name + ": iteration does not visit exactly the live records";
+                }
+            }
+        }
+    }
+    return "";
+}
+
+string testStore(mt19937_64& rng, const Options&) {
+    string failure = checkStore<EntityStore<int>>(rng, "EntityStore");
+    return failure.empty() ? checkStore<ListEntityStore<int>>(rng, "ListEntityStore") : failure;
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    options.tests = { "batch", "grid", "archive", "snapshot", "journal", "sharded", "store" };
+    options.seed = 42;
+    options.tmpDir = ".";
+
+    for (int i = 1; i < argc; i += 2) {
+        string flag = argv[i];
+        if (i + 1 == argc) {
+            cerr << "Option " << flag << " needs a value\n";
+            return 1;
+        }
+        string value = argv[i + 1];
+        if (flag == "--tests") {
+            options.tests = splitList(value);
+        }
+        else if (flag == "--seed") {
+            options.seed = stoull(value);
+        }
+        else if (flag == "--tmp") {
+            options.tmpDir = value;
+        }
+        else {
+            cerr << "Unknown option " << flag << "\n";
+            return 1;
+        }
+    }
+
+    struct Test {
+        const char* name;
+        string (*run)(mt19937_64&, const Options&);
+    };
+    const Test tests[] = {
+        { "batch", testBatch },
+        { "grid", testGrid },
+        { "archive", testArchive },
+        { "snapshot", testSnapshot },
+        { "journal", testJournal },
+        { "sharded", testSharded },
+        { "store", testStore },
+    };
+
+    NullBuffer sink;
+    streambuf* console = cout.rdbuf();
+    int failed = 0;
+    for (const Test& test : tests) {
+        if (!wants(options.tests, test.name)) {
+            continue;
+        }
+        mt19937_64 rng(options.seed);
+        cout.rdbuf(&sink);
+        string failure = test.run(rng, options);
+        cout.rdbuf(console);
+        if (failure.empty()) {
+            cout << "PASS " << test.name << "\n";
+        }
+        else {
+            cout << "FAIL " << test.name << ": " << failure << "\n";
+            ++failed;
+        }
+    }
+    return failed > 0 ? 1 : 0;
+}